@@ -0,0 +1,186 @@
+#pragma once
+
+#include "scanline.h"
+#include "canvas.h"
+
+/// Сглаженная заливка накоплением площади, как в растеризаторах шрифтов (font-rs): каждое ребро
+/// добавляет в ячейки своих строк знаковую площадь, отсекаемую им справа, а покрытие пиксела
+/// получается префиксной суммой по строке. Пиксел (x, y) — квадрат [x - 1/2, x + 1/2] x [y - 1/2, y + 1/2],
+/// поэтому его центр совпадает с точкой, по которой судит построчная заливка.
+/// Объект можно переиспользовать: после resolve буфер снова нулевой.
+class CoverageAccumulator {
+private:
+    vector<float> acc;
+    vector<float> row_coverage;
+    PixelRect rect;
+    int stride = 0;
+
+    /// Часть ребра, не пересекающая вертикали x = 0 и x = width
+    void accumulate(Vertex<double> p0, Vertex<double> p1) {
+        if (p0.y == p1.y)
+            return;
+        double dir = 1;
+        if (p0.y > p1.y) {
+            swap(p0, p1);
+            dir = -1;
+        }
+        const int height = rect.y1 - rect.y0;
+        double y_start = max(p0.y, 0.0), y_end = min(p1.y, double(height));
+        if (y_start >= y_end)
+            return;
+        const double dxdy = (p1.x - p0.x) / (p1.y - p0.y);
+        double x = p0.x + (y_start - p0.y) * dxdy;
+        for (int y = int(floor(y_start)); y < int(ceil(y_end)); ++y) {
+            float *row = acc.data() + size_t(y) * stride;
+            double dy = min(y + 1.0, y_end) - max(double(y), y_start);
+            double x_next = x + dxdy * dy;
+            double d = dy * dir;
+            double x0 = min(x, x_next), x1 = max(x, x_next);
+            double x0_floor = floor(x0), x1_ceil = ceil(x1);
+            int x0i = int(x0_floor), x1i = int(x1_ceil);
+            if (x1i <= x0i + 1) {
+                // ребро в пределах одной ячейки
+                double xm = 0.5 * (x + x_next) - x0_floor;
+                row[x0i] += d - d * xm;
+                row[x0i + 1] += d * xm;
+            } else {
+                double s = 1 / (x1 - x0);
+                double x0f = x0 - x0_floor;
+                double a0 = 0.5 * s * (1 - x0f) * (1 - x0f);
+                double x1f = x1 - x1_ceil + 1;
+                double am = 0.5 * s * x1f * x1f;
+                row[x0i] += d * a0;
+                if (x1i == x0i + 2) {
+                    row[x0i + 1] += d * (1 - a0 - am);
+                } else {
+                    double a1 = s * (1.5 - x0f);
+                    row[x0i + 1] += d * (a1 - a0);
+                    for (int xi = x0i + 2; xi < x1i - 1; ++xi)
+                        row[xi] += d * s;
+                    double a2 = a1 + (x1i - x0i - 3) * s;
+                    row[x1i - 1] += d * (1 - a2 - am);
+                }
+                row[x1i] += d * am;
+            }
+            x = x_next;
+        }
+    }
+
+public:
+    /// Начинает новую фигуру, покрытие которой нужно только внутри area
+    void reset(const PixelRect &area) {
+        rect = area;
+        if (rect.empty())
+            return;
+        stride = rect.x1 - rect.x0 + 2;
+        size_t size = size_t(stride) * (rect.y1 - rect.y0);
+        if (acc.size() < size)
+            acc.resize(size, 0);
+    }
+
+    [[nodiscard]] const PixelRect &area() const {
+        return rect;
+    }
+
+    void addEdge(const Vertex<double> &a, const Vertex<double> &b) {
+        if (rect.empty() || a.y == b.y)
+            return;
+        const double width = rect.x1 - rect.x0;
+        // переход к координатам буфера: углы пикселов — целые точки
+        Vertex<double> p0(a.x + 0.5 - rect.x0, a.y + 0.5 - rect.y0), p1(b.x + 0.5 - rect.x0, b.y + 0.5 - rect.y0);
+
+        // режем ребро вертикалями x = 0 и x = width: левее области ребро покрывает её строки целиком,
+        // как вертикаль x = 0, а правее — ни одного пиксела, но площадь должна вернуться в ноль в конце строки
+        double ts[4] = {0, 0, 0, 1};
+        int count = 1;
+        for (double border: {0.0, width}) {
+            if ((p0.x < border) != (p1.x < border) && p0.x != p1.x)
+                ts[count++] = (border - p0.x) / (p1.x - p0.x);
+        }
+        ts[count++] = 1;
+        if (count == 4 && ts[2] < ts[1])
+            swap(ts[1], ts[2]);
+        Vertex<double> prev = p0;
+        for (int i = 1; i < count; ++i) {
+            Vertex<double> cur = i == count - 1 ? p1 : p0 + (p1 - p0) * ts[i];
+            Vertex<double> q0 = prev, q1 = cur;
+            double mid = (prev.x + cur.x) / 2;
+            if (mid <= 0)
+                q0.x = q1.x = 0;
+            else if (mid >= width)
+                q0.x = q1.x = width;
+            else {
+                q0.x = std::clamp(q0.x, 0.0, width);
+                q1.x = std::clamp(q1.x, 0.0, width);
+            }
+            accumulate(q0, q1);
+            prev = cur;
+        }
+    }
+
+    void addEdge(const Vertex<int> &a, const Vertex<int> &b) {
+        addEdge(convertToDoubleVertex(a), convertToDoubleVertex(b));
+    }
+
+    void addSegments(const vector<Segment<int>> &segments) {
+        for (auto &segm: segments)
+            addEdge(segm.a, segm.b);
+    }
+
+    void addContour(const vector<Vertex<double>> &points) {
+        for (size_t i = 0; i < points.size(); ++i)
+            addEdge(points[i], points[(i + 1) % points.size()]);
+    }
+
+    /// Вызывает row(y, x_from, coverage) для каждой строки области: coverage[i] — покрытие пиксела
+    /// (x_from + i, y) от 0 до 1. Для чётно-нечётного правила площадь сворачивается как в FreeType:
+    /// |s| по модулю 2, значения больше 1 отражаются.
+    template<class RowFn>
+    void resolve(FillRule rule, RowFn &&row) {
+        if (rect.empty())
+            return;
+        const int width = rect.x1 - rect.x0;
+        row_coverage.resize(width);
+        for (int y = 0; y < rect.y1 - rect.y0; ++y) {
+            float *cells = acc.data() + size_t(y) * stride;
+            float s = 0;
+            for (int x = 0; x < width; ++x) {
+                s += cells[x];
+                cells[x] = 0;
+                float a = abs(s);
+                if (rule == NON_ZERO) {
+                    row_coverage[x] = min(a, 1.0f);
+                } else {
+                    a = fmod(a, 2.0f);
+                    row_coverage[x] = a > 1 ? 2 - a : a;
+                }
+            }
+            cells[width] = cells[width + 1] = 0;
+            row(rect.y0 + y, rect.x0, (const float *) row_coverage.data());
+        }
+    }
+};
+
+/// Сглаженная заливка фигуры, рёбра которой уже добавлены в accumulator: полностью покрытые
+/// отрезки строки закрашиваются через plotSpan, частично покрытые пикселы смешиваются
+template<RasterTarget Img>
+void fillCoverage(CoverageAccumulator &accumulator, FillRule rule, Img &img, const Magick::Color &col) {
+    const auto pen = makePen(img, col);
+    const int width = accumulator.area().x1 - accumulator.area().x0;
+    accumulator.resolve(rule, [&](int y, int x_from, const float *coverage) {
+        for (int i = 0; i < width;) {
+            int alpha = int(coverage[i] * 255 + 0.5f);
+            if (alpha == 255) {
+                int j = i;
+                while (j < width && int(coverage[j] * 255 + 0.5f) == 255)
+                    ++j;
+                plotSpan(img, y, x_from + i, x_from + j, pen);
+                i = j;
+                continue;
+            }
+            if (alpha > 0)
+                blend(img, x_from + i, y, pen, uint8_t(alpha));
+            ++i;
+        }
+    });
+}
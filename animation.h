@@ -0,0 +1,78 @@
+#pragma once
+
+#include "gif_writer.h"
+#include "thread_pool.h"
+#include "retained.h"
+#include <map>
+
+/// Параллельная отрисовка кадров с потоковой записью. Кадр i рисуется функцией render_frame(i, canvas)
+/// на чистом холсте и сжимается в рабочем потоке, а вызывающий поток дописывает готовые кадры в файл
+/// строго по порядку. Одновременно в работе не больше max_in_flight кадров, поэтому память
+/// не зависит от их общего числа.
+template<class F>
+void renderAnimation(int frame_count, F &&render_frame, GifWriter &writer, ThreadPool &pool,
+                     const Magick::Color &background = Magick::Color("white"), size_t max_in_flight = 0) {
+    if (max_in_flight == 0)
+        max_in_flight = 2 * pool.size();
+
+    mutex m;
+    condition_variable ready_cv;
+    map<int, vector<uint8_t>> ready;   /// сжатые кадры, ждущие своей очереди
+    exception_ptr error;
+    ThreadPool::TaskGroup frames;
+
+    auto task = [&](int i) {
+        PAINTING_SCOPE("renderAnimation::frame");
+        vector<uint8_t> encoded;
+        try {
+            Canvas canvas(writer.getWidth(), writer.getHeight(), background);
+            render_frame(i, canvas);
+            encoded = writer.encode(canvas);
+        } catch (...) {
+            lock_guard l(m);
+            if (!error)
+                error = current_exception();
+        }
+        lock_guard l(m);
+        ready.emplace(i, std::move(encoded));
+        ready_cv.notify_one();
+    };
+
+    int submitted = 0;
+    for (int next = 0; next < frame_count; ++next) {
+        while (submitted < frame_count && size_t(submitted - next) < max_in_flight) {
+            int i = submitted++;
+            pool.submit(frames, [&task, i] { task(i); });
+        }
+        vector<uint8_t> frame;
+        {
+            unique_lock l(m);
+            ready_cv.wait(l, [&] { return ready.contains(next); });
+            if (error)
+                break;
+            frame = std::move(ready[next]);
+            ready.erase(next);
+        }
+        writer.writeEncoded(frame);
+    }
+    pool.wait(frames);
+    if (error)
+        rethrow_exception(error);
+}
+
+/// Анимация в удерживаемом режиме: update_frame(i, scene) меняет примитивы сцены, перерисовываются
+/// только грязные области, и в файл идёт лишь их ограничивающий прямоугольник. Каждый кадр зависит
+/// от предыдущего, поэтому кадры рисуются и сжимаются по очереди; первый кадр записывается целиком.
+template<class F>
+void renderRetainedAnimation(int frame_count, F &&update_frame, RetainedScene &scene, GifWriter &writer) {
+    for (int i = 0; i < frame_count; ++i) {
+        PAINTING_SCOPE("renderRetainedAnimation::frame");
+        update_frame(i, scene);
+        PixelRect changed;
+        for (auto &r: scene.render()) {
+            changed = changed.empty() ? r : PixelRect{min(changed.x0, r.x0), min(changed.y0, r.y0),
+                                                      max(changed.x1, r.x1), max(changed.y1, r.y1)};
+        }
+        writer.addFrame(scene.getCanvas(), i == 0 ? scene.getCanvas().bounds() : changed);
+    }
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "draw.h"
+
+/// Дуги и секторы окружности без кривых Безье: точки окружности строятся целочисленным алгоритмом
+/// середины по одному октанту и отражаются на остальные семь. Углы переводятся в целочисленные
+/// направления один раз на дугу, дальше принадлежность точки дуге проверяется векторными произведениями.
+/// Дуга идёт от phi1 к phi2 против часовой стрелки (при counter_clockwise = false — по часовой);
+/// разность углов не меньше 2 pi — полная окружность.
+
+/// Угловой диапазон дуги
+class ArcRange {
+private:
+    /// Масштаб целочисленных направлений: точность угла около 1e-6 при произведениях в пределах long long
+    static constexpr double DIRECTION_SCALE = 1 << 20;
+
+    long long sx = 0, sy = 0;  /// направление начала
+    long long ex = 0, ey = 0;  /// направление конца
+    bool full = false;
+    bool wide = false;         /// дуга больше половины окружности
+    bool empty_range = false;
+
+    /// Сужает [lo, hi] до решений a x + b >= 0
+    static void halfPlane(long long a, long long b, long long &lo, long long &hi) {
+        if (a > 0)
+            lo = max(lo, ceilDiv(-b, a));
+        else if (a < 0)
+            hi = min(hi, floorDiv(b, -a));
+        else if (b < 0)
+            hi = lo - 1;
+    }
+
+public:
+    ArcRange(double phi1, double phi2, bool counter_clockwise = true) {
+        double start = counter_clockwise ? phi1 : phi2;
+        double span = counter_clockwise ? phi2 - phi1 : phi1 - phi2;
+        if (span >= 2 * M_PI) {
+            full = true;
+            return;
+        }
+        span = fmod(span, 2 * M_PI);
+        if (span < 0)
+            span += 2 * M_PI;
+        if (span == 0) {
+            empty_range = true;
+            return;
+        }
+        wide = span > M_PI;
+        sx = llround(cos(start) * DIRECTION_SCALE);
+        sy = llround(sin(start) * DIRECTION_SCALE);
+        ex = llround(cos(start + span) * DIRECTION_SCALE);
+        ey = llround(sin(start + span) * DIRECTION_SCALE);
+    }
+
+    [[nodiscard]] bool isFull() const {
+        return full;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return empty_range;
+    }
+
+    /// Лежит ли направление (x, y) от центра в диапазоне; границы включаются
+    [[nodiscard]] bool contains(long long x, long long y) const {
+        if (full)
+            return true;
+        if (empty_range)
+            return false;
+        if (!wide)
+            return sx * y - sy * x >= 0 && x * ey - y * ex >= 0;
+        // дополнение к узкой открытой дуге от конца к началу
+        return !(ex * y - ey * x > 0 && x * sy - y * sx > 0);
+    }
+
+    /// Отрезки строки dy внутри [lo, hi], лежащие в диапазоне: f(from, to) для каждого, включительно
+    template<class F>
+    void rowSpans(long long dy, long long lo, long long hi, F &&f) const {
+        if (empty_range || lo > hi)
+            return;
+        if (full) {
+            f(lo, hi);
+            return;
+        }
+        if (!wide) {
+            halfPlane(-sy, sx * dy, lo, hi);
+            halfPlane(ey, -ex * dy, lo, hi);
+            if (lo <= hi)
+                f(lo, hi);
+            return;
+        }
+        // строгие неравенства для целых: a x + b > 0 <=> a x + b - 1 >= 0
+        long long c_lo = lo, c_hi = hi;
+        halfPlane(-ey, ex * dy - 1, c_lo, c_hi);
+        halfPlane(sy, -sx * dy - 1, c_lo, c_hi);
+        if (c_lo > c_hi) {
+            f(lo, hi);
+            return;
+        }
+        if (lo < c_lo)
+            f(lo, c_lo - 1);
+        if (c_hi < hi)
+            f(c_hi + 1, hi);
+    }
+};
+
+/// Обход октанта 0 <= x <= y окружности радиуса r алгоритмом середины: f(x, y) для каждой точки
+template<class F>
+void forEachOctantPoint(int r, F &&f) {
+    int x = 0, y = r;
+    long long d = 1 - (long long) r;
+    while (x <= y) {
+        f(x, y);
+        if (d < 0) {
+            d += 2LL * x + 3;
+        } else {
+            d += 2LL * (x - y) + 5;
+            y--;
+        }
+        x++;
+    }
+}
+
+template<RasterTarget Img>
+void drawArc(const Vertex<int> &center, int r, double phi1, double phi2, Img &img, const Magick::Color &color,
+             bool counter_clockwise = true) {
+    if (r < 0)
+        throw std::runtime_error("drawArc radius is negative");
+    const PixelRect clip = targetBounds(img);
+    if (clip.intersect({center.x - r, center.y - r, center.x + r + 1, center.y + r + 1}).empty())
+        return;
+    PAINTING_SCOPE("drawArc");
+    const ArcRange range(phi1, phi2, counter_clockwise);
+    if (range.empty())
+        return;
+    const auto pen = makePen(img, color);
+    auto put = [&](int dx, int dy) {
+        if (clip.contains(center.x + dx, center.y + dy) && range.contains(dx, dy))
+            plot(img, center.x + dx, center.y + dy, pen);
+    };
+    // точки на осях и диагоналях совпадают у соседних октантов и ставятся один раз
+    forEachOctantPoint(r, [&](int x, int y) {
+        if (x == 0) {
+            put(0, y);
+            put(y, 0);
+            put(0, -y);
+            put(-y, 0);
+        } else if (x == y) {
+            put(x, x);
+            put(-x, x);
+            put(x, -x);
+            put(-x, -x);
+        } else {
+            for (int sx: {1, -1}) {
+                for (int sy: {1, -1}) {
+                    put(sx * x, sy * y);
+                    put(sx * y, sy * x);
+                }
+            }
+        }
+    });
+}
+
+template<RasterTarget Img>
+void drawCircle(const Vertex<int> &center, int r, Img &img, const Magick::Color &color) {
+    drawArc(center, r, 0, 2 * M_PI, img, color);
+}
+
+/// Сектор между радиусами phi1 и phi2 вместе с дугой: по строкам, с теми же граничными точками, что у drawArc
+template<RasterTarget Img>
+void fillSector(const Vertex<int> &center, int r, double phi1, double phi2, Img &img, const Magick::Color &color,
+                bool counter_clockwise = true) {
+    if (r < 0)
+        throw std::runtime_error("fillSector radius is negative");
+    const PixelRect clip = targetBounds(img);
+    if (clip.intersect({center.x - r, center.y - r, center.x + r + 1, center.y + r + 1}).empty())
+        return;
+    PAINTING_SCOPE("fillSector");
+    const ArcRange range(phi1, phi2, counter_clockwise);
+    if (range.empty())
+        return;
+    const auto pen = makePen(img, color);
+
+    // половина ширины круга в строке |dy|: самая дальняя точка окружности в этой строке
+    static thread_local vector<int> extent;
+    extent.assign(r + 1, 0);
+    forEachOctantPoint(r, [&](int x, int y) {
+        extent[y] = max(extent[y], x);
+        extent[x] = max(extent[x], y);
+    });
+
+    int dy_from = max(-r, clip.y0 - center.y), dy_to = min(r, clip.y1 - 1 - center.y);
+    for (int dy = dy_from; dy <= dy_to; ++dy) {
+        int half = extent[abs(dy)];
+        long long lo = max<long long>(-half, (long long) clip.x0 - center.x);
+        long long hi = min<long long>(half, (long long) clip.x1 - 1 - center.x);
+        range.rowSpans(dy, lo, hi, [&](long long from, long long to) {
+            plotSpan(img, center.y + dy, int(center.x + from), int(center.x + to + 1), pen);
+        });
+    }
+}
+
+template<RasterTarget Img>
+void fillCircle(const Vertex<int> &center, int r, Img &img, const Magick::Color &color) {
+    fillSector(center, r, 0, 2 * M_PI, img, color);
+}
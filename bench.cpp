@@ -0,0 +1,464 @@
+#define MAGICKCORE_QUANTUM_DEPTH 16
+#define MAGICKCORE_HDRI_ENABLE 1
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include <functional>
+#include "polyhedron.h"
+#include "clipping.h"
+#include "kuboid.h"
+#include "image_writer.h"
+#include "polygon_store.h"
+#include "spatial_index.h"
+#include "hit_test.h"
+#include "arc.h"
+#include "stroke.h"
+#include "boolean_ops.h"
+
+/// Замеры производительности примитивов. Каждый замер — функция с параметрами (число вершин,
+/// размер холста и т. п.); результаты печатаются в JSON или CSV, чтобы их можно было сравнивать между версиями.
+///
+/// painting_bench [--json FILE] [--csv FILE] [--filter SUBSTRING] [--min-time SECONDS]
+
+using namespace std;
+
+const Magick::Color BenchWhite(QuantumRange, QuantumRange, QuantumRange);
+const Magick::Color BenchBlue(0, 0, QuantumRange);
+const Magick::Color BenchRed(QuantumRange, 0, 0);
+
+/// Не даёт компилятору выбросить результат замера
+volatile uint64_t bench_sink = 0;
+
+void consume(const Canvas &canvas) {
+    bench_sink = bench_sink + canvas.getPixel(canvas.getWidth() / 2, canvas.getHeight() / 2);
+}
+
+void consume(uint64_t v) {
+    bench_sink = bench_sink + v;
+}
+
+struct BenchResult {
+    string name;
+    vector<pair<string, long long>> params;
+    size_t iterations;
+    double ns_min, ns_median;
+};
+
+class BenchRunner {
+private:
+    vector<BenchResult> results;
+    string filter;
+    double min_time;
+
+    static constexpr int SAMPLES = 5;
+
+    static double seconds(const function<void()> &f, size_t iterations) {
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+            f();
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+public:
+    BenchRunner(string _filter, double _min_time) : filter(std::move(_filter)), min_time(_min_time) {}
+
+    /// Подбирает число повторов так, чтобы выборка шла не меньше min_time / SAMPLES,
+    /// и записывает минимальное и медианное время одного повтора
+    void run(const string &name, const vector<pair<string, long long>> &params, const function<void()> &f) {
+        if (!filter.empty() && name.find(filter) == string::npos)
+            return;
+        f(); // прогрев
+        size_t iterations = 1;
+        while (seconds(f, iterations) < min_time / SAMPLES && iterations < (size_t(1) << 30))
+            iterations *= 2;
+
+        vector<double> samples;
+        for (int i = 0; i < SAMPLES; ++i)
+            samples.push_back(seconds(f, iterations) * 1e9 / iterations);
+        sort(samples.begin(), samples.end());
+        results.push_back({name, params, iterations, samples[0], samples[SAMPLES / 2]});
+
+        cerr << name;
+        for (auto &[key, value]: params)
+            cerr << ' ' << key << '=' << value;
+        cerr << ": " << samples[SAMPLES / 2] << " ns\n";
+    }
+
+    void writeJson(ostream &out) const {
+        out << "[\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            auto &r = results[i];
+            out << "  {\"name\": \"" << r.name << "\", \"params\": {";
+            for (size_t k = 0; k < r.params.size(); ++k)
+                out << (k ? ", " : "") << '"' << r.params[k].first << "\": " << r.params[k].second;
+            out << "}, \"iterations\": " << r.iterations << ", \"ns_min\": " << r.ns_min
+                << ", \"ns_median\": " << r.ns_median << '}' << (i + 1 < results.size() ? "," : "") << '\n';
+        }
+        out << "]\n";
+    }
+
+    /// Параметры записываются одной колонкой вида key=value;key=value
+    void writeCsv(ostream &out) const {
+        out << "name,params,iterations,ns_min,ns_median\n";
+        for (auto &r: results) {
+            out << r.name << ',';
+            for (size_t k = 0; k < r.params.size(); ++k)
+                out << (k ? ";" : "") << r.params[k].first << '=' << r.params[k].second;
+            out << ',' << r.iterations << ',' << r.ns_min << ',' << r.ns_median << '\n';
+        }
+    }
+};
+
+/// Многоугольник из n вершин вокруг центра со случайными радиусами: простой, но не выпуклый
+vector<Vertex<int>> starPolygon(int n, int size, mt19937 &gen) {
+    uniform_real_distribution<double> radius(0.2, 0.45);
+    vector<Vertex<int>> points;
+    for (int i = 0; i < n; ++i) {
+        double phi = 2 * M_PI * i / n, r = radius(gen) * size;
+        points.emplace_back(roundToInt(size / 2 + r * cos(phi)), roundToInt(size / 2 + r * sin(phi)));
+    }
+    return points;
+}
+
+/// Правильный многоугольник: выпуклый
+vector<Vertex<int>> regularPolygon(int n, int size) {
+    vector<Vertex<int>> points;
+    for (int i = 0; i < n; ++i) {
+        double phi = 2 * M_PI * i / n;
+        points.emplace_back(roundToInt(size / 2 + size * 0.45 * cos(phi)), roundToInt(size / 2 + size * 0.45 * sin(phi)));
+    }
+    return points;
+}
+
+/// Случайные вершины: много самопересечений
+vector<Vertex<int>> randomPolygon(int n, int size, mt19937 &gen) {
+    uniform_int_distribution<int> coord(0, size - 1);
+    vector<Vertex<int>> points;
+    for (int i = 0; i < n; ++i)
+        points.emplace_back(coord(gen), coord(gen));
+    return points;
+}
+
+array<array<Vertex<int>, 4>, 6> cube(int x, int y, int z, int a) {
+    vector<Vertex<int>> low = {{x, y, z}, {x + a, y, z}, {x + a, y + a, z}, {x, y + a, z}};
+    vector<Vertex<int>> high = low;
+    for (auto &v: high)
+        v.z = z + a;
+    array<array<Vertex<int>, 4>, 6> faces;
+    faces[4] = {low[0], low[1], low[2], low[3]};
+    faces[5] = {high[0], high[1], high[2], high[3]};
+    for (int i = 0; i < 4; i++)
+        faces[i] = {low[i], low[(i + 1) % 4], high[(i + 1) % 4], high[i]};
+    return faces;
+}
+
+void benchRaster(BenchRunner &bench) {
+    for (int size: {256, 1024, 4096}) {
+        mt19937 gen(1);
+        uniform_int_distribution<int> coord(-size, 2 * size);
+        vector<Segment<int>> lines;
+        for (int i = 0; i < 100; ++i)
+            lines.push_back({{coord(gen), coord(gen)}, {coord(gen), coord(gen)}});
+        Canvas canvas(size, size, BenchWhite);
+        bench.run("drawLine", {{"canvas", size}, {"lines", lines.size()}}, [&] {
+            for (auto &l: lines)
+                drawLine(l.a, l.b, canvas, BenchBlue);
+            consume(canvas);
+        });
+    }
+
+    for (int size: {256, 1024, 4096}) {
+        for (int n: {8, 64, 512}) {
+            mt19937 gen(2);
+            Polyhedron pol(starPolygon(n, size, gen));
+            Canvas canvas(size, size, BenchWhite);
+            bench.run("fillEvenOdd", {{"canvas", size}, {"vertices", n}}, [&] {
+                pol.fillWithEvenOddRule(canvas, BenchBlue);
+                consume(canvas);
+            });
+            bench.run("fillNonZero", {{"canvas", size}, {"vertices", n}}, [&] {
+                pol.fillWithNonZeroWinding(canvas, BenchBlue);
+                consume(canvas);
+            });
+        }
+    }
+
+    // многоугольник намного больше холста: холст видит только его часть
+    for (int zoom: {4, 64}) {
+        for (int n: {64, 512}) {
+            const int size = 1024;
+            mt19937 gen(12);
+            Polyhedron pol(starPolygon(n, size * zoom, gen));
+            pol.move({-size * zoom / 2 + size / 2, -size * zoom / 2 + size / 2});
+            Canvas canvas(size, size, BenchWhite);
+            bench.run("fillOffscreen", {{"zoom", zoom}, {"vertices", n}}, [&] {
+                pol.fillWithEvenOddRule(canvas, BenchBlue);
+                consume(canvas);
+            });
+        }
+    }
+
+    for (int size: {512, 2048}) {
+        for (int n: {3, 4, 8, 16}) {
+            mt19937 gen(3);
+            auto points = randomPolygon(n, size, gen);
+            Canvas canvas(size, size, BenchWhite);
+            bench.run("drawBezierCurve", {{"canvas", size}, {"points", n}}, [&] {
+                drawBezierCurve(points, canvas, BenchBlue);
+                consume(canvas);
+            });
+        }
+    }
+
+    for (int r: {50, 500}) {
+        Canvas canvas(2 * r + 20, 2 * r + 20, BenchWhite);
+        bench.run("drawCircleWithBezie", {{"radius", r}}, [&] {
+            drawCircleWithBezie({r + 10, r + 10}, r, 0, 2 * M_PI, canvas, BenchBlue, BenchRed);
+            consume(canvas);
+        });
+        bench.run("drawCircle", {{"radius", r}}, [&] {
+            drawCircle({r + 10, r + 10}, r, canvas, BenchBlue);
+            consume(canvas);
+        });
+        bench.run("drawArc", {{"radius", r}}, [&] {
+            drawArc({r + 10, r + 10}, r, 0.3, 4.0, canvas, BenchBlue);
+            consume(canvas);
+        });
+        bench.run("fillSector", {{"radius", r}}, [&] {
+            fillSector({r + 10, r + 10}, r, 0.3, 4.0, canvas, BenchBlue);
+            consume(canvas);
+        });
+    }
+}
+
+void benchStroke(BenchRunner &bench) {
+    mt19937 gen(10);
+    uniform_int_distribution<int> coord(0, 1023);
+    vector<Vertex<int>> polyline;
+    for (int i = 0; i < 64; ++i)
+        polyline.emplace_back(coord(gen), coord(gen));
+    Canvas canvas(1024, 1024, BenchWhite);
+    for (int width: {1, 8, 32}) {
+        for (LineJoin join: {JOIN_MITER, JOIN_ROUND}) {
+            bench.run("strokePolyline", {{"width", width}, {"round", join == JOIN_ROUND}}, [&] {
+                strokePolyline(polyline, {double(width), join, CAP_BUTT}, canvas, BenchBlue);
+                consume(canvas);
+            });
+        }
+    }
+}
+
+void benchGeometry(BenchRunner &bench) {
+    for (int n: {16, 256, 4096}) {
+        mt19937 gen(4);
+        Polyhedron star(starPolygon(n, 1 << 20, gen));
+        bench.run("IsSimple", {{"vertices", n}}, [&] {
+            consume(star.IsSimple());
+        });
+        Polyhedron convex(regularPolygon(n, 1 << 20));
+        bench.run("isConvex", {{"vertices", n}}, [&] {
+            consume(convex.isConvex());
+        });
+    }
+
+    for (int n: {8, 32, 128}) {
+        mt19937 gen(5);
+        Polyhedron pol(randomPolygon(n, 1000, gen));
+        bench.run("weilerAtherton", {{"vertices", n}}, [&] {
+            consume(pol.weilerAtherton().getSegments().size());
+        });
+    }
+
+    for (int n: {8, 32, 128}) {
+        mt19937 gen(11);
+        vector<Polyhedron> subject = {Polyhedron(randomPolygon(n, 1000, gen))};
+        vector<Polyhedron> clip = {Polyhedron(randomPolygon(n, 1000, gen))};
+        for (BooleanOperation op: {BOOLEAN_UNION, BOOLEAN_INTERSECTION}) {
+            bench.run("booleanContours", {{"vertices", n}, {"union", op == BOOLEAN_UNION}}, [&] {
+                consume(booleanContours(subject, clip, op).size());
+            });
+        }
+    }
+
+    for (int n: {8, 64, 256}) {
+        const int size = 1 << 16;
+        Polyhedron window(regularPolygon(n, size));
+        mt19937 gen(6);
+        uniform_int_distribution<int> coord(-size / 2, size * 3 / 2);
+        vector<Segment<int>> lines;
+        for (int i = 0; i < 1000; ++i)
+            lines.push_back({{coord(gen), coord(gen)}, {coord(gen), coord(gen)}});
+        bench.run("cyrusBeckClipLine", {{"window", n}, {"lines", lines.size()}}, [&] {
+            uint64_t sum = 0;
+            for (auto &l: lines)
+                sum += cyrusBeckClipLine(l, window).a.x;
+            consume(sum);
+        });
+        ConvexClipper clipper(window);
+        vector<Segment<int>> clipped(lines.size());
+        bench.run("ConvexClipper", {{"window", n}, {"lines", lines.size()}}, [&] {
+            consume(clipper.clip(lines, clipped));
+        });
+    }
+}
+
+void benchPolygonStore(BenchRunner &bench) {
+    for (int count: {1000, 20000}) {
+        const int size = 2048;
+        mt19937 gen(8);
+        uniform_int_distribution<int> coord(0, size - 40), offset(0, 40);
+        vector<Polyhedron> polyhedrons;
+        PolygonStore store;
+        for (int i = 0; i < count; ++i) {
+            int x = coord(gen), y = coord(gen);
+            vector<Vertex<int>> points;
+            for (int k = 0; k < 8; ++k)
+                points.emplace_back(x + offset(gen), y + offset(gen));
+            polyhedrons.emplace_back(points);
+            store.add(points);
+        }
+        Canvas canvas(size, size, BenchWhite);
+        bench.run("Polyhedron.fill", {{"polygons", count}}, [&] {
+            for (auto &pol: polyhedrons)
+                pol.fillWithNonZeroWinding(canvas, BenchBlue);
+            consume(canvas);
+        });
+        bench.run("PolygonStore.fill", {{"polygons", count}}, [&] {
+            for (auto &pol: store)
+                pol.fill(canvas, BenchBlue, NON_ZERO);
+            consume(canvas);
+        });
+    }
+}
+
+void benchSpatialIndex(BenchRunner &bench) {
+    for (int count: {1000, 20000}) {
+        const int size = 8192, queries = 1000;
+        mt19937 gen(9);
+        uniform_int_distribution<int> coord(0, size - 40), offset(0, 40);
+        vector<Polyhedron> polyhedrons;
+        PolygonIndex index;
+        for (int i = 0; i < count; ++i) {
+            int x = coord(gen), y = coord(gen);
+            vector<Vertex<int>> points;
+            for (int k = 0; k < 8; ++k)
+                points.emplace_back(x + offset(gen), y + offset(gen));
+            polyhedrons.emplace_back(points);
+        }
+        vector<PolygonHitTester> testers;
+        for (auto &pol: polyhedrons) {
+            index.add(pol);
+            testers.emplace_back(pol.getSegments());
+        }
+        vector<Vertex<int>> points;
+        for (int i = 0; i < queries; ++i)
+            points.emplace_back(coord(gen), coord(gen));
+        bench.run("PolygonHitTester.scan", {{"polygons", count}, {"queries", queries}}, [&] {
+            uint64_t hits = 0;
+            for (auto &v: points)
+                for (auto &tester: testers)
+                    hits += tester.contains(v, EVEN_ODD);
+            consume(hits);
+        });
+        bench.run("PolygonIndex.containing", {{"polygons", count}, {"queries", queries}}, [&] {
+            uint64_t hits = 0;
+            for (auto &v: points)
+                hits += index.containing(v).size();
+            consume(hits);
+        });
+    }
+}
+
+void benchEncode(BenchRunner &bench) {
+    for (int size: {512, 2048}) {
+        mt19937 gen(7);
+        Canvas canvas(size, size, BenchWhite);
+        for (int i = 0; i < 8; ++i)
+            Polyhedron(starPolygon(64, size, gen)).fillWithEvenOddRule(canvas, i % 2 ? BenchBlue : BenchRed);
+        bench.run("encodeQOI", {{"canvas", size}}, [&] {
+            consume(encodeQOI(canvas).size());
+        });
+        ostringstream out;
+        bench.run("writePPM", {{"canvas", size}}, [&] {
+            out.str("");
+            writePPM(canvas, out);
+            consume(out.tellp());
+        });
+        GifWriter gif("/dev/null", size, size);
+        bench.run("GifWriter.encode", {{"canvas", size}}, [&] {
+            consume(gif.encode(canvas).size());
+        });
+    }
+}
+
+void benchKuboid(BenchRunner &bench) {
+    Kuboid model(cube(200, 200, 100, 300));
+    auto center = convertToDoubleVertex(model.getCenter());
+    for (int frames: {1, 64}) {
+        bench.run("Kuboid.transform", {{"frames", frames}}, [&] {
+            uint64_t sum = 0;
+            for (int i = 0; i < frames; ++i)
+                sum += model.transformed(Transform::rotation(0.1, 2 * M_PI * i / frames, 0, center)).getCenter().x;
+            consume(sum);
+        });
+    }
+    for (int size: {512, 2048}) {
+        Canvas canvas(size, size, BenchWhite);
+        Kuboid k = model.transformed(Transform::scale(size / 700.0) * Transform::rotation(0.4, 0.7, 0, center));
+        bench.run("Kuboid.onePointProjection", {{"canvas", size}}, [&] {
+            k.onePointProjection(1.3e-3, canvas, BenchBlue);
+            consume(canvas);
+        });
+        bench.run("Kuboid.show", {{"canvas", size}}, [&] {
+            k.show(canvas, BenchBlue);
+            consume(canvas);
+        });
+    }
+}
+
+int main(int argc, char **argv) {
+    string json_file, csv_file, filter;
+    double min_time = 0.5;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            cerr << "painting_bench: missing value for " << arg << '\n';
+            return 1;
+        }
+        if (arg == "--json")
+            json_file = argv[++i];
+        else if (arg == "--csv")
+            csv_file = argv[++i];
+        else if (arg == "--filter")
+            filter = argv[++i];
+        else if (arg == "--min-time")
+            min_time = stod(argv[++i]);
+        else {
+            cerr << "painting_bench: unknown option " << arg << '\n';
+            return 1;
+        }
+    }
+
+    BenchRunner bench(filter, min_time);
+    benchRaster(bench);
+    benchStroke(bench);
+    benchGeometry(bench);
+    benchPolygonStore(bench);
+    benchSpatialIndex(bench);
+    benchEncode(bench);
+    benchKuboid(bench);
+
+    if (!json_file.empty()) {
+        ofstream out(json_file);
+        bench.writeJson(out);
+    }
+    if (!csv_file.empty()) {
+        ofstream out(csv_file);
+        bench.writeCsv(out);
+    }
+    if (json_file.empty() && csv_file.empty())
+        bench.writeJson(cout);
+    return 0;
+}
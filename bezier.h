@@ -0,0 +1,110 @@
+#pragma once
+
+#include "vertex.h"
+#include <array>
+#include <vector>
+
+/// Допустимое отклонение ломаной от кривой Безье по умолчанию, в пикселах
+const double BEZIER_TOLERANCE = 0.25;
+
+/// Наибольшее число опорных точек, для которого разбиение обходится без выделения памяти
+const size_t BEZIER_MAX_POINTS = 16;
+
+/// Число отрезков, при котором ломаная отклоняется от кривой степени degree не больше чем на tolerance
+/// (оценка Ванга по вторым разностям опорных точек)
+inline int bezierSegmentCount(const Vertex<double> *points, size_t count, double tolerance) {
+    if (count <= 2)
+        return 1;
+    double l = 0;
+    for (size_t i = 0; i + 2 < count; ++i)
+        l = max(l, (points[i] - points[i + 1] * 2 + points[i + 2]).mod());
+    int degree = count - 1;
+    double n = sqrt(degree * (degree - 1) * l / (8 * tolerance));
+    return max(1, int(ceil(n)));
+}
+
+/// Точка кривой Безье по схеме де Кастельжо; tmp — буфер на count точек
+inline Vertex<double> bezierPoint(const Vertex<double> *points, size_t count, double t, Vertex<double> *tmp) {
+    for (size_t i = 0; i < count; ++i)
+        tmp[i] = points[i];
+    for (size_t k = count - 1; k > 0; --k) {
+        for (size_t i = 0; i < k; ++i)
+            tmp[i] = tmp[i] * (1 - t) + tmp[i + 1] * t;
+    }
+    return tmp[0];
+}
+
+/// Разбиение кривой Безье степени N на отрезки: вершины ломаной (без первой опорной точки)
+/// дописываются в out, поэтому несколько кривых подряд дают одну ломаную
+template<size_t N>
+void flattenBezier(const array<Vertex<double>, N + 1> &points, double tolerance, vector<Vertex<double>> &out) {
+    int n = bezierSegmentCount(points.data(), points.size(), tolerance);
+    array<Vertex<double>, N + 1> tmp;
+    for (int i = 1; i < n; ++i)
+        out.push_back(bezierPoint(points.data(), points.size(), double(i) / n, tmp.data()));
+    out.push_back(points.back());
+}
+
+/// Кубическая кривая: прямые разности, три сложения на точку
+template<>
+inline void flattenBezier<3>(const array<Vertex<double>, 4> &p, double tolerance, vector<Vertex<double>> &out) {
+    int n = bezierSegmentCount(p.data(), p.size(), tolerance);
+    double h = 1.0 / n;
+    // B(t) = a t^3 + b t^2 + c t + p0
+    Vertex<double> a = p[3] - p[0] + (p[1] - p[2]) * 3;
+    Vertex<double> b = (p[0] - p[1] * 2 + p[2]) * 3;
+    Vertex<double> c = (p[1] - p[0]) * 3;
+    Vertex<double> f = p[0];
+    Vertex<double> df = a * (h * h * h) + b * (h * h) + c * h;
+    Vertex<double> ddf = a * (6 * h * h * h) + b * (2 * h * h);
+    Vertex<double> dddf = a * (6 * h * h * h);
+    for (int i = 1; i < n; ++i) {
+        f += df;
+        df += ddf;
+        ddf += dddf;
+        out.push_back(f);
+    }
+    out.push_back(p[3]);
+}
+
+/// Разбиение кривой с произвольным числом опорных точек
+inline void flattenBezier(const vector<Vertex<int>> &points, double tolerance, vector<Vertex<double>> &out) {
+    auto fixed = [&]<size_t N>() {
+        array<Vertex<double>, N + 1> p;
+        for (size_t i = 0; i <= N; ++i)
+            p[i] = convertToDoubleVertex(points[i]);
+        flattenBezier<N>(p, tolerance, out);
+    };
+    switch (points.size()) {
+        case 0:
+            return;
+        case 1:
+            out.push_back(convertToDoubleVertex(points[0]));
+            return;
+        case 2:
+            return fixed.operator()<1>();
+        case 3:
+            return fixed.operator()<2>();
+        case 4:
+            return fixed.operator()<3>();
+        default:
+            break;
+    }
+
+    size_t count = points.size();
+    array<Vertex<double>, BEZIER_MAX_POINTS> p_buf, tmp_buf;
+    vector<Vertex<double>> p_heap, tmp_heap;
+    Vertex<double> *p = p_buf.data(), *tmp = tmp_buf.data();
+    if (count > BEZIER_MAX_POINTS) {
+        p_heap.resize(count);
+        tmp_heap.resize(count);
+        p = p_heap.data();
+        tmp = tmp_heap.data();
+    }
+    for (size_t i = 0; i < count; ++i)
+        p[i] = convertToDoubleVertex(points[i]);
+    int n = bezierSegmentCount(p, count, tolerance);
+    for (int i = 1; i < n; ++i)
+        out.push_back(bezierPoint(p, count, double(i) / n, tmp));
+    out.push_back(p[count - 1]);
+}
@@ -0,0 +1,782 @@
+#pragma once
+
+#include "polyhedron.h"
+
+/// Булева операция над двумя наборами многоугольников
+enum BooleanOperation {
+    BOOLEAN_UNION,
+    BOOLEAN_INTERSECTION,
+    BOOLEAN_DIFFERENCE,   /// subject без clip
+    BOOLEAN_XOR,
+};
+
+/// Булевы операции над многоугольниками за O((n + k + m) log n), где k — число пересечений рёбер,
+/// m — число пар «кусок границы — горячий пиксел, который он задевает» (шаг 4).
+/// 1. Рёбра обоих наборов разбиваются во всех точках пересечения заметающей прямой (SweepLine),
+///    совпадающие куски сливаются, их вклады в число оборотов складываются.
+/// 2. Второй проход заметающей прямой по уже непересекающимся кускам находит для каждого куска
+///    число оборотов каждого набора под ним: это число над ближайшим куском снизу.
+///    Всё в точной арифметике, как в SweepLine; вертикальный кусок считается слегка наклонённым вправо,
+///    так что «под» ним — справа, «над» — слева.
+/// 3. Кусок входит в границу результата, если результат по разные стороны от него различается;
+///    он направляется так, чтобы результат был слева.
+/// 4. Куски границы округляются до целых через горячие пикселы (snap rounding): пиксел, в который
+///    попадает вершина, горячий, и кусок превращается в ломаную через центры всех горячих пикселов,
+///    которые он пересекает. Такие ломаные не пересекаются, только совпадают или сходятся в вершинах;
+///    совпадающие рёбра противоположных направлений сокращаются. Короткий кусок или кусок с немногими
+///    горячими пикселами в своих столбцах проверяется напрямую. Длинный кусок, проходящий через пиксел,
+///    либо кончается рядом с ним, либо пересекает его сторону; такие стороны находят две заметающие
+///    прямые, по x и по y.
+/// 5. Граница обходится по рёбрам; в вершине, где сходится несколько контуров, выбирается ближайший
+///    по часовой стрелке поворот, поэтому касающиеся контуры разделяются. Контур, проходящий через
+///    вершину дважды, разрезается в ней, и каждый контур получается простым.
+/// Внешние контуры результата обходятся против часовой стрелки (в координатах с осью y вверх), дырки —
+/// по часовой, поэтому результат заливается по любому правилу одной заливкой (fillContours).
+///
+/// При правиле NON_ZERO каждый входной многоугольник приводится к обходу против часовой стрелки, так что
+/// набор означает объединение своих многоугольников; дырки во входе задаются правилом EVEN_ODD.
+class BooleanSolver {
+private:
+    /// Кусок, в столбцах которого не больше HOT_SCAN горячих пикселов или который уже COLUMN_SCAN столбцов,
+    /// проверяется напрямую, остальные — заметающими прямыми
+    static constexpr int HOT_SCAN = 32, COLUMN_SCAN = 8;
+
+    struct Input {
+        Vertex<int> p, q;  /// p лексикографически меньше q
+        long long dx, dy;
+        int wind;          /// +1, если исходное ребро шло от p к q
+        int owner;         /// 0 — subject, 1 — clip
+    };
+
+    /// Кусок ребра между соседними точками разбиения: u лексикографически меньше v
+    struct Piece {
+        int u, v;
+        int support;       /// исходное ребро, на котором лежит кусок
+        int wind[2];       /// на сколько число оборотов над куском больше, чем под ним
+        int below[2];
+    };
+
+    struct StatusLess {
+        const BooleanSolver *solver;
+        using is_transparent = void;
+
+        bool operator()(int s, int t) const {
+            return solver->less(s, t);
+        }
+
+        bool operator()(int s, const ExactPoint &p) const {
+            return solver->below(s, p);
+        }
+
+        bool operator()(const ExactPoint &p, int s) const {
+            return solver->above(s, p);
+        }
+    };
+
+    FillRule rules[2] = {NON_ZERO, NON_ZERO};
+    vector<Input> inputs;
+    vector<ExactPoint> vertices;
+    vector<Piece> pieces;
+    ExactPoint event;
+
+    static bool lexLess(const Vertex<int> &a, const Vertex<int> &b) {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    }
+
+    /// Ордината куска на вертикали события, как SweepLine::key: num / dx
+    [[nodiscard]] pair<int128, long long> key(int s) const {
+        const Input &it = inputs[pieces[s].support];
+        if (it.dx == 0)
+            return {event.y, 1};
+        return {int128(it.p.y) * event.d * it.dx + (event.x - int128(it.p.x) * event.d) * it.dy, it.dx};
+    }
+
+    /// Куски не пересекаются, поэтому равные ординаты бывают только у кусков, начинающихся в точке события:
+    /// они упорядочены по наклону, вертикальный — выше всех
+    [[nodiscard]] bool less(int s, int t) const {
+        auto [ns, ds] = key(s);
+        auto [nt, dt] = key(t);
+        int128 a = ns * dt, b = nt * ds;
+        if (a != b)
+            return a < b;
+        const Input &l = inputs[pieces[s].support], &r = inputs[pieces[t].support];
+        if (l.dx == 0 || r.dx == 0)
+            return (l.dx == 0) < (r.dx == 0);
+        long long sl = l.dy * r.dx, sr = r.dy * l.dx;
+        if (sl != sr)
+            return sl < sr;
+        return s < t;
+    }
+
+    [[nodiscard]] bool below(int s, const ExactPoint &p) const {
+        auto [num, dx] = key(s);
+        return num < p.y * dx;
+    }
+
+    [[nodiscard]] bool above(int s, const ExactPoint &p) const {
+        auto [num, dx] = key(s);
+        return num > p.y * dx;
+    }
+
+    static bool inside(int winding, FillRule rule) {
+        return rule == EVEN_ODD ? (winding & 1) != 0 : winding != 0;
+    }
+
+    static bool apply(BooleanOperation op, bool a, bool b) {
+        switch (op) {
+            case BOOLEAN_UNION:
+                return a || b;
+            case BOOLEAN_INTERSECTION:
+                return a && b;
+            case BOOLEAN_DIFFERENCE:
+                return a && !b;
+            case BOOLEAN_XOR:
+                return a != b;
+        }
+        return false;
+    }
+
+    /// Направление b встречается раньше a при повороте по часовой стрелке от r (само r — последним)
+    static bool clockwiseCloser(long long rx, long long ry, long long ax, long long ay, long long bx, long long by) {
+        // порядок против часовой стрелки, начиная с r: чем позже направление, тем оно ближе по часовой
+        bool wrap_a = angleLess(ax, ay, rx, ry), wrap_b = angleLess(bx, by, rx, ry);
+        if (wrap_a != wrap_b)
+            return wrap_b;
+        return angleLess(ax, ay, bx, by);
+    }
+
+    void addPolygons(const vector<Polyhedron> &polygons, FillRule rule, int owner) {
+        for (auto &pol: polygons) {
+            auto &segments = pol.getSegments();
+            long long doubled_area = 0;
+            for (auto &segm: segments)
+                doubled_area += (long long) segm.a.x * segm.b.y - (long long) segm.b.x * segm.a.y;
+            bool reverse = rule == NON_ZERO && doubled_area < 0;
+            for (auto &segm: segments) {
+                Vertex<int> a(segm.a.x, segm.a.y), b(segm.b.x, segm.b.y);
+                if (a == b)
+                    continue;
+                int wind = lexLess(a, b) ? 1 : -1;
+                if (lexLess(b, a))
+                    swap(a, b);
+                inputs.push_back({a, b, b.x - a.x, b.y - a.y, reverse ? -wind : wind, owner});
+            }
+        }
+    }
+
+    /// Шаг 1: разбиение рёбер в точках пересечения и слияние совпадающих кусков
+    void split() {
+        vector<Segment<int>> segments;
+        segments.reserve(inputs.size());
+        for (auto &in: inputs)
+            segments.emplace_back(in.p, in.q);
+
+        vector<pair<int, ExactPoint>> cuts;
+        cuts.reserve(2 * inputs.size());
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            cuts.emplace_back(i, ExactPoint(inputs[i].p));
+            cuts.emplace_back(i, ExactPoint(inputs[i].q));
+        }
+        for (auto &crossing: SweepLine(segments).crossings()) {
+            for (int s: crossing.segments)
+                cuts.emplace_back(s, crossing.point);
+        }
+        std::sort(cuts.begin(), cuts.end());
+        cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+        // номера вершин по лексикографическому порядку: тогда u < v у каждого куска
+        vector<ExactPoint> points;
+        points.reserve(cuts.size());
+        for (auto &cut: cuts)
+            points.push_back(cut.second);
+        std::sort(points.begin(), points.end());
+        points.erase(std::unique(points.begin(), points.end()), points.end());
+        vertices = std::move(points);
+        auto vertexId = [&](const ExactPoint &p) {
+            return int(std::lower_bound(vertices.begin(), vertices.end(), p) - vertices.begin());
+        };
+
+        vector<Piece> raw;
+        raw.reserve(cuts.size());
+        for (size_t i = 0; i + 1 < cuts.size(); ++i) {
+            if (cuts[i].first != cuts[i + 1].first)
+                continue;
+            const Input &in = inputs[cuts[i].first];
+            Piece piece{vertexId(cuts[i].second), vertexId(cuts[i + 1].second), cuts[i].first, {0, 0}, {0, 0}};
+            piece.wind[in.owner] = in.wind;
+            raw.push_back(piece);
+        }
+        std::sort(raw.begin(), raw.end(), [](const Piece &l, const Piece &r) {
+            return l.u != r.u ? l.u < r.u : l.v < r.v;
+        });
+        for (auto &piece: raw) {
+            if (!pieces.empty() && pieces.back().u == piece.u && pieces.back().v == piece.v) {
+                pieces.back().wind[0] += piece.wind[0];
+                pieces.back().wind[1] += piece.wind[1];
+            } else {
+                pieces.push_back(piece);
+            }
+        }
+        // куски с нулевым вкладом не разделяют области с разными числами оборотов
+        std::erase_if(pieces, [](const Piece &p) { return p.wind[0] == 0 && p.wind[1] == 0; });
+    }
+
+    /// Шаг 2: числа оборотов под каждым куском
+    void label() {
+        PAINTING_SCOPE("BooleanSolver::label");
+        vector<int> start_offsets(vertices.size() + 1, 0), end_offsets(vertices.size() + 1, 0);
+        for (auto &p: pieces) {
+            start_offsets[p.u + 1]++;
+            end_offsets[p.v + 1]++;
+        }
+        for (size_t v = 0; v < vertices.size(); ++v) {
+            start_offsets[v + 1] += start_offsets[v];
+            end_offsets[v + 1] += end_offsets[v];
+        }
+        // куски отсортированы по u, поэтому начинающиеся в вершине идут подряд
+        vector<int> ending(pieces.size());
+        {
+            vector<int> fill_pos(end_offsets.begin(), end_offsets.end() - 1);
+            for (size_t i = 0; i < pieces.size(); ++i)
+                ending[fill_pos[pieces[i].v]++] = i;
+        }
+
+        set<int, StatusLess> status(StatusLess{this});
+        vector<set<int, StatusLess>::iterator> where(pieces.size(), status.end());
+        for (size_t v = 0; v < vertices.size(); ++v) {
+            event = vertices[v];
+            for (int k = end_offsets[v]; k < end_offsets[v + 1]; ++k)
+                status.erase(where[ending[k]]);
+            int count = start_offsets[v + 1] - start_offsets[v];
+            if (count == 0)
+                continue;
+            for (int s = start_offsets[v]; s < start_offsets[v + 1]; ++s)
+                where[s] = status.insert(s).first;
+            PAINTING_COUNT(MAP_LOOKUPS, count);
+
+            auto it = status.lower_bound(event);
+            int w[2] = {0, 0};
+            if (it != status.begin()) {
+                const Piece &under = pieces[*prev(it)];
+                w[0] = under.below[0] + under.wind[0];
+                w[1] = under.below[1] + under.wind[1];
+            }
+            for (int k = 0; k < count; ++k, ++it) {
+                Piece &piece = pieces[*it];
+                piece.below[0] = w[0];
+                piece.below[1] = w[1];
+                w[0] += piece.wind[0];
+                w[1] += piece.wind[1];
+            }
+        }
+    }
+
+    /// Граница интервала параметра n / d (d > 0), open — сама точка не входит
+    struct Bound {
+        int128 n, d;
+        bool open;
+    };
+
+    static int compare(const Bound &a, const Bound &b) {
+        int128 l = a.n * b.d, r = b.n * a.d;
+        return l < r ? -1 : l > r ? 1 : 0;
+    }
+
+    /// Сужает интервал [lo, hi] границей снизу или сверху
+    static void raise(Bound &lo, const Bound &b) {
+        int c = compare(b, lo);
+        if (c > 0 || (c == 0 && b.open))
+            lo = b;
+    }
+
+    static void lower(Bound &hi, const Bound &b) {
+        int c = compare(b, hi);
+        if (c < 0 || (c == 0 && b.open))
+            hi = b;
+    }
+
+    /// Центр пиксела точки: пиксел h — [h - 1/2, h + 1/2) по каждой оси
+    static Vertex<int> snap(const ExactPoint &p) {
+        return {int(floorDiv(2 * p.x + p.d, 2 * p.d)), int(floorDiv(2 * p.y + p.d, 2 * p.d))};
+    }
+
+    /// Проходит ли кусок через пиксел h; entry — параметр точки входа. Параметр — x,
+    /// у вертикального куска — y; так он растёт от u к v.
+    [[nodiscard]] bool throughPixel(const Piece &piece, const Vertex<int> &h, Bound &entry) const {
+        const Input &in = inputs[piece.support];
+        const ExactPoint &a = vertices[piece.u], &b = vertices[piece.v];
+        bool vertical = in.dx == 0;
+        Bound lo = vertical ? Bound{a.y, a.d, false} : Bound{a.x, a.d, false};
+        Bound hi = vertical ? Bound{b.y, b.d, false} : Bound{b.x, b.d, false};
+        int hp = vertical ? h.y : h.x;
+        raise(lo, {2 * int128(hp) - 1, 2, false});
+        lower(hi, {2 * int128(hp) + 1, 2, true});
+        if (vertical) {
+            if (in.p.x != h.x)
+                return false;
+        } else if (in.dy == 0) {
+            if (in.p.y != h.y)
+                return false;
+        } else {
+            // x, при котором прямая проходит через y = h.y -+ 1/2
+            auto at = [&](int side) {
+                int128 n = 2 * int128(in.p.x) * in.dy + (2 * int128(h.y) + side - 2 * int128(in.p.y)) * in.dx;
+                int128 d = 2 * int128(in.dy);
+                return d < 0 ? pair(-n, -d) : pair(n, d);
+            };
+            auto [n1, d1] = at(-1);
+            auto [n2, d2] = at(1);
+            if (in.dy > 0) {
+                raise(lo, {n1, d1, false});
+                lower(hi, {n2, d2, true});
+            } else {
+                lower(hi, {n1, d1, false});
+                raise(lo, {n2, d2, true});
+            }
+        }
+        int c = compare(lo, hi);
+        if (c > 0 || (c == 0 && (lo.open || hi.open)))
+            return false;
+        entry = lo;
+        return true;
+    }
+
+    /// Кусок границы в координатах заметающей прямой (при транспонировании оси меняются местами)
+    struct Span {
+        int boundary;            /// номер в списке кусков границы
+        Vertex<int> a;           /// начало опорного ребра, dx > 0
+        long long dx, dy;
+        int128 lo, lo_d, hi, hi_d;  /// кусок занимает абсциссы (lo / lo_d, hi / hi_d)
+    };
+
+    /// Удвоенная ордината: ищутся куски, проходящие между двумя такими уровнями
+    struct Level {
+        long long y2;
+    };
+
+    /// Порядок кусков по ординате на прямой x = line / 2. В статусе только куски, пересекающие
+    /// прямую внутренней точкой; куски не пересекаются, поэтому их ординаты там различны.
+    struct SpanLess {
+        const vector<Span> *spans;
+        const long long *line;
+        using is_transparent = void;
+
+        /// Ордината куска, умноженная на 2 dx; при координатах до SWEEP_COORD_LIMIT помещается в 64 бита
+        [[nodiscard]] long long num(int s) const {
+            const Span &sp = (*spans)[s];
+            return 2 * sp.a.y * sp.dx + (*line - 2 * (long long) sp.a.x) * sp.dy;
+        }
+
+        bool operator()(int s, int t) const {
+            return int128(num(s)) * (*spans)[t].dx < int128(num(t)) * (*spans)[s].dx;
+        }
+
+        bool operator()(int s, const Level &l) const {
+            return int128(num(s)) < int128(l.y2) * (*spans)[s].dx;
+        }
+
+        bool operator()(const Level &l, int s) const {
+            return int128(l.y2) * (*spans)[s].dx < int128(num(s));
+        }
+    };
+
+    /// Пары (кусок границы, горячий пиксел), в которых кусок пересекает внутренней точкой сторону
+    /// пиксела на прямой x = h.x -+ 1/2 (при transpose — y = h.y -+ 1/2). Прямая заметает стороны
+    /// по порядку; куски, задевающие одну сторону, идут в статусе подряд.
+    void sideCrossings(const vector<pair<int, bool>> &boundary, const vector<int> &long_pieces,
+                       const vector<Vertex<int>> &hot, bool transpose, vector<pair<int, int>> &candidates) const {
+        auto frame = [&](const Vertex<int> &v) {
+            return transpose ? Vertex<int>(v.y, v.x) : v;
+        };
+        vector<Span> spans;
+        for (int b: long_pieces) {
+            const Piece &piece = pieces[boundary[b].first];
+            const Input &in = inputs[piece.support];
+            Vertex<int> a = frame(in.p), c = frame(in.q);
+            // параллельный заметающей прямой кусок лежит на целой абсциссе и сторон не пересекает
+            if (a.x == c.x)
+                continue;
+            if (c.x < a.x)
+                swap(a, c);
+            const ExactPoint &u = vertices[piece.u], &v = vertices[piece.v];
+            Span span{b, a, (long long) c.x - a.x, (long long) c.y - a.y,
+                      transpose ? u.y : u.x, u.d, transpose ? v.y : v.x, v.d};
+            if (span.hi * span.lo_d < span.lo * span.hi_d) {
+                swap(span.lo, span.hi);
+                swap(span.lo_d, span.hi_d);
+            }
+            spans.push_back(span);
+        }
+
+        vector<pair<long long, int>> sides;  /// удвоенная абсцисса стороны, пиксел
+        sides.reserve(2 * hot.size());
+        for (size_t i = 0; i < hot.size(); ++i) {
+            long long x = frame(hot[i]).x;
+            sides.emplace_back(2 * x - 1, i);
+            sides.emplace_back(2 * x + 1, i);
+        }
+        std::sort(sides.begin(), sides.end());
+
+        vector<int> by_lo(spans.size()), by_hi(spans.size());
+        for (size_t i = 0; i < spans.size(); ++i)
+            by_lo[i] = by_hi[i] = i;
+        std::sort(by_lo.begin(), by_lo.end(), [&](int s, int t) {
+            return spans[s].lo * spans[t].lo_d < spans[t].lo * spans[s].lo_d;
+        });
+        std::sort(by_hi.begin(), by_hi.end(), [&](int s, int t) {
+            return spans[s].hi * spans[t].hi_d < spans[t].hi * spans[s].hi_d;
+        });
+
+        long long line = 0;
+        SpanLess order{&spans, &line};
+        set<int, SpanLess> status(order);
+        vector<set<int, SpanLess>::iterator> where(spans.size(), status.end());
+        size_t next_lo = 0, next_hi = 0;
+        for (size_t k = 0; k < sides.size();) {
+            line = sides[k].first;
+            // сначала уходят куски, кончившиеся не правее прямой, потом входят начавшиеся левее неё
+            for (; next_hi < by_hi.size(); ++next_hi) {
+                const Span &sp = spans[by_hi[next_hi]];
+                if (2 * sp.hi > line * sp.hi_d)
+                    break;
+                if (where[by_hi[next_hi]] != status.end()) {
+                    status.erase(where[by_hi[next_hi]]);
+                    where[by_hi[next_hi]] = status.end();
+                }
+            }
+            for (; next_lo < by_lo.size(); ++next_lo) {
+                const Span &sp = spans[by_lo[next_lo]];
+                if (2 * sp.lo >= line * sp.lo_d)
+                    break;
+                if (2 * sp.hi > line * sp.hi_d)
+                    where[by_lo[next_lo]] = status.insert(by_lo[next_lo]).first;
+            }
+            size_t end = k;
+            while (end < sides.size() && sides[end].first == line)
+                ++end;
+            PAINTING_COUNT(MAP_LOOKUPS, status.empty() ? 0 : end - k);
+            for (; !status.empty() && k < end; ++k) {
+                long long y = frame(hot[sides[k].second]).y;
+                Level top{2 * y + 1};
+                for (auto it = status.lower_bound(Level{2 * y - 1}); it != status.end() && !order(top, *it); ++it)
+                    candidates.emplace_back(spans[*it].boundary, sides[k].second);
+            }
+            k = end;
+        }
+    }
+
+    /// Горячие пикселы рядом с куском b, если их можно найти без заметания: горячих пикселов в столбцах
+    /// куска не больше HOT_SCAN или самих столбцов не больше COLUMN_SCAN (тогда в каждом столбце берутся
+    /// строки, которые кусок в нём проходит, с запасом в пиксел). false — кусок длинный.
+    bool directCandidates(const Piece &piece, int b, const vector<Vertex<int>> &hot,
+                          vector<pair<int, int>> &candidates) const {
+        const Input &in = inputs[piece.support];
+        Vertex<double> a = vertices[piece.u].toDouble(), c = vertices[piece.v].toDouble();
+        auto check = [&](int hx, int hy_from, int hy_to) {
+            auto it = std::lower_bound(hot.begin(), hot.end(), Vertex<int>(hx, hy_from), lexLess);
+            for (; it != hot.end() && it->x == hx && it->y <= hy_to; ++it)
+                candidates.emplace_back(b, int(it - hot.begin()));
+        };
+        if (in.dx == 0) {
+            check(in.p.x, int(floor(a.y)) - 1, int(ceil(c.y)) + 1);
+            return true;
+        }
+        int hx_from = int(floor(a.x)) - 1, hx_to = int(ceil(c.x)) + 1;
+        double slope = double(in.dy) / double(in.dx);
+        auto first = std::lower_bound(hot.begin(), hot.end(), Vertex<int>(hx_from, INT_MIN), lexLess);
+        auto last = std::lower_bound(first, hot.end(), Vertex<int>(hx_to + 1, INT_MIN), lexLess);
+        if (last - first <= HOT_SCAN) {
+            for (auto it = first; it != last; ++it) {
+                double y = in.p.y + (it->x - in.p.x) * slope;
+                if (abs(it->y - y) <= abs(slope) + 2)
+                    candidates.emplace_back(b, int(it - hot.begin()));
+            }
+            return true;
+        }
+        if (hx_to - hx_from >= COLUMN_SCAN)
+            return false;
+        for (int hx = hx_from; hx <= hx_to; ++hx) {
+            double x0 = max(a.x, hx - 0.5), x1 = min(c.x, hx + 0.5);
+            if (x0 > x1 + 1)
+                continue;
+            double y0 = in.p.y + (x0 - in.p.x) * slope, y1 = in.p.y + (x1 - in.p.x) * slope;
+            check(hx, int(floor(min(y0, y1))) - 1, int(ceil(max(y0, y1))) + 1);
+        }
+        return true;
+    }
+
+    /// Горячие пикселы из candidates, через которые проходит кусок, в порядке от u к v: (точка входа, номер в hot)
+    void pixelsAlong(const Piece &piece, const vector<Vertex<int>> &hot, const pair<int, int> *first,
+                     const pair<int, int> *last, vector<pair<Bound, int>> &chain) const {
+        chain.clear();
+        for (; first != last; ++first) {
+            Bound entry;
+            if (throughPixel(piece, hot[first->second], entry))
+                chain.emplace_back(entry, first->second);
+        }
+        std::sort(chain.begin(), chain.end(), [](const pair<Bound, int> &l, const pair<Bound, int> &r) {
+            int c = compare(l.first, r.first);
+            return c != 0 ? c < 0 : !l.first.open && r.first.open;
+        });
+    }
+
+    static void addLoop(vector<Vertex<int>> &contour, vector<vector<Vertex<int>>> &res) {
+        simplify(contour);
+        if (contour.size() >= 3)
+            res.push_back(contour);
+    }
+
+public:
+    BooleanSolver(const vector<Polyhedron> &subject, FillRule subject_rule,
+                  const vector<Polyhedron> &clip, FillRule clip_rule) {
+        PAINTING_SCOPE("BooleanSolver::Constructor");
+        addPolygons(subject, subject_rule, 0);
+        addPolygons(clip, clip_rule, 1);
+        rules[0] = subject_rule;
+        rules[1] = clip_rule;
+        split();
+        label();
+    }
+
+    /// Контуры результата: внешние против часовой стрелки, дырки по часовой. Вершины целые,
+    /// каждый контур простой: без самопересечений и без повторных вершин.
+    [[nodiscard]] vector<vector<Vertex<int>>> contours(BooleanOperation op) const {
+        PAINTING_SCOPE("BooleanSolver::contours");
+        // шаг 3: куски границы, направленные так, чтобы результат был слева
+        vector<pair<int, bool>> boundary;  /// кусок и идёт ли граница от u к v
+        for (size_t i = 0; i < pieces.size(); ++i) {
+            const Piece &p = pieces[i];
+            bool under = apply(op, inside(p.below[0], rules[0]), inside(p.below[1], rules[1]));
+            bool over = apply(op, inside(p.below[0] + p.wind[0], rules[0]), inside(p.below[1] + p.wind[1], rules[1]));
+            if (under != over)
+                boundary.emplace_back(i, over);
+        }
+
+        // шаг 4: округление через горячие пикселы
+        vector<Vertex<int>> hot;
+        for (auto [i, forward]: boundary) {
+            hot.push_back(snap(vertices[pieces[i].u]));
+            hot.push_back(snap(vertices[pieces[i].v]));
+        }
+        std::sort(hot.begin(), hot.end(), lexLess);
+        hot.erase(std::unique(hot.begin(), hot.end()), hot.end());
+
+        // короткие куски проверяются напрямую; длинный, проходящий через пиксел, либо кончается в нём
+        // или на его границе (тогда пиксел среди соседей пиксела конца), либо пересекает его сторону
+        vector<pair<int, int>> candidates;  /// номер в boundary, номер в hot
+        vector<int> long_pieces;
+        for (size_t b = 0; b < boundary.size(); ++b) {
+            const Piece &piece = pieces[boundary[b].first];
+            if (directCandidates(piece, b, hot, candidates))
+                continue;
+            long_pieces.push_back(b);
+            for (int end: {piece.u, piece.v}) {
+                Vertex<int> c = snap(vertices[end]);
+                for (int dx = -1; dx <= 1; ++dx) {
+                    for (int dy = -1; dy <= 1; ++dy) {
+                        Vertex<int> h(c.x + dx, c.y + dy);
+                        auto it = std::lower_bound(hot.begin(), hot.end(), h, lexLess);
+                        if (it != hot.end() && *it == h)
+                            candidates.emplace_back(b, int(it - hot.begin()));
+                    }
+                }
+            }
+        }
+        if (!long_pieces.empty()) {
+            sideCrossings(boundary, long_pieces, hot, false, candidates);
+            sideCrossings(boundary, long_pieces, hot, true, candidates);
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+        // рёбра между центрами пикселов; совпадающие рёбра противоположных направлений сокращаются
+        vector<tuple<int, int, int>> snapped;  /// меньший конец, больший конец, +1 — от меньшего к большему
+        vector<pair<Bound, int>> chain;
+        for (size_t from = 0; from < candidates.size();) {
+            size_t to = from;
+            while (to < candidates.size() && candidates[to].first == candidates[from].first)
+                ++to;
+            auto [i, forward] = boundary[candidates[from].first];
+            pixelsAlong(pieces[i], hot, candidates.data() + from, candidates.data() + to, chain);
+            for (size_t k = 0; k + 1 < chain.size(); ++k) {
+                int a = chain[k].second, b = chain[k + 1].second;
+                if (a != b)
+                    snapped.emplace_back(min(a, b), max(a, b), (a < b) == forward ? 1 : -1);
+            }
+            from = to;
+        }
+        std::sort(snapped.begin(), snapped.end());
+        struct Directed {
+            int from, to;
+            long long dx, dy;
+        };
+        vector<Directed> edges;
+        for (size_t k = 0; k < snapped.size();) {
+            auto [a, b, dir] = snapped[k];
+            int count = 0;
+            for (; k < snapped.size() && get<0>(snapped[k]) == a && get<1>(snapped[k]) == b; ++k)
+                count += get<2>(snapped[k]);
+            if (count < 0) {
+                swap(a, b);
+                count = -count;
+            }
+            for (int c = 0; c < count; ++c)
+                edges.push_back({a, b, (long long) hot[b].x - hot[a].x, (long long) hot[b].y - hot[a].y});
+        }
+
+        vector<int> offsets(hot.size() + 1, 0);
+        for (auto &e: edges)
+            offsets[e.from + 1]++;
+        for (size_t v = 0; v < hot.size(); ++v)
+            offsets[v + 1] += offsets[v];
+        vector<int> outgoing(edges.size());
+        {
+            vector<int> fill_pos(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < edges.size(); ++i)
+                outgoing[fill_pos[edges[i].from]++] = i;
+        }
+
+        // шаг 5: обход
+        vector<vector<Vertex<int>>> res;
+        vector<char> used(edges.size(), 0);
+        vector<int> cycle, path;
+        vector<int> position(hot.size(), -1);
+        vector<Vertex<int>> contour;
+        for (size_t first = 0; first < edges.size(); ++first) {
+            if (used[first])
+                continue;
+            cycle.clear();
+            int e = first;
+            while (!used[e]) {
+                used[e] = 1;
+                const Directed &cur = edges[e];
+                cycle.push_back(cur.from);
+                // из вершины cur.to — ближайший по часовой стрелке от обратного направления поворот
+                int best = -1;
+                for (int k = offsets[cur.to]; k < offsets[cur.to + 1]; ++k) {
+                    const Directed &cand = edges[outgoing[k]];
+                    if (best < 0 || clockwiseCloser(-cur.dx, -cur.dy, edges[best].dx, edges[best].dy,
+                                                    cand.dx, cand.dy))
+                        best = outgoing[k];
+                }
+                if (best < 0)
+                    throw std::runtime_error("BooleanSolver::contours boundary is not closed");
+                e = best;
+            }
+            // контур, проходящий через вершину дважды, разрезается в ней на простые петли:
+            // рёбра те же, поэтому заливка не меняется
+            path.clear();
+            for (int v: cycle) {
+                if (position[v] >= 0) {
+                    contour.clear();
+                    for (size_t k = position[v]; k < path.size(); ++k) {
+                        contour.push_back(hot[path[k]]);
+                        if (k > size_t(position[v]))
+                            position[path[k]] = -1;
+                    }
+                    path.resize(position[v] + 1);
+                    addLoop(contour, res);
+                } else {
+                    position[v] = path.size();
+                    path.push_back(v);
+                }
+            }
+            contour.clear();
+            for (int v: path) {
+                contour.push_back(hot[v]);
+                position[v] = -1;
+            }
+            addLoop(contour, res);
+        }
+        return res;
+    }
+
+    /// Удаляет повторяющиеся вершины и вершины на одной прямой с соседними
+    static void simplify(vector<Vertex<int>> &contour) {
+        vector<Vertex<int>> out;
+        out.reserve(contour.size());
+        auto collinear = [](const Vertex<int> &a, const Vertex<int> &b, const Vertex<int> &c) {
+            return (long long) (b.x - a.x) * (c.y - b.y) - (long long) (b.y - a.y) * (c.x - b.x) == 0;
+        };
+        for (auto &p: contour) {
+            if (!out.empty() && out.back() == p)
+                continue;
+            while (out.size() >= 2 && collinear(out[out.size() - 2], out.back(), p))
+                out.pop_back();
+            out.push_back(p);
+        }
+        // то же на стыке конца и начала
+        bool changed = true;
+        while (changed && out.size() >= 3) {
+            changed = false;
+            if (out.back() == out.front()) {
+                out.pop_back();
+                changed = true;
+            } else if (collinear(out[out.size() - 2], out.back(), out.front())) {
+                out.pop_back();
+                changed = true;
+            } else if (collinear(out.back(), out.front(), out[1])) {
+                out.erase(out.begin());
+                changed = true;
+            }
+        }
+        contour = std::move(out);
+    }
+};
+
+/// Контуры результата op над наборами subject и clip
+inline vector<vector<Vertex<int>>> booleanContours(const vector<Polyhedron> &subject, const vector<Polyhedron> &clip,
+                                                   BooleanOperation op, FillRule subject_rule = NON_ZERO,
+                                                   FillRule clip_rule = NON_ZERO) {
+    return BooleanSolver(subject, subject_rule, clip, clip_rule).contours(op);
+}
+
+/// То же в виде многоугольников; обход контуров сохраняется, поэтому дырки остаются дырками
+/// при совместной заливке (fillContours), но не при заливке каждого многоугольника отдельно
+inline vector<Polyhedron> booleanOperation(const vector<Polyhedron> &subject, const vector<Polyhedron> &clip,
+                                           BooleanOperation op, FillRule subject_rule = NON_ZERO,
+                                           FillRule clip_rule = NON_ZERO) {
+    vector<Polyhedron> res;
+    for (auto &contour: booleanContours(subject, clip, op, subject_rule, clip_rule)) {
+        vector<Segment<int>> segments;
+        segments.reserve(contour.size());
+        for (size_t i = 0; i < contour.size(); ++i)
+            segments.emplace_back(contour[i], contour[(i + 1) % contour.size()]);
+        res.emplace_back(segments);
+    }
+    return res;
+}
+
+/// Заливка набора контуров одной построчной заливкой: дырки остаются пустыми
+template<RasterTarget Img>
+void fillContours(const vector<vector<Vertex<int>>> &contours, Img &img, const Magick::Color &col,
+                  FillRule rule = NON_ZERO) {
+    PAINTING_SCOPE("fillContours");
+    const auto pen = makePen(img, col);
+    const PixelRect clip = targetBounds(img);
+    static thread_local PolygonClipper clipper;
+    static thread_local ScanlineFiller filler;
+    clipper.setRect(clip);
+    filler.clear();
+    for (auto &contour: contours)
+        clipper.addContour(filler, contour);
+    filler.fill(rule, clip.y0, clip.y1, [&](int y, int x_from, int x_to) {
+        plotSpan(img, y, max(x_from, clip.x0), min(x_to, clip.x1), pen);
+    });
+}
+
+template<RasterTarget Img>
+void fillContours(const vector<Polyhedron> &polygons, Img &img, const Magick::Color &col, FillRule rule = NON_ZERO) {
+    PAINTING_SCOPE("fillContours");
+    const auto pen = makePen(img, col);
+    const PixelRect clip = targetBounds(img);
+    static thread_local PolygonClipper clipper;
+    static thread_local ScanlineFiller filler;
+    clipper.setRect(clip);
+    filler.clear();
+    for (auto &pol: polygons)
+        clipper.addSegments(filler, pol.getSegments());
+    filler.fill(rule, clip.y0, clip.y1, [&](int y, int x_from, int x_to) {
+        plotSpan(img, y, max(x_from, clip.x0), min(x_to, clip.x1), pen);
+    });
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <Magick++.h>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <concepts>
+#include "instrumentation.h"
+
+using namespace std;
+
+/// Прямоугольник пикселов [x0, x1) x [y0, y1)
+struct PixelRect {
+    int x0 = 0, y0 = 0;
+    int x1 = 0, y1 = 0;
+
+    [[nodiscard]] bool empty() const {
+        return x0 >= x1 || y0 >= y1;
+    }
+
+    [[nodiscard]] bool contains(int x, int y) const {
+        return x0 <= x && x < x1 && y0 <= y && y < y1;
+    }
+
+    [[nodiscard]] PixelRect intersect(const PixelRect &r) const {
+        return {max(x0, r.x0), max(y0, r.y0), min(x1, r.x1), min(y1, r.y1)};
+    }
+
+    bool operator==(const PixelRect &) const = default;
+};
+
+/// Холст с непрерывным буфером пикселов RGBA (по байту на канал, строки подряд, y = 0 — первая строка).
+/// Примитивы пишут в него напрямую, а в Magick::Image он переносится одной операцией в конце.
+class Canvas {
+public:
+    using Pixel = uint32_t;
+private:
+    int width, height;
+    vector<Pixel> pixels;
+public:
+    Canvas(int _width, int _height, const Magick::Color &background = Magick::Color("white"))
+            : width(_width), height(_height) {
+        if (width <= 0 || height <= 0)
+            throw std::runtime_error("Canvas::Constructor size is empty");
+        pixels.assign(size_t(width) * height, pack(background));
+    }
+
+    /// Переводит цвет в формат пиксела холста. Холст непрозрачный, как и изображения,
+    /// которые он заменяет, поэтому альфа-канал всегда максимальный.
+    static Pixel pack(const Magick::Color &col) {
+        auto channel = [](double q) -> uint8_t {
+            return uint8_t(std::clamp(q / QuantumRange, 0.0, 1.0) * 255 + 0.5);
+        };
+        return packRGB(channel(col.quantumRed()), channel(col.quantumGreen()), channel(col.quantumBlue()));
+    }
+
+    static Pixel packRGB(uint8_t r, uint8_t g, uint8_t b) {
+        array<uint8_t, 4> rgba = {r, g, b, 255};
+        Pixel p;
+        memcpy(&p, rgba.data(), sizeof(p));
+        return p;
+    }
+
+    static array<uint8_t, 4> unpack(Pixel p) {
+        array<uint8_t, 4> rgba;
+        memcpy(rgba.data(), &p, sizeof(p));
+        return rgba;
+    }
+
+    [[nodiscard]] int getWidth() const {
+        return width;
+    }
+
+    [[nodiscard]] int getHeight() const {
+        return height;
+    }
+
+    [[nodiscard]] PixelRect bounds() const {
+        return {0, 0, width, height};
+    }
+
+    [[nodiscard]] Pixel *row(int y) {
+        return pixels.data() + size_t(y) * width;
+    }
+
+    [[nodiscard]] const Pixel *row(int y) const {
+        return pixels.data() + size_t(y) * width;
+    }
+
+    [[nodiscard]] const Pixel *data() const {
+        return pixels.data();
+    }
+
+    [[nodiscard]] Pixel getPixel(int x, int y) const {
+        return row(y)[x];
+    }
+
+    /// Точки за пределами холста пропускаются
+    void setPixel(int x, int y, Pixel p) {
+        if (unsigned(x) < unsigned(width) && unsigned(y) < unsigned(height)) {
+            row(y)[x] = p;
+            PAINTING_COUNT(PIXELS_WRITTEN, 1);
+        }
+    }
+
+    /// Закрашивает отрезок строки [x_from, x_to), обрезанный по границам холста
+    void fillSpan(int y, int x_from, int x_to, Pixel p) {
+        if (unsigned(y) >= unsigned(height))
+            return;
+        x_from = max(x_from, 0);
+        x_to = min(x_to, width);
+        if (x_from < x_to) {
+            std::fill(row(y) + x_from, row(y) + x_to, p);
+            PAINTING_COUNT(PIXELS_WRITTEN, x_to - x_from);
+        }
+    }
+
+    /// Смешивает пиксел с цветом p: alpha = 255 — цвет p, 0 — пиксел не меняется
+    void blendPixel(int x, int y, Pixel p, uint8_t alpha) {
+        if (unsigned(x) >= unsigned(width) || unsigned(y) >= unsigned(height))
+            return;
+        PAINTING_COUNT(PIXELS_WRITTEN, 1);
+        Pixel &dst = row(y)[x];
+        auto a = unpack(dst), b = unpack(p);
+        for (int c = 0; c < 3; ++c)
+            a[c] = uint8_t((b[c] * alpha + a[c] * (255 - alpha) + 127) / 255);
+        memcpy(&dst, a.data(), sizeof(dst));
+    }
+
+    void clear(Pixel p) {
+        std::fill(pixels.begin(), pixels.end(), p);
+    }
+
+    /// Тот же интерфейс, что и у Magick::Image
+    void pixelColor(int x, int y, const Magick::Color &col) {
+        setPixel(x, y, pack(col));
+    }
+
+    /// Копирует буфер в изображение одной операцией
+    void syncTo(Magick::Image &img) const {
+        PAINTING_SCOPE("Canvas::syncTo");
+        img.read(width, height, "RGBA", Magick::CharPixel, pixels.data());
+    }
+
+    [[nodiscard]] Magick::Image toImage() const {
+        Magick::Image img;
+        syncTo(img);
+        return img;
+    }
+};
+
+/// Часть холста: запись за пределами прямоугольника rect отбрасывается. Нужна, чтобы растеризовать
+/// примитив только внутри тайла или изменившейся области, не меняя остальных пикселов.
+struct CanvasView {
+    Canvas *canvas;
+    PixelRect rect;
+
+    CanvasView(Canvas &_canvas, const PixelRect &_rect) : canvas(&_canvas), rect(_rect.intersect(_canvas.bounds())) {}
+};
+
+/// Цвет, подготовленный для записи в конкретный холст: для Canvas он переводится в пиксел один раз
+/// на примитив, а не на каждую точку
+inline Magick::Color makePen(Magick::Image &, const Magick::Color &col) {
+    return col;
+}
+
+inline Canvas::Pixel makePen(Canvas &, const Magick::Color &col) {
+    return Canvas::pack(col);
+}
+
+inline Canvas::Pixel makePen(CanvasView &, const Magick::Color &col) {
+    return Canvas::pack(col);
+}
+
+inline void plot(Magick::Image &img, int x, int y, const Magick::Color &col) {
+    PAINTING_COUNT(PIXELS_WRITTEN, 1);
+    img.pixelColor(x, y, col);
+}
+
+inline void plot(Canvas &canvas, int x, int y, Canvas::Pixel p) {
+    canvas.setPixel(x, y, p);
+}
+
+inline void plot(CanvasView &view, int x, int y, Canvas::Pixel p) {
+    if (view.rect.contains(x, y)) {
+        view.canvas->row(y)[x] = p;
+        PAINTING_COUNT(PIXELS_WRITTEN, 1);
+    }
+}
+
+inline void plotSpan(Magick::Image &img, int y, int x_from, int x_to, const Magick::Color &col) {
+    PAINTING_COUNT(PIXELS_WRITTEN, max(x_to - x_from, 0));
+    for (int x = x_from; x < x_to; ++x)
+        img.pixelColor(x, y, col);
+}
+
+inline void plotSpan(Canvas &canvas, int y, int x_from, int x_to, Canvas::Pixel p) {
+    canvas.fillSpan(y, x_from, x_to, p);
+}
+
+inline void plotSpan(CanvasView &view, int y, int x_from, int x_to, Canvas::Pixel p) {
+    if (y < view.rect.y0 || y >= view.rect.y1)
+        return;
+    x_from = max(x_from, view.rect.x0);
+    x_to = min(x_to, view.rect.x1);
+    if (x_from < x_to) {
+        std::fill(view.canvas->row(y) + x_from, view.canvas->row(y) + x_to, p);
+        PAINTING_COUNT(PIXELS_WRITTEN, x_to - x_from);
+    }
+}
+
+/// Частичное закрашивание пиксела для сглаживания; alpha — доля покрытия от 0 до 255
+inline void blend(Magick::Image &img, int x, int y, const Magick::Color &col, uint8_t alpha) {
+    PAINTING_COUNT(PIXELS_WRITTEN, 1);
+    Magick::Color dst = img.pixelColor(x, y);
+    double a = alpha / 255.0;
+    img.pixelColor(x, y, Magick::Color(col.quantumRed() * a + dst.quantumRed() * (1 - a),
+                                       col.quantumGreen() * a + dst.quantumGreen() * (1 - a),
+                                       col.quantumBlue() * a + dst.quantumBlue() * (1 - a)));
+}
+
+inline void blend(Canvas &canvas, int x, int y, Canvas::Pixel p, uint8_t alpha) {
+    canvas.blendPixel(x, y, p, alpha);
+}
+
+inline void blend(CanvasView &view, int x, int y, Canvas::Pixel p, uint8_t alpha) {
+    if (view.rect.contains(x, y))
+        view.canvas->blendPixel(x, y, p, alpha);
+}
+
+/// Область, в которую можно рисовать: примитивы обрезаются по ней до растеризации
+inline PixelRect targetBounds(const Magick::Image &img) {
+    return {0, 0, int(img.columns()), int(img.rows())};
+}
+
+inline PixelRect targetBounds(const Canvas &canvas) {
+    return canvas.bounds();
+}
+
+inline PixelRect targetBounds(const CanvasView &view) {
+    return view.rect;
+}
+
+/// Всё, во что умеют рисовать примитивы: Magick::Image, Canvas и CanvasView
+template<typename Img>
+concept RasterTarget = requires(Img &img, const Magick::Color &col) {
+    plot(img, 0, 0, makePen(img, col));
+    plotSpan(img, 0, 0, 0, makePen(img, col));
+    { targetBounds(img) } -> same_as<PixelRect>;
+};
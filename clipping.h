@@ -0,0 +1,143 @@
+#pragma once
+
+#include "polyhedron.h"
+#include <span>
+#include <limits>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/// Отсечение множества отрезков одним выпуклым окном (Кирус — Бек). Нормали и смещения сторон окна
+/// вычисляются один раз в конструкторе и хранятся отдельными массивами; отрезки обрабатываются пачками,
+/// по несколько за раз с AVX2, если он доступен.
+class ConvexClipper {
+private:
+    /// сторона окна: точка P внутри, если nx * P.x + ny * P.y + c >= 0
+    vector<double> nx, ny, c;
+
+    static constexpr size_t BLOCK = 64;
+
+    void clipScalar(size_t from, size_t to, const double *x0, const double *y0, const double *x1, const double *y1,
+                    double *t_in, double *t_out) const {
+        const double inf = numeric_limits<double>::infinity();
+        for (size_t i = from; i < to; ++i) {
+            t_in[i] = 0;
+            t_out[i] = 1;
+        }
+        for (size_t e = 0; e < nx.size(); ++e) {
+            const double a = nx[e], b = ny[e], d = c[e];
+            for (size_t i = from; i < to; ++i) {
+                double num = a * x0[i] + b * y0[i] + d;
+                double den = a * (x1[i] - x0[i]) + b * (y1[i] - y0[i]);
+                double t = -num / den;
+                t_in[i] = den > 0 ? max(t_in[i], t) : t_in[i];
+                t_out[i] = den < 0 ? min(t_out[i], t) : t_out[i];
+                // параллельный стороне отрезок снаружи окна
+                t_in[i] = den == 0 && num < 0 ? inf : t_in[i];
+            }
+        }
+    }
+
+#ifdef __AVX2__
+
+    size_t clipAvx(size_t count, const double *x0, const double *y0, const double *x1, const double *y1,
+                   double *t_in, double *t_out) const {
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d one = _mm256_set1_pd(1);
+        const __m256d inf = _mm256_set1_pd(numeric_limits<double>::infinity());
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m256d px = _mm256_loadu_pd(x0 + i), py = _mm256_loadu_pd(y0 + i);
+            __m256d lx = _mm256_sub_pd(_mm256_loadu_pd(x1 + i), px);
+            __m256d ly = _mm256_sub_pd(_mm256_loadu_pd(y1 + i), py);
+            __m256d lo = zero, hi = one;
+            for (size_t e = 0; e < nx.size(); ++e) {
+                __m256d a = _mm256_set1_pd(nx[e]), b = _mm256_set1_pd(ny[e]);
+                __m256d num = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(a, px), _mm256_mul_pd(b, py)),
+                                            _mm256_set1_pd(c[e]));
+                __m256d den = _mm256_add_pd(_mm256_mul_pd(a, lx), _mm256_mul_pd(b, ly));
+                __m256d t = _mm256_div_pd(_mm256_sub_pd(zero, num), den);
+                lo = _mm256_blendv_pd(lo, _mm256_max_pd(lo, t), _mm256_cmp_pd(den, zero, _CMP_GT_OQ));
+                hi = _mm256_blendv_pd(hi, _mm256_min_pd(hi, t), _mm256_cmp_pd(den, zero, _CMP_LT_OQ));
+                __m256d outside = _mm256_and_pd(_mm256_cmp_pd(den, zero, _CMP_EQ_OQ),
+                                                _mm256_cmp_pd(num, zero, _CMP_LT_OQ));
+                lo = _mm256_blendv_pd(lo, inf, outside);
+            }
+            _mm256_storeu_pd(t_in + i, lo);
+            _mm256_storeu_pd(t_out + i, hi);
+        }
+        return i;
+    }
+
+#endif
+
+public:
+    explicit ConvexClipper(const Polyhedron &window) {
+        if (!window.isConvex())
+            throw std::runtime_error("ConvexClipper::Constructor window is not convex");
+
+        auto &segments = window.getSegments();
+        nx.reserve(segments.size());
+        ny.reserve(segments.size());
+        c.reserve(segments.size());
+        for (auto &segm: segments) {
+            nx.push_back(segm.n.x);
+            ny.push_back(segm.n.y);
+            c.push_back(-(double(segm.n.x) * segm.a.x + double(segm.n.y) * segm.a.y));
+        }
+    }
+
+    /// Отсекает count отрезков (x0[i], y0[i]) - (x1[i], y1[i]). Видимая часть i-го отрезка — точки
+    /// P0 + t (P1 - P0) при t_in[i] <= t <= t_out[i]; если t_in[i] > t_out[i], отрезок целиком снаружи.
+    void clip(size_t count, const double *x0, const double *y0, const double *x1, const double *y1,
+              double *t_in, double *t_out) const {
+        PAINTING_COUNT(EDGE_TESTS, nx.size() * count);
+        size_t done = 0;
+#ifdef __AVX2__
+        done = clipAvx(count, x0, y0, x1, y1, t_in, t_out);
+#endif
+        clipScalar(done, count, x0, y0, x1, y1, t_in, t_out);
+    }
+
+    /// Отсекает отрезки lines и записывает результат в out (out.size() >= lines.size()).
+    /// Невидимый отрезок заменяется вырожденным {a, a}, как в cyrusBeckClipLine. Возвращает число видимых.
+    size_t clip(std::span<const Segment<int>> lines, std::span<Segment<int>> out) const {
+        if (out.size() < lines.size())
+            throw std::runtime_error("ConvexClipper::clip output buffer is too small");
+        PAINTING_SCOPE("ConvexClipper::clip");
+
+        double x0[BLOCK], y0[BLOCK], x1[BLOCK], y1[BLOCK], t_in[BLOCK], t_out[BLOCK];
+        size_t visible = 0;
+        for (size_t from = 0; from < lines.size(); from += BLOCK) {
+            size_t count = min(BLOCK, lines.size() - from);
+            for (size_t i = 0; i < count; ++i) {
+                auto &line = lines[from + i];
+                x0[i] = line.a.x;
+                y0[i] = line.a.y;
+                x1[i] = line.b.x;
+                y1[i] = line.b.y;
+            }
+            clip(count, x0, y0, x1, y1, t_in, t_out);
+            for (size_t i = 0; i < count; ++i) {
+                auto &line = lines[from + i];
+                if (t_in[i] > t_out[i]) {
+                    out[from + i] = Segment<int>{line.a, line.a};
+                    continue;
+                }
+                double lx = x1[i] - x0[i], ly = y1[i] - y0[i];
+                Vertex<int> a = {roundToInt(x0[i] + lx * t_in[i]), roundToInt(y0[i] + ly * t_in[i])};
+                Vertex<int> b = {roundToInt(x0[i] + lx * t_out[i]), roundToInt(y0[i] + ly * t_out[i])};
+                out[from + i] = Segment<int>{a, b};
+                visible++;
+            }
+        }
+        return visible;
+    }
+
+    [[nodiscard]] Segment<int> clip(const Segment<int> &line) const {
+        Segment<int> ans;
+        clip(std::span<const Segment<int>>(&line, 1), std::span<Segment<int>>(&ans, 1));
+        return ans;
+    }
+};
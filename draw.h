@@ -4,43 +4,125 @@
 #include <cmath>
 #include <Magick++.h>
 #include "vertex.h"
+#include "canvas.h"
+#include "bezier.h"
 
 using namespace std;
 
-void drawLine(int x1, int y1, int x2, int y2, Magick::Image &img, const Magick::Color &col) {
-    if (x1 > x2) {
+/// Деление с округлением вниз и вверх для любых знаков
+inline long long floorDiv(__int128 a, __int128 b) {
+    __int128 q = a / b;
+    return q - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+inline long long ceilDiv(__int128 a, __int128 b) {
+    return -floorDiv(-a, b);
+}
+
+/// Отрезок растеризуется по формуле середины: по ведущей оси берутся все точки от одного конца до другого,
+/// а вторая координата — ближайшая к прямой (половина округляется вверх). Концы упорядочены по ведущей оси,
+/// поэтому отрезок не зависит от направления, а каждая точка вычисляется по своему положению — значит,
+/// отрезок можно сначала обрезать по clip и шагать только по видимой части, и результат совпадёт
+/// с полной отрисовкой.
+template<RasterTarget Img, class Pen>
+void drawLineClipped(int x1, int y1, int x2, int y2, Img &img, const Pen &pen, const PixelRect &clip) {
+    if (clip.empty())
+        return;
+    bool x_major = abs((long long) x2 - x1) >= abs((long long) y2 - y1);
+    if (x_major ? x1 > x2 : y1 > y2) {
         swap(x1, x2);
         swap(y1, y2);
     }
-    const int delta_x = 2 * abs(x2 - x1), delta_y = 2 * abs(y2 - y1);
-    const int step_x = x1 < x2 ? 1 : -1, step_y = y1 < y2 ? 1 : -1;
-    int error = delta_x - delta_y;
-    while (x1 != x2 && y1 != y2) {
-        img.pixelColor(x1, y1, col);
-        if (error > -delta_y) {
-            error -= delta_y;
-            x1 += step_x;
-        }
-        if (error < delta_x) {
-            error += delta_x;
-            y1 += step_y;
-        }
+
+    // горизонталь и вертикаль — одним отрезком строки или столбца
+    if (y1 == y2) {
+        if (y1 >= clip.y0 && y1 < clip.y1)
+            plotSpan(img, y1, max(x1, clip.x0), int(min<long long>(x2 + 1LL, clip.x1)), pen);
+        return;
+    }
+    if (x1 == x2) {
+        if (x1 < clip.x0 || x1 >= clip.x1)
+            return;
+        for (int y = max(y1, clip.y0), y_end = min(y2, clip.y1 - 1); y <= y_end; ++y)
+            plot(img, x1, y, pen);
+        return;
     }
-    while (x1 != x2) {
-        img.pixelColor(x1, y2, col);
-        x1 += step_x;
+
+    // ведущая координата u = u1 + t, 0 <= t <= du; вторая v = v1 + sv * m(t), m(t) = floor((2 dv t + du) / (2 du))
+    int u1 = x_major ? x1 : y1, v1 = x_major ? y1 : x1;
+    long long du = x_major ? (long long) x2 - x1 : (long long) y2 - y1;
+    long long dv = abs(x_major ? (long long) y2 - y1 : (long long) x2 - x1);
+    int sv = (x_major ? y2 > y1 : x2 > x1) ? 1 : -1;
+    int u_lo = x_major ? clip.x0 : clip.y0, u_hi = x_major ? clip.x1 - 1 : clip.y1 - 1;
+    int v_lo = x_major ? clip.y0 : clip.x0, v_hi = x_major ? clip.y1 - 1 : clip.x1 - 1;
+
+    // допустимые значения m, при которых v попадает в clip
+    long long m_lo = sv > 0 ? (long long) v_lo - v1 : (long long) v1 - v_hi;
+    long long m_hi = sv > 0 ? (long long) v_hi - v1 : (long long) v1 - v_lo;
+    const __int128 A = 2 * dv, B = du, D = 2 * du;
+    long long t_from = max({0LL, (long long) u_lo - u1, ceilDiv(D * m_lo - B, A)});
+    long long t_to = min({du, (long long) u_hi - u1, floorDiv(D * (m_hi + 1) - B - 1, A)});
+    if (t_from > t_to)
+        return;
+
+    long long m = floorDiv(A * t_from + B, D);
+    int u = int(u1 + t_from), v = int(v1 + sv * m);
+    int steps = int(t_to - t_from);
+    if (dv == du) {
+        // 45 градусов: шаг по диагонали без ошибки
+        for (int i = 0; i <= steps; ++i, ++u, v += sv)
+            x_major ? plot(img, u, v, pen) : plot(img, v, u, pen);
+        return;
     }
-    while (y1 != y2) {
-        img.pixelColor(x2, y1, col);
-        y1 += step_y;
+    long long r = (long long) (A * t_from + B - D * m), a = (long long) A, d = (long long) D;
+    for (int i = 0; i <= steps; ++i) {
+        if (x_major)
+            plot(img, u, v, pen);
+        else
+            plot(img, v, u, pen);
+        ++u;
+        r += a;
+        if (r >= d) {
+            r -= d;
+            v += sv;
+        }
     }
-    img.pixelColor(x2, y2, col);
 }
 
-void drawLine(const Vertex<int> &from, const Vertex<int> &to, Magick::Image &img, const Magick::Color &color) {
+template<RasterTarget Img>
+void drawLine(int x1, int y1, int x2, int y2, Img &img, const Magick::Color &col) {
+    drawLineClipped(x1, y1, x2, y2, img, makePen(img, col), targetBounds(img));
+}
+
+template<RasterTarget Img>
+void drawLine(const Vertex<int> &from, const Vertex<int> &to, Img &img, const Magick::Color &color) {
     drawLine(from.x, from.y, to.x, to.y, img, color);
 }
 
+/// Ломаная через points (замкнутая, если closed): цвет и границы готовятся один раз на всю ломаную
+template<RasterTarget Img>
+void drawPolyline(const vector<Vertex<int>> &points, Img &img, const Magick::Color &color, bool closed = false) {
+    if (points.empty())
+        return;
+    PAINTING_SCOPE("drawPolyline");
+    const auto pen = makePen(img, color);
+    const PixelRect clip = targetBounds(img);
+    for (size_t i = 0; i + 1 < points.size(); ++i)
+        drawLineClipped(points[i].x, points[i].y, points[i + 1].x, points[i + 1].y, img, pen, clip);
+    if (closed && points.size() > 2)
+        drawLineClipped(points.back().x, points.back().y, points[0].x, points[0].y, img, pen, clip);
+}
+
+/// Набор независимых отрезков одним цветом
+template<RasterTarget Img>
+void drawLines(const vector<pair<Vertex<int>, Vertex<int>>> &lines, Img &img, const Magick::Color &color) {
+    PAINTING_SCOPE("drawLines");
+    const auto pen = makePen(img, color);
+    const PixelRect clip = targetBounds(img);
+    for (auto &[a, b]: lines)
+        drawLineClipped(a.x, a.y, b.x, b.y, img, pen, clip);
+}
+
 
 vector<int> getCombCoeffs(int n) {
     if (n == 1)
@@ -59,28 +141,42 @@ vector<int> getCombCoeffs(int n) {
     return coeffs;
 }
 
-void drawBezierCurve(const vector<Vertex<int>> &_points, Magick::Image &img, const Magick::Color &color) {
-    size_t n = _points.size();
-    auto coeffs = getCombCoeffs(n);
-    vector<Vertex<double>> points(n);
-    for (size_t i = 0; i < n; ++i) {
-        points[i] = convertToDoubleVertex(_points[i]);
-    }
-    // sum(coeffs[i] * (1 - t) ^ (n - i) * t ^ i * points[i])
-    Vertex<int> last = _points[0];
-    for (double t = 0.0; t <= 1.0; t += 0.01) {
-        Vertex<double> a = {0.0, 0.0};
-        for (size_t i = 0; i < n; i++) {
-            a += points[i] * (coeffs[i] * pow((1 - t), n - i - 1) * pow(t, i));
-        }
-        Vertex<int> cur(roundToInt(a.x), roundToInt(a.y));
-        if ((cur - last).mod2() <= 3)
+/// Рисует ломаную, начинающуюся в точке start; вершины округляются до пикселов
+template<RasterTarget Img>
+void drawFlattened(const Vertex<int> &start, const vector<Vertex<double>> &polyline, Img &img,
+                   const Magick::Color &color) {
+    const auto pen = makePen(img, color);
+    const PixelRect clip = targetBounds(img);
+    Vertex<int> last = start;
+    for (auto &p: polyline) {
+        Vertex<int> cur(roundToInt(p.x), roundToInt(p.y));
+        if (cur == last)
             continue;
-        drawLine(last.x, last.y, cur.x, cur.y, img, color);
+        drawLineClipped(last.x, last.y, cur.x, cur.y, img, pen, clip);
         last = cur;
-//        img.pixelColor(cur.x, cur.y, color);
     }
-    drawLine(last, _points.back(), img, color);
+}
+
+template<RasterTarget Img>
+void drawBezierCurve(const vector<Vertex<int>> &points, Img &img, const Magick::Color &color) {
+    if (points.empty())
+        return;
+    PAINTING_SCOPE("drawBezierCurve");
+    // буфер переиспользуется между вызовами, поэтому после первой кривой память не выделяется
+    static thread_local vector<Vertex<double>> polyline;
+    polyline.clear();
+    flattenBezier(points, BEZIER_TOLERANCE, polyline);
+    drawFlattened(points[0], polyline, img, color);
+}
+
+template<RasterTarget Img>
+void drawCubicBezier(const Vertex<int> &p1, const Vertex<int> &p2, const Vertex<int> &p3, const Vertex<int> &p4,
+                     Img &img, const Magick::Color &color) {
+    static thread_local vector<Vertex<double>> polyline;
+    polyline.clear();
+    flattenBezier<3>({convertToDoubleVertex(p1), convertToDoubleVertex(p2),
+                      convertToDoubleVertex(p3), convertToDoubleVertex(p4)}, BEZIER_TOLERANCE, polyline);
+    drawFlattened(p1, polyline, img, color);
 }
 
 
@@ -88,8 +184,10 @@ void drawBezierCurve(const vector<Vertex<int>> &_points, Magick::Image &img, con
 /// порядка строит дугу окружности. Функция получает в качестве параметров координаты
 /// центра окружности, радиус окружности и значения двух углов, которые задают радиус-вектора от центра окружности до
 /// крайних точек дуги. Дуга строится против часовой стрелки.
+template<RasterTarget Img>
 void drawCircleWithBezie(const Vertex<int> &center, int r, double phi1, double phi2,
-                         Magick::Image &img, const Magick::Color &color, const Magick::Color &color2) {
+                         Img &img, const Magick::Color &color, const Magick::Color &color2) {
+    const auto pen2 = makePen(img, color2);
     double step = M_PI / 4;
     while (phi1 < phi2) {
         double R = r / sin(M_PI / 2 - step / 2);
@@ -101,12 +199,12 @@ void drawCircleWithBezie(const Vertex<int> &center, int r, double phi1, double p
                     center + Vertex{roundToInt(R * cos(phi1 + step / 2)), roundToInt(R * sin(phi1 + step / 2))};
             Vertex<int> p2 = p1 + (pt - p1) * F;
             Vertex<int> p3 = p4 + (pt - p4) * F;
-            drawBezierCurve({p1, p2, p3, p4}, img, color);
+            drawCubicBezier(p1, p2, p3, p4, img, color);
             phi1 += step;
-            img.pixelColor(p1.x, p1.y, color2);
-            img.pixelColor(p2.x, p2.y, color2);
-            img.pixelColor(p3.x, p3.y, color2);
-            img.pixelColor(p4.x, p4.y, color2);
+            plot(img, p1.x, p1.y, pen2);
+            plot(img, p2.x, p2.y, pen2);
+            plot(img, p3.x, p3.y, pen2);
+            plot(img, p4.x, p4.y, pen2);
         }
         step = phi2 - phi1;
     }
@@ -0,0 +1,290 @@
+#pragma once
+
+#include "canvas.h"
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <memory>
+
+/// Потоковая запись анимации GIF89a: каждый кадр сжимается и дописывается в файл сразу,
+/// поэтому в памяти никогда не хранится больше одного кадра.
+/// Кадр получает собственную палитру из своих цветов; если их больше 256, цвета квантуются равномерно.
+class GifWriter {
+private:
+    ofstream out;
+    int width, height;
+    int delay;
+    bool bottom_up;
+
+    static constexpr int MAX_CODE = 4095;
+
+    /// Упаковка кодов переменной длины в подблоки по 255 байт
+    struct BitWriter {
+        vector<uint8_t> &out;
+        uint32_t bits = 0;
+        int count = 0;
+        uint8_t block[255] = {};
+        int block_size = 0;
+
+        void flushByte() {
+            block[block_size++] = bits & 0xFF;
+            bits >>= 8;
+            count -= 8;
+            if (block_size == 255)
+                flushBlock();
+        }
+
+        void flushBlock() {
+            if (block_size == 0)
+                return;
+            out.push_back(block_size);
+            out.insert(out.end(), block, block + block_size);
+            block_size = 0;
+        }
+
+        void write(int code, int size) {
+            bits |= uint32_t(code) << count;
+            count += size;
+            while (count >= 8)
+                flushByte();
+        }
+
+        void finish() {
+            if (count > 0)
+                flushByte();
+            flushBlock();
+            out.push_back(0);
+        }
+    };
+
+    /// Хеш-таблица словаря LZW: ключ — (префикс, следующий индекс)
+    struct Dictionary {
+        static constexpr int SIZE = 8192;
+        int32_t keys[SIZE];
+        int16_t codes[SIZE];
+
+        void clear() {
+            std::fill(keys, keys + SIZE, -1);
+        }
+
+        static int slot(int32_t key) {
+            return (uint32_t(key) * 2654435761u) >> 19;
+        }
+
+        int find(int32_t key) const {
+            for (int s = slot(key);; s = (s + 1) & (SIZE - 1)) {
+                if (keys[s] == key)
+                    return codes[s];
+                if (keys[s] < 0)
+                    return -1;
+            }
+        }
+
+        void insert(int32_t key, int code) {
+            int s = slot(key);
+            while (keys[s] >= 0)
+                s = (s + 1) & (SIZE - 1);
+            keys[s] = key;
+            codes[s] = code;
+        }
+    };
+
+    static void writeWord(vector<uint8_t> &buf, int v) {
+        buf.push_back(v & 0xFF);
+        buf.push_back((v >> 8) & 0xFF);
+    }
+
+    static void compress(const vector<uint8_t> &indices, int min_code_size, vector<uint8_t> &buf) {
+        buf.push_back(min_code_size);
+        BitWriter bits{buf};
+        auto dict = make_unique<Dictionary>();
+        dict->clear();
+
+        const int clear_code = 1 << min_code_size, end_code = clear_code + 1;
+        int code_size = min_code_size + 1, next_code = end_code + 1;
+        bits.write(clear_code, code_size);
+
+        int cur = indices[0];
+        for (size_t i = 1; i < indices.size(); ++i) {
+            int32_t key = (cur << 8) | indices[i];
+            int code = dict->find(key);
+            if (code >= 0) {
+                cur = code;
+                continue;
+            }
+            bits.write(cur, code_size);
+            dict->insert(key, next_code);
+            if (next_code >= (1 << code_size))
+                code_size++;
+            if (next_code == MAX_CODE) {
+                bits.write(clear_code, code_size);
+                dict->clear();
+                code_size = min_code_size + 1;
+                next_code = end_code;
+            }
+            next_code++;
+            cur = indices[i];
+        }
+        bits.write(cur, code_size);
+        // декодер добавит в словарь ещё один код, прочитав последний, и может увеличить длину кода
+        if (next_code == (1 << code_size) && code_size < 12)
+            code_size++;
+        bits.write(end_code, code_size);
+        bits.finish();
+    }
+
+public:
+    /// delay — пауза между кадрами в сотых долях секунды; при bottom_up первая строка холста
+    /// оказывается внизу картинки, как в saveImg
+    GifWriter(const string &filename, int _width, int _height, int _delay = 1, bool _bottom_up = true)
+            : out(filename, ios::binary), width(_width), height(_height), delay(_delay), bottom_up(_bottom_up) {
+        if (!out)
+            throw std::runtime_error("GifWriter::Constructor can't open " + filename);
+        if (width <= 0 || height <= 0 || width > 0xFFFF || height > 0xFFFF)
+            throw std::runtime_error("GifWriter::Constructor wrong size");
+
+        vector<uint8_t> header = {'G', 'I', 'F', '8', '9', 'a'};
+        writeWord(header, width);
+        writeWord(header, height);
+        header.insert(header.end(), {0, 0, 0});
+        // бесконечный повтор
+        header.insert(header.end(), {0x21, 0xFF, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 3, 1});
+        writeWord(header, 0);
+        header.push_back(0);
+        out.write((const char *) header.data(), header.size());
+    }
+
+    GifWriter(const GifWriter &) = delete;
+
+    GifWriter &operator=(const GifWriter &) = delete;
+
+    ~GifWriter() {
+        if (out.is_open()) {
+            out.put(0x3B);
+            out.close();
+        }
+    }
+
+    /// Сжимает кадр в самостоятельный блок GIF. Не зависит от состояния файла, поэтому
+    /// кадры можно кодировать параллельно и записывать по готовности через writeEncoded
+    [[nodiscard]] vector<uint8_t> encode(const Canvas &canvas) const {
+        return encode(canvas, {0, 0, width, height});
+    }
+
+    /// Кадр только из прямоугольника rect холста: остальная картинка остаётся от предыдущих кадров.
+    /// Пустой rect даёт кадр из одного неизменного пиксела, чтобы сохранить паузу.
+    [[nodiscard]] vector<uint8_t> encode(const Canvas &canvas, PixelRect rect) const {
+        if (canvas.getWidth() != width || canvas.getHeight() != height)
+            throw std::runtime_error("GifWriter::encode frame size differs from animation size");
+        PAINTING_SCOPE("GifWriter::encode");
+        const bool partial = rect != canvas.bounds();
+        rect = rect.intersect(canvas.bounds());
+        if (rect.empty())
+            rect = {0, 0, 1, 1};
+        const int w = rect.x1 - rect.x0, h = rect.y1 - rect.y0;
+        // строка y кадра, считая сверху файла
+        auto sourceRow = [&](int y) {
+            return canvas.row(bottom_up ? rect.y1 - 1 - y : rect.y0 + y) + rect.x0;
+        };
+
+        vector<uint8_t> indices(size_t(w) * h);
+        vector<Canvas::Pixel> palette;
+        unordered_map<Canvas::Pixel, uint8_t> lookup;
+        bool quantize = false;
+        Canvas::Pixel last = sourceRow(0)[0] + 1;
+        uint8_t last_index = 0;
+        for (int y = 0; y < h && !quantize; ++y) {
+            const Canvas::Pixel *row = sourceRow(y);
+            uint8_t *dst = indices.data() + size_t(y) * w;
+            for (int x = 0; x < w; ++x) {
+                if (row[x] == last) {
+                    dst[x] = last_index;
+                    continue;
+                }
+                PAINTING_COUNT(MAP_LOOKUPS, 1);
+                auto it = lookup.find(row[x]);
+                if (it == lookup.end()) {
+                    if (palette.size() == 256) {
+                        quantize = true;
+                        break;
+                    }
+                    it = lookup.emplace(row[x], palette.size()).first;
+                    palette.push_back(row[x]);
+                }
+                dst[x] = it->second;
+                last = row[x];
+                last_index = it->second;
+            }
+        }
+        if (quantize) {
+            // 6 x 7 x 6 уровней
+            palette.clear();
+            for (int r = 0; r < 6; ++r) {
+                for (int g = 0; g < 7; ++g) {
+                    for (int b = 0; b < 6; ++b)
+                        palette.push_back(Canvas::packRGB(r * 255 / 5, g * 255 / 6, b * 255 / 5));
+                }
+            }
+            for (int y = 0; y < h; ++y) {
+                const Canvas::Pixel *row = sourceRow(y);
+                uint8_t *dst = indices.data() + size_t(y) * w;
+                for (int x = 0; x < w; ++x) {
+                    auto rgba = Canvas::unpack(row[x]);
+                    int r = (rgba[0] * 5 + 127) / 255, g = (rgba[1] * 6 + 127) / 255, b = (rgba[2] * 5 + 127) / 255;
+                    dst[x] = (r * 7 + g) * 6 + b;
+                }
+            }
+        }
+
+        int table_bits = 1;
+        while ((1 << table_bits) < int(palette.size()))
+            table_bits++;
+
+        vector<uint8_t> buf;
+        // управление показом: пауза; частичный кадр рисуется поверх предыдущего (не удалять кадр)
+        buf.insert(buf.end(), {0x21, 0xF9, 4, uint8_t(partial ? 1 << 2 : 0)});
+        writeWord(buf, delay);
+        buf.insert(buf.end(), {0, 0});
+        // описание кадра с локальной палитрой
+        buf.push_back(0x2C);
+        writeWord(buf, rect.x0);
+        writeWord(buf, bottom_up ? height - rect.y1 : rect.y0);
+        writeWord(buf, w);
+        writeWord(buf, h);
+        buf.push_back(0x80 | (table_bits - 1));
+        for (int i = 0; i < (1 << table_bits); ++i) {
+            auto rgba = Canvas::unpack(i < int(palette.size()) ? palette[i] : 0);
+            buf.insert(buf.end(), {rgba[0], rgba[1], rgba[2]});
+        }
+        compress(indices, max(2, table_bits), buf);
+        return buf;
+    }
+
+    void writeEncoded(const vector<uint8_t> &frame) {
+        PAINTING_SCOPE("GifWriter::writeEncoded");
+        out.write((const char *) frame.data(), frame.size());
+    }
+
+    void addFrame(const Canvas &canvas) {
+        writeEncoded(encode(canvas));
+    }
+
+    void addFrame(const Canvas &canvas, const PixelRect &rect) {
+        writeEncoded(encode(canvas, rect));
+    }
+
+    [[nodiscard]] int getWidth() const {
+        return width;
+    }
+
+    [[nodiscard]] int getHeight() const {
+        return height;
+    }
+
+    void close() {
+        out.put(0x3B);
+        out.close();
+        if (out.fail())
+            throw std::runtime_error("GifWriter::close write failed");
+    }
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "scanline.h"
+#include <cstdint>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/// Пакетная проверка принадлежности точек полигону. Диапазон y полигона разбит на полосы, и для каждой
+/// полосы хранятся (отдельными массивами координат) только пересекающие её рёбра. Точки раскладываются
+/// по полосам, и каждое ребро полосы проверяется сразу для нескольких точек (AVX2, если доступен).
+/// Правило то же, что у ScanlineFiller: ребро учитывается, если y_lo <= y < y_hi и пересекает
+/// горизонталь точки не правее неё, поэтому ответ совпадает с построчной заливкой пиксел в пиксел.
+class PolygonHitTester {
+private:
+    /// рёбра, упорядоченные по полосам; ребро, задевающее несколько полос, повторяется в каждой
+    vector<double> x_lo, y_lo, x_hi, y_hi, dir;
+    vector<int> band_offsets;
+    int y_min = 0, y_max = 0, band_height = 1;
+
+    static constexpr size_t BLOCK = 256;
+
+    void windingScalar(size_t e_from, size_t e_to, size_t from, size_t to, const int *xs, const int *ys,
+                       int *out) const {
+        for (size_t e = e_from; e < e_to; ++e) {
+            const double x0 = x_lo[e], y0 = y_lo[e], dx = x_hi[e] - x0, dy = y_hi[e] - y0, y1 = y_hi[e];
+            const int d = int(dir[e]);
+            for (size_t i = from; i < to; ++i) {
+                double px = xs[i], py = ys[i];
+                bool crosses = y0 <= py && py < y1 && (px - x0) * dy - (py - y0) * dx >= 0;
+                out[i] += crosses ? d : 0;
+            }
+        }
+    }
+
+#ifdef __AVX2__
+
+    size_t windingAvx(size_t e_from, size_t e_to, size_t count, const int *xs, const int *ys, int *out) const {
+        const __m256d zero = _mm256_setzero_pd();
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m256d px = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *) (xs + i)));
+            __m256d py = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *) (ys + i)));
+            __m256d w = zero;
+            for (size_t e = e_from; e < e_to; ++e) {
+                __m256d x0 = _mm256_set1_pd(x_lo[e]), y0 = _mm256_set1_pd(y_lo[e]);
+                __m256d dx = _mm256_set1_pd(x_hi[e] - x_lo[e]), dy = _mm256_set1_pd(y_hi[e] - y_lo[e]);
+                __m256d in_rows = _mm256_and_pd(_mm256_cmp_pd(y0, py, _CMP_LE_OQ),
+                                                _mm256_cmp_pd(py, _mm256_set1_pd(y_hi[e]), _CMP_LT_OQ));
+                __m256d side = _mm256_sub_pd(_mm256_mul_pd(_mm256_sub_pd(px, x0), dy),
+                                             _mm256_mul_pd(_mm256_sub_pd(py, y0), dx));
+                __m256d crosses = _mm256_and_pd(in_rows, _mm256_cmp_pd(side, zero, _CMP_GE_OQ));
+                w = _mm256_add_pd(w, _mm256_and_pd(crosses, _mm256_set1_pd(dir[e])));
+            }
+            _mm_storeu_si128((__m128i *) (out + i), _mm256_cvtpd_epi32(w));
+        }
+        return i;
+    }
+
+#endif
+
+    /// Число оборотов для точек одной полосы
+    void windingBand(int band, size_t count, const int *xs, const int *ys, int *out) const {
+        size_t e_from = band_offsets[band], e_to = band_offsets[band + 1];
+        PAINTING_COUNT(EDGE_TESTS, (e_to - e_from) * count);
+        size_t done = 0;
+#ifdef __AVX2__
+        done = windingAvx(e_from, e_to, count, xs, ys, out);
+#endif
+        for (size_t i = done; i < count; ++i)
+            out[i] = 0;
+        windingScalar(e_from, e_to, done, count, xs, ys, out);
+    }
+
+    [[nodiscard]] int bandOf(int y) const {
+        if (y < y_min || y >= y_max)
+            return -1;
+        return (y - y_min) / band_height;
+    }
+
+public:
+    explicit PolygonHitTester(const vector<Segment<int>> &segments) {
+        vector<const Segment<int> *> edges;
+        for (auto &segm: segments) {
+            if (segm.a.y != segm.b.y)
+                edges.push_back(&segm);
+        }
+        band_offsets = {0, 0};
+        if (edges.empty())
+            return;
+
+        y_min = INT_MAX;
+        y_max = INT_MIN;
+        for (auto *segm: edges) {
+            y_min = min({y_min, segm->a.y, segm->b.y});
+            y_max = max({y_max, segm->a.y, segm->b.y});
+        }
+        // примерно по ребру на полосу, но без лишнего дублирования длинных рёбер
+        long long height = (long long) y_max - y_min;
+        int bands = int(min<long long>(edges.size(), height));
+        auto entries = [&](int count) {
+            long long h = (height + count - 1) / count, total = 0;
+            for (auto *segm: edges)
+                total += (max(segm->a.y, segm->b.y) - 1 - y_min) / h - (min(segm->a.y, segm->b.y) - y_min) / h + 1;
+            return total;
+        };
+        while (bands > 1 && entries(bands) > 8 * (long long) edges.size())
+            bands /= 2;
+        band_height = int((height + bands - 1) / bands);
+
+        vector<vector<const Segment<int> *>> by_band(bands);
+        for (auto *segm: edges) {
+            int lo = min(segm->a.y, segm->b.y), hi = max(segm->a.y, segm->b.y);
+            for (int b = (lo - y_min) / band_height; b <= (hi - 1 - y_min) / band_height; ++b)
+                by_band[b].push_back(segm);
+        }
+        band_offsets.assign(bands + 1, 0);
+        for (int b = 0; b < bands; ++b) {
+            for (auto *segm: by_band[b]) {
+                bool up = segm->a.y < segm->b.y;
+                const Vertex<int> &lo = up ? segm->a : segm->b;
+                const Vertex<int> &hi = up ? segm->b : segm->a;
+                x_lo.push_back(lo.x);
+                y_lo.push_back(lo.y);
+                x_hi.push_back(hi.x);
+                y_hi.push_back(hi.y);
+                dir.push_back(up ? 1 : -1);
+            }
+            band_offsets[b + 1] = x_lo.size();
+        }
+    }
+
+    /// Число оборотов контура вокруг каждой из count точек (xs[i], ys[i])
+    void winding(size_t count, const int *xs, const int *ys, int *out) const {
+        int bands = band_offsets.size() - 1;
+        // раскладываем точки по полосам сортировкой подсчётом
+        vector<int> start(bands + 1, 0);
+        for (size_t i = 0; i < count; ++i) {
+            int b = bandOf(ys[i]);
+            if (b < 0)
+                out[i] = 0;
+            else
+                start[b + 1]++;
+        }
+        for (int b = 0; b < bands; ++b)
+            start[b + 1] += start[b];
+        vector<int> order(start[bands]);
+        vector<int> pos(start.begin(), start.end() - 1);
+        for (size_t i = 0; i < count; ++i) {
+            int b = bandOf(ys[i]);
+            if (b >= 0)
+                order[pos[b]++] = i;
+        }
+
+        int bx[BLOCK], by[BLOCK], w[BLOCK];
+        for (int b = 0; b < bands; ++b) {
+            for (int from = start[b]; from < start[b + 1]; from += BLOCK) {
+                int n = min<int>(BLOCK, start[b + 1] - from);
+                for (int i = 0; i < n; ++i) {
+                    bx[i] = xs[order[from + i]];
+                    by[i] = ys[order[from + i]];
+                }
+                windingBand(b, n, bx, by, w);
+                for (int i = 0; i < n; ++i)
+                    out[order[from + i]] = w[i];
+            }
+        }
+    }
+
+    /// Принадлежность точек полигону по правилу rule: 1 — внутри, 0 — снаружи
+    void contains(size_t count, const int *xs, const int *ys, uint8_t *out, FillRule rule) const {
+        vector<int> w(count);
+        winding(count, xs, ys, w.data());
+        for (size_t i = 0; i < count; ++i)
+            out[i] = rule == EVEN_ODD ? (w[i] & 1) : (w[i] != 0);
+    }
+
+    [[nodiscard]] int winding(const Vertex<int> &v) const {
+        int b = bandOf(v.y), w = 0;
+        if (b >= 0)
+            windingScalar(band_offsets[b], band_offsets[b + 1], 0, 1, &v.x, &v.y, &w);
+        return w;
+    }
+
+    [[nodiscard]] bool contains(const Vertex<int> &v, FillRule rule) const {
+        int w = winding(v);
+        return rule == EVEN_ODD ? (w & 1) : w != 0;
+    }
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+#include "canvas.h"
+#include "gif_writer.h"
+#include <ostream>
+#include <fstream>
+#include <string>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+/// Запись холста без ImageMagick. Строки берутся прямо из буфера холста; при bottom_up = true
+/// первой в файл идёт последняя строка холста, то есть переворот делается при выводе, а не отдельным проходом.
+
+/// PPM (P6): RGB по байту на канал
+inline void writePPM(const Canvas &canvas, ostream &out, bool bottom_up = true) {
+    PAINTING_SCOPE("writePPM");
+    const int width = canvas.getWidth(), height = canvas.getHeight();
+    out << "P6\n" << width << ' ' << height << "\n255\n";
+    vector<uint8_t> line(size_t(width) * 3);
+    for (int y = 0; y < height; ++y) {
+        const Canvas::Pixel *row = canvas.row(bottom_up ? height - 1 - y : y);
+        for (int x = 0; x < width; ++x) {
+            auto rgba = Canvas::unpack(row[x]);
+            line[3 * x] = rgba[0];
+            line[3 * x + 1] = rgba[1];
+            line[3 * x + 2] = rgba[2];
+        }
+        out.write((const char *) line.data(), line.size());
+    }
+}
+
+/// PAM (P7, RGB_ALPHA): формат пикселов совпадает с холстом, строки пишутся как есть
+inline void writePAM(const Canvas &canvas, ostream &out, bool bottom_up = true) {
+    PAINTING_SCOPE("writePAM");
+    const int width = canvas.getWidth(), height = canvas.getHeight();
+    out << "P7\nWIDTH " << width << "\nHEIGHT " << height << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+    for (int y = 0; y < height; ++y)
+        out.write((const char *) canvas.row(bottom_up ? height - 1 - y : y), sizeof(Canvas::Pixel) * width);
+}
+
+/// QOI (https://qoiformat.org): сжатие без потерь за один проход. Для картинок из заливок и линий
+/// почти все пикселы уходят в серии, поэтому файл мал, а кодирование быстрее PNG в разы.
+inline vector<uint8_t> encodeQOI(const Canvas &canvas, bool bottom_up = true) {
+    PAINTING_SCOPE("encodeQOI");
+    const int width = canvas.getWidth(), height = canvas.getHeight();
+    vector<uint8_t> buf;
+    buf.reserve(22 + size_t(width) * height / 4);
+    buf.insert(buf.end(), {'q', 'o', 'i', 'f'});
+    for (uint32_t v: {uint32_t(width), uint32_t(height)})
+        buf.insert(buf.end(), {uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v)});
+    buf.push_back(3); // каналы: холст непрозрачный
+    buf.push_back(0); // sRGB
+
+    array<Canvas::Pixel, 64> index{};
+    Canvas::Pixel prev = Canvas::packRGB(0, 0, 0);
+    int run = 0;
+    for (int y = 0; y < height; ++y) {
+        const Canvas::Pixel *row = canvas.row(bottom_up ? height - 1 - y : y);
+        for (int x = 0; x < width; ++x) {
+            const Canvas::Pixel p = row[x];
+            if (p == prev) {
+                if (++run == 62) {
+                    buf.push_back(0xC0 | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                buf.push_back(0xC0 | (run - 1));
+                run = 0;
+            }
+            auto c = Canvas::unpack(p);
+            int hash = (c[0] * 3 + c[1] * 5 + c[2] * 7 + c[3] * 11) % 64;
+            if (index[hash] == p) {
+                buf.push_back(hash);
+            } else {
+                index[hash] = p;
+                auto q = Canvas::unpack(prev);
+                int8_t dr = int8_t(c[0] - q[0]), dg = int8_t(c[1] - q[1]), db = int8_t(c[2] - q[2]);
+                int8_t dr_dg = int8_t(dr - dg), db_dg = int8_t(db - dg);
+                if (c[3] != q[3]) {
+                    buf.insert(buf.end(), {0xFF, c[0], c[1], c[2], c[3]});
+                } else if (-2 <= dr && dr <= 1 && -2 <= dg && dg <= 1 && -2 <= db && db <= 1) {
+                    buf.push_back(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                } else if (-32 <= dg && dg <= 31 && -8 <= dr_dg && dr_dg <= 7 && -8 <= db_dg && db_dg <= 7) {
+                    buf.push_back(0x80 | (dg + 32));
+                    buf.push_back((dr_dg + 8) << 4 | (db_dg + 8));
+                } else {
+                    buf.insert(buf.end(), {0xFE, c[0], c[1], c[2]});
+                }
+            }
+            prev = p;
+        }
+    }
+    if (run > 0)
+        buf.push_back(0xC0 | (run - 1));
+    buf.insert(buf.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+    return buf;
+}
+
+inline void writeQOI(const Canvas &canvas, ostream &out, bool bottom_up = true) {
+    auto buf = encodeQOI(canvas, bottom_up);
+    out.write((const char *) buf.data(), buf.size());
+}
+
+/// Запись по расширению: .ppm, .pam, .qoi и .gif кодируются здесь, остальные форматы — через Magick
+inline void writeImage(const Canvas &canvas, const string &filename, bool bottom_up = true) {
+    auto native = [&](void (*write)(const Canvas &, ostream &, bool)) {
+        ofstream out(filename, ios::binary);
+        if (!out)
+            throw std::runtime_error("writeImage cannot open " + filename);
+        write(canvas, out, bottom_up);
+        out.close();
+        if (out.fail())
+            throw std::runtime_error("writeImage write failed: " + filename);
+    };
+    if (filename.ends_with(".ppm")) {
+        native(writePPM);
+    } else if (filename.ends_with(".pam")) {
+        native(writePAM);
+    } else if (filename.ends_with(".qoi")) {
+        native(writeQOI);
+    } else if (filename.ends_with(".gif")) {
+        GifWriter writer(filename, canvas.getWidth(), canvas.getHeight(), 1, bottom_up);
+        writer.addFrame(canvas);
+        writer.close();
+    } else {
+        PAINTING_SCOPE("writeImage::Magick");
+        Magick::Image img = canvas.toImage();
+        if (bottom_up)
+            img.flip();
+        img.write(filename);
+    }
+}
+
+/// Запись картинок в отдельном потоке: write копирует холст в переиспользуемый буфер и сразу
+/// возвращается, так что следующая картинка рисуется, пока кодируется предыдущая.
+/// Если в очереди уже max_queued картинок, write ждёт.
+class AsyncImageWriter {
+private:
+    struct Job {
+        unique_ptr<Canvas> canvas;
+        string filename;
+    };
+
+    size_t max_queued;
+    bool bottom_up;
+    mutex m;
+    condition_variable changed;
+    deque<Job> jobs;
+    vector<unique_ptr<Canvas>> spare;
+    bool busy = false;
+    bool stopping = false;
+    exception_ptr error;
+    thread worker;
+
+    void workerLoop() {
+        unique_lock lock(m);
+        while (true) {
+            changed.wait(lock, [&] { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            Job job = std::move(jobs.front());
+            jobs.pop_front();
+            busy = true;
+            lock.unlock();
+
+            exception_ptr failure;
+            try {
+                writeImage(*job.canvas, job.filename, bottom_up);
+            } catch (...) {
+                failure = current_exception();
+            }
+
+            lock.lock();
+            if (failure && !error)
+                error = failure;
+            spare.push_back(std::move(job.canvas));
+            busy = false;
+            changed.notify_all();
+        }
+    }
+
+    /// Вызывается под m: ошибка записи сообщается один раз
+    void rethrowError() {
+        if (error) {
+            exception_ptr e = error;
+            error = nullptr;
+            rethrow_exception(e);
+        }
+    }
+
+public:
+    explicit AsyncImageWriter(size_t _max_queued = 2, bool _bottom_up = true)
+            : max_queued(max<size_t>(_max_queued, 1)), bottom_up(_bottom_up) {
+        worker = thread([this] { workerLoop(); });
+    }
+
+    AsyncImageWriter(const AsyncImageWriter &) = delete;
+    AsyncImageWriter &operator=(const AsyncImageWriter &) = delete;
+
+    /// Дописывает очередь; ошибки записи при этом теряются, поэтому перед выходом лучше вызвать flush
+    ~AsyncImageWriter() {
+        {
+            lock_guard lock(m);
+            stopping = true;
+        }
+        changed.notify_all();
+        worker.join();
+    }
+
+    /// Ставит картинку в очередь. Если предыдущая запись завершилась ошибкой, она выбрасывается здесь.
+    void write(const Canvas &canvas, const string &filename) {
+        unique_ptr<Canvas> copy;
+        {
+            unique_lock lock(m);
+            changed.wait(lock, [&] { return jobs.size() < max_queued; });
+            rethrowError();
+            if (!spare.empty()) {
+                copy = std::move(spare.back());
+                spare.pop_back();
+            }
+        }
+        if (copy)
+            *copy = canvas;
+        else
+            copy = make_unique<Canvas>(canvas);
+        {
+            lock_guard lock(m);
+            jobs.push_back({std::move(copy), filename});
+        }
+        changed.notify_all();
+    }
+
+    /// Дожидается записи всей очереди
+    void flush() {
+        unique_lock lock(m);
+        changed.wait(lock, [&] { return jobs.empty() && !busy; });
+        rethrowError();
+    }
+};
@@ -0,0 +1,237 @@
+#pragma once
+
+/// Счётчики и временная шкала горячих мест. Включаются макросом PAINTING_INSTRUMENTATION
+/// (опция CMake с тем же именем); без него все макросы ниже раскрываются в пустые операторы,
+/// и в коде не остаётся ни вызовов, ни переменных.
+///
+/// PAINTING_COUNT(counter, n)  — прибавить n к счётчику (PIXELS_WRITTEN, EDGE_TESTS, INTERSECTIONS_FOUND,
+///                               MAP_LOOKUPS; ALLOCATIONS считается сам заменой operator new)
+/// PAINTING_SCOPE(name)        — замер времени до конца блока; name — строковый литерал
+/// PAINTING_WRITE_TRACE(file)  — записать шкалу в формате Chrome trace events (chrome://tracing, Perfetto)
+
+#ifdef PAINTING_INSTRUMENTATION
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum InstrumentationCounter {
+    PIXELS_WRITTEN,
+    EDGE_TESTS,
+    INTERSECTIONS_FOUND,
+    MAP_LOOKUPS,
+    ALLOCATIONS,
+    COUNTER_COUNT,
+};
+
+/// Сбор событий. Счётчики копятся в переменных потока без синхронизации и сливаются в общие
+/// при выходе из внешнего замера потока, поэтому подсчёт пикселов почти не замедляет рисование.
+class Instrumentation {
+public:
+    struct Event {
+        const char *name;
+        int thread;
+        double start_us, duration_us;
+        int depth;
+    };
+
+    /// Событий больше этого не записывается, чтобы длинный прогон не съел память
+    static constexpr size_t MAX_EVENTS = size_t(1) << 20;
+
+private:
+    inline static atomic<uint64_t> totals[COUNTER_COUNT];
+    inline static atomic<int> next_thread{0};
+    inline static mutex events_mutex;
+    inline static vector<Event> events;
+    inline static vector<pair<double, array<uint64_t, COUNTER_COUNT>>> samples;
+    inline static size_t dropped = 0;
+    inline static const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+
+    /// Тривиальные thread_local: их можно трогать из operator new, ничего не выделяя
+    inline static thread_local uint64_t local[COUNTER_COUNT];
+    inline static thread_local int depth = 0;
+
+    static const char *counterName(int c) {
+        static const char *names[COUNTER_COUNT] = {"pixels written", "edge tests", "intersections found",
+                                                   "map lookups", "allocations"};
+        return names[c];
+    }
+
+public:
+    static void add(InstrumentationCounter c, uint64_t n) {
+        local[c] += n;
+    }
+
+    static double now() {
+        return chrono::duration<double, micro>(chrono::steady_clock::now() - epoch).count();
+    }
+
+    static int threadId() {
+        thread_local int id = next_thread++;
+        return id;
+    }
+
+    /// Переносит счётчики текущего потока в общие
+    static void flush() {
+        for (int c = 0; c < COUNTER_COUNT; ++c) {
+            if (local[c] != 0) {
+                totals[c].fetch_add(local[c], memory_order_relaxed);
+                local[c] = 0;
+            }
+        }
+    }
+
+    [[nodiscard]] static uint64_t total(InstrumentationCounter c) {
+        flush();
+        return totals[c].load(memory_order_relaxed);
+    }
+
+    static void enter() {
+        depth++;
+    }
+
+    static void leave(const char *name, double start_us) {
+        double end_us = now();
+        int d = --depth;
+        if (d == 0)
+            flush();
+        lock_guard lock(events_mutex);
+        if (events.size() >= MAX_EVENTS) {
+            dropped++;
+            return;
+        }
+        events.push_back({name, threadId(), start_us, end_us - start_us, d});
+        // значения счётчиков на шкале — после каждого внешнего замера
+        if (d == 0) {
+            array<uint64_t, COUNTER_COUNT> values;
+            for (int c = 0; c < COUNTER_COUNT; ++c)
+                values[c] = totals[c].load(memory_order_relaxed);
+            samples.emplace_back(end_us, values);
+        }
+    }
+
+    /// Сбрасывает накопленные события и счётчики
+    static void reset() {
+        flush();
+        lock_guard lock(events_mutex);
+        events.clear();
+        samples.clear();
+        dropped = 0;
+        for (auto &t: totals)
+            t.store(0, memory_order_relaxed);
+    }
+
+    /// {"traceEvents": [...]}: замеры — полные события "X", счётчики — события "C"
+    static void writeChromeTrace(ostream &out) {
+        flush();
+        lock_guard lock(events_mutex);
+        out << "{\"traceEvents\": [\n";
+        bool first = true;
+        auto separator = [&] {
+            out << (first ? "" : ",\n");
+            first = false;
+        };
+        for (auto &e: events) {
+            separator();
+            out << "  {\"name\": \"" << e.name << "\", \"cat\": \"painting\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+                << e.thread << ", \"ts\": " << e.start_us << ", \"dur\": " << e.duration_us << '}';
+        }
+        double end_us = now();
+        samples.emplace_back(end_us, array<uint64_t, COUNTER_COUNT>{});
+        for (int c = 0; c < COUNTER_COUNT; ++c)
+            samples.back().second[c] = totals[c].load(memory_order_relaxed);
+        for (auto &[ts, values]: samples) {
+            for (int c = 0; c < COUNTER_COUNT; ++c) {
+                separator();
+                out << "  {\"name\": \"" << counterName(c) << "\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << ts
+                    << ", \"args\": {\"value\": " << values[c] << "}}";
+            }
+        }
+        samples.pop_back();
+        out << "\n], \"otherData\": {\"dropped_events\": " << dropped << "}}\n";
+    }
+
+    static void writeChromeTrace(const string &filename) {
+        ofstream out(filename);
+        if (!out)
+            throw std::runtime_error("Instrumentation::writeChromeTrace cannot open " + filename);
+        writeChromeTrace(out);
+    }
+};
+
+/// Замер от создания до конца блока
+class InstrumentationScope {
+private:
+    const char *name;
+    double start_us;
+
+public:
+    explicit InstrumentationScope(const char *_name) : name(_name), start_us(Instrumentation::now()) {
+        Instrumentation::enter();
+    }
+
+    InstrumentationScope(const InstrumentationScope &) = delete;
+    InstrumentationScope &operator=(const InstrumentationScope &) = delete;
+
+    ~InstrumentationScope() {
+        Instrumentation::leave(name, start_us);
+    }
+};
+
+/// Подсчёт выделений памяти. Как и всё в этом репозитории, заголовок подключается в одну единицу
+/// трансляции на программу, поэтому замена глобальных operator new/delete определена здесь же.
+inline void *countedAllocation(size_t size) {
+    Instrumentation::add(ALLOCATIONS, 1);
+    if (void *p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new(size_t size) {
+    return countedAllocation(size);
+}
+
+void *operator new[](size_t size) {
+    return countedAllocation(size);
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    std::free(p);
+}
+
+#define PAINTING_CONCAT_IMPL(a, b) a##b
+#define PAINTING_CONCAT(a, b) PAINTING_CONCAT_IMPL(a, b)
+#define PAINTING_COUNT(counter, n) Instrumentation::add(counter, uint64_t(n))
+#define PAINTING_SCOPE(name) InstrumentationScope PAINTING_CONCAT(painting_scope_, __LINE__)(name)
+#define PAINTING_WRITE_TRACE(filename) Instrumentation::writeChromeTrace(filename)
+
+#else
+
+#define PAINTING_COUNT(counter, n) ((void) 0)
+#define PAINTING_SCOPE(name) ((void) 0)
+#define PAINTING_WRITE_TRACE(filename) ((void) 0)
+
+#endif
@@ -8,6 +8,16 @@
 #include <Magick++.h>
 #include "tests.h"
 #include "kuboid.h"
+#include "clipping.h"
+#include "tile_renderer.h"
+#include "animation.h"
+#include "zbuffer.h"
+#include "scene.h"
+#include "image_writer.h"
+#include "arc.h"
+#include "stroke.h"
+#include "boolean_ops.h"
+#include <fstream>
 
 const int DEPTH = (2 << MAGICKCORE_QUANTUM_DEPTH) - 1;
 
@@ -24,6 +34,7 @@ const Color Orange(DEPTH, 0.3 * DEPTH, 0);
 
 
 void saveImg(Magick::Image &img, const string &filename) {
+    PAINTING_SCOPE("saveImg");
     img.flip();
     img.magick("png");
     if (filename.ends_with(".png"))
@@ -32,6 +43,16 @@ void saveImg(Magick::Image &img, const string &filename) {
         img.write("../images/" + filename + ".png");
 }
 
+/// Холсты записываются в фоновом потоке, пока рисуется следующая картинка
+AsyncImageWriter &imageWriter() {
+    static AsyncImageWriter writer;
+    return writer;
+}
+
+void saveImg(const Canvas &canvas, const string &filename) {
+    imageWriter().write(canvas, "../images/" + (filename.find('.') == string::npos ? filename + ".png" : filename));
+}
+
 Polyhedron create_star() {
     vector<Vertex<int>> points = {{150, 200},
                                   {460, 350},
@@ -53,7 +74,7 @@ Polyhedron create_convex() {
 }
 
 void draw1() {
-    Magick::Image img("500x500", "white");
+    Canvas img(500, 500, White);
     Polyhedron pol1 = create_star();
     pol1.move({-100, -200});
     pol1.scale(0.6);
@@ -72,7 +93,7 @@ void draw1() {
 }
 
 void drawBezie() {
-    Magick::Image img("500x500", "white");
+    Canvas img(500, 500, White);
     drawBezierCurve({
                             {200, 400},
                             {500, 200},
@@ -82,43 +103,62 @@ void drawBezie() {
 }
 
 void drawClip() {
-    Magick::Image img("2560x1440", "white");
+    Canvas img(2560, 1440, White);
     Polyhedron pol = create_convex();
     pol.move({1000, 500});
     pol.scale(3);
+    // окно выходит за холст: заливка отсекает его по краям холста
+    pol.fill(img, Yellow, EVEN_ODD);
     pol.drawBounds(img, Blue);
 
-    Segment<int> line1({100, 200}, {2400, 1400});
-    auto ans1 = cyrusBeckClipLine(line1, pol);
-    line1.draw(img, Orange);
-    ans1.draw(img, Red);
-
-    Segment<int> line2({100, 1300}, {2300, 300});
-    auto ans2 = cyrusBeckClipLine(line2, pol);
-    line2.draw(img, Orange);
-    ans2.draw(img, Red);
-
-    Segment<int> line3({1000, 400}, {1200, 600});
-    auto ans3 = cyrusBeckClipLine(line3, pol);
-    line3.draw(img, Orange);
-    ans3.draw(img, Red);
+    vector<Segment<int>> lines = {{{100,  200},  {2400, 1400}},
+                                  {{100,  1300}, {2300, 300}},
+                                  {{1000, 400},  {1200, 600}},
+                                  {{2000, 700},  {1300, 900}},
+                                  {{300,  700},  {800,  900}}};
+    vector<Segment<int>> clipped(lines.size());
+    ConvexClipper(pol).clip(lines, clipped);
+    for (size_t i = 0; i < lines.size(); ++i) {
+        lines[i].draw(img, Orange);
+        clipped[i].draw(img, Red);
+    }
 
-    Segment<int> line4({2000, 700}, {1300, 900});
-    auto ans4 = cyrusBeckClipLine(line4, pol);
-    line4.draw(img, Orange);
-    ans4.draw(img, Red);
+    saveImg(img, "clip_line.png");
+}
 
-    Segment<int> line5({300, 700}, {800, 900});
-    auto ans5 = cyrusBeckClipLine(line5, pol);
-    line5.draw(img, Orange);
-    ans5.draw(img, Red);
+void drawTiled() {
+    Canvas img(2560, 1440, White);
+    TileRenderer renderer;
+    Polyhedron star = create_star();
+    star.scale(3);
+    renderer.addFill(star, NON_ZERO, Yellow);
+    renderer.addBounds(star, Black);
+    Polyhedron convex = create_convex();
+    convex.move({1500, 300});
+    convex.scale(2);
+    renderer.addFill(convex, EVEN_ODD, Green);
+    renderer.addBezier({{100, 1300}, {900, 100}, {1700, 1400}, {2500, 200}}, Red);
+
+    ThreadPool pool;
+    renderer.render(img, pool);
+    saveImg(img, "tiled.png");
+}
 
-    saveImg(img, "clip_line.png");
+void drawAntialiased() {
+    Canvas img(500, 500, White);
+    Polyhedron star = create_star();
+    star.fillAntialiased(img, Blue, NON_ZERO);
+    star.move({20, -150});
+    star.fillAntialiased(img, Orange, EVEN_ODD);
+    saveImg(img, "antialiased.png");
 }
 
 void drawCircle() {
-    Magick::Image img("500x500", "white");
+    Canvas img(500, 500, White);
     drawCircleWithBezie({250, 250}, 100, 0, 6 * M_PI / 5, img, Black, Red);
+    // та же дуга без кривых Безье, снаружи — сектор
+    drawArc({250, 250}, 110, 0, 6 * M_PI / 5, img, Blue);
+    fillSector({250, 250}, 60, 6 * M_PI / 5, 2 * M_PI, img, Blue);
     saveImg(img, "circle.png");
 }
 
@@ -234,6 +274,66 @@ void testKuboid() {
     saveImg(img, "projection.png");
 }
 
+void drawSolidKuboids() {
+    Canvas img(700, 700, White);
+    DepthRenderer renderer(700, 700, 1.3e-3);
+    vector<Color> colors = {Blue, Red, Green, Orange};
+    for (int i = 0; i < 4; ++i) {
+        int a = 150 + 30 * i;
+        vector<vector<Vertex<int>>> faces;
+        vector<Vertex<int>> low = {{100 + 110 * i, 150 + 60 * i, 100 + 40 * i},
+                                   {100 + 110 * i + a, 150 + 60 * i, 100 + 40 * i},
+                                   {100 + 110 * i + a, 150 + 60 * i + a, 100 + 40 * i},
+                                   {100 + 110 * i, 150 + 60 * i + a, 100 + 40 * i}};
+        vector<Vertex<int>> high = low;
+        for (auto &v: high)
+            v.z += a;
+        faces.push_back({low[0], low[1], low[2], low[3]});
+        faces.push_back({high[0], high[1], high[2], high[3]});
+        for (int k = 0; k < 4; k++)
+            faces.push_back({low[k], low[(k + 1) % 4], high[(k + 1) % 4], high[k]});
+        Mesh cube(faces);
+        cube.rotate(0.3 * i, 0.5, 0.2, cube.getCenter());
+        renderer.drawMesh(cube, img, colors[i]);
+    }
+    saveImg(img, "solid_kuboids.png");
+}
+
+void drawStrokes() {
+    Canvas img(600, 300, White);
+    vector<Vertex<int>> zigzag = {{40, 60}, {140, 240}, {240, 60}, {340, 240}};
+    vector<pair<LineJoin, LineCap>> styles = {{JOIN_MITER, CAP_BUTT}, {JOIN_ROUND, CAP_ROUND}, {JOIN_BEVEL, CAP_SQUARE}};
+    vector<Color> colors = {Blue, Red, Green};
+    for (int i = 0; i < 3; ++i) {
+        for (auto &p: zigzag)
+            p.x += 60 * (i > 0);
+        strokePolyline(zigzag, {24.0 - 8 * i, styles[i].first, styles[i].second}, img, colors[i]);
+    }
+    // тонкая линия поверх толстой — для сравнения
+    drawPolyline(zigzag, img, Black);
+    saveImg(img, "strokes.png");
+}
+
+void drawBoolean() {
+    Canvas img(800, 200, White);
+    vector<Polyhedron> square = {Polyhedron(vector<Vertex<int>>{{20, 40}, {140, 40}, {140, 160}, {20, 160}})};
+    vector<Polyhedron> diamond = {Polyhedron(vector<Vertex<int>>{{100, 20}, {180, 100}, {100, 180}, {20, 100}})};
+    vector<BooleanOperation> ops = {BOOLEAN_UNION, BOOLEAN_INTERSECTION, BOOLEAN_DIFFERENCE, BOOLEAN_XOR};
+    for (int i = 0; i < 4; ++i) {
+        auto contours = booleanContours(square, diamond, ops[i]);
+        for (auto &contour: contours) {
+            for (auto &p: contour)
+                p.x += 200 * i;
+        }
+        fillContours(contours, img, Blue);
+        for (auto &contour: contours) {
+            contour.push_back(contour.front());
+            drawPolyline(contour, img, Black);
+        }
+    }
+    saveImg(img, "boolean.png");
+}
+
 void plotAnimation() {
     int a = 300;
     int min_x = 200, min_y = 200, min_z = 100, max_z = 200;
@@ -258,29 +358,26 @@ void plotAnimation() {
     }
 
     Kuboid kuboid(faces);
-    kuboid.rotate(1.5 * M_PI_4, 0, 0, kuboid.getCenter());
+    auto center = convertToDoubleVertex(kuboid.getCenter());
+    Transform tilt = Transform::rotation(1.5 * M_PI_4, 0, 0, center);
 
     int N = 50;
-    vector<Magick::Image> frames1(N, Magick::Image("700x700", "white"));
-    vector<Magick::Image> frames2(N, Magick::Image("700x700", "white"));
-    auto center = kuboid.getCenter();
-    for (int i = 0; i < N; i++) {
-        kuboid.rotate(0, 2 * M_PI / N, 0, center);
-        kuboid.onePointProjection(1.3e-3, frames1[i], Blue);
-        kuboid.show(frames2[i], Blue);
-    }
-
-    for (auto &frame: frames1) {
-        frame.flip();
-        frame.animationDelay(1);
-    }
-    for (auto &frame: frames2) {
-        frame.flip();
-        frame.animationDelay(1);
-    }
+    // каждый кадр строится из исходного куба одним преобразованием, поэтому кадры независимы
+    auto frame = [&](int i) {
+        return kuboid.transformed(Transform::rotation(0, 2 * M_PI * (i + 1) / N, 0, center) * tilt);
+    };
 
-    Magick::writeImages(frames1.begin(), frames1.end(), "../images/anim.gif");
-    Magick::writeImages(frames2.begin(), frames2.end(), "../images/anim2.gif");
+    // куб занимает малую часть кадра, поэтому перерисовывается и записывается только область вокруг него
+    RetainedScene projection(700, 700), visible(700, 700);
+    int projected = projection.addLines({}, Blue), shown = visible.addLines({}, Blue);
+    GifWriter anim1("../images/anim.gif", 700, 700);
+    renderRetainedAnimation(N, [&](int i, RetainedScene &scene) {
+        scene.updateLines(projected, frame(i).projectedEdges(1.3e-3), Blue);
+    }, projection, anim1);
+    GifWriter anim2("../images/anim2.gif", 700, 700);
+    renderRetainedAnimation(N, [&](int i, RetainedScene &scene) {
+        scene.updateLines(shown, frame(i).visibleEdges(), Blue);
+    }, visible, anim2);
 }
 
 void testWeilerAtherton1() {
@@ -332,11 +429,55 @@ void testWeilerAtherton3() {
     saveImg(img, "WeilerAtherton3.png");
 }
 
-int main() {
+/// painting [--output DIR] SCENE... — отрисовка описаний сцен (см. scene.h), "-" — стандартный ввод.
+/// Все сцены выполняются в одном процессе с общим пулом потоков.
+int renderScenes(int argc, char **argv) {
+    string output_dir;
+    vector<string> scenes;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--output") {
+            if (i + 1 >= argc) {
+                cerr << "painting: missing value for " << arg << '\n';
+                return 1;
+            }
+            output_dir = argv[++i];
+        } else {
+            scenes.push_back(arg);
+        }
+    }
+
+    ThreadPool pool;
+    SceneRenderer renderer(pool, output_dir);
+    for (auto &scene: scenes) {
+        try {
+            if (scene == "-") {
+                renderer.run(cin);
+                continue;
+            }
+            ifstream in(scene);
+            if (!in)
+                throw std::runtime_error("cannot open file");
+            renderer.run(in);
+        } catch (const exception &e) {
+            cerr << "painting: " << scene << ": " << e.what() << '\n';
+            return 1;
+        }
+    }
+    PAINTING_WRITE_TRACE("trace.json");
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1)
+        return renderScenes(argc, argv);
+
     RunTests();
 //    draw1();
 //    drawBezie();
 //    drawClip();
+//    drawTiled();
+//    drawAntialiased();
 //    testDrawLine();
     drawCircle();
 //    testShowProjection();
@@ -346,5 +487,11 @@ int main() {
 //    testWeilerAtherton3();
 //    testOnePointProjection();
 //    plotAnimation();
+//    drawSolidKuboids();
+//    drawStrokes();
+//    drawBoolean();
+    imageWriter().flush();
+    // только в сборке с PAINTING_INSTRUMENTATION
+    PAINTING_WRITE_TRACE("../images/trace.json");
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,234 @@
+#pragma once
+
+#include "draw.h"
+#include "transform.h"
+#include <map>
+#include <tuple>
+#include <span>
+
+/// Многогранник с общими вершинами: массив вершин и индексы граней и рёбер.
+/// Вершины хранятся в собственной системе координат и не меняются; повороты и сдвиги накапливаются
+/// в матрице placement, и каждая вершина преобразуется один раз на кадр.
+/// Каждое ребро знает две соседние грани, поэтому видимое ребро рисуется ровно один раз.
+class Mesh {
+public:
+    /// Положение модели на кадре: вершины после преобразования и центры граней
+    struct Pose {
+        vector<Vertex<int>> points;
+        vector<Vertex<int>> face_centers;
+        Vertex<int> center;
+    };
+
+    using Edge = pair<Vertex<int>, Vertex<int>>;
+
+private:
+    VertexArray model;
+    vector<int> face_offsets = {0};   /// вершины грани f — face_vertices[face_offsets[f]..face_offsets[f + 1])
+    vector<int> face_vertices;
+    vector<array<int, 2>> edges;      /// концы ребра в порядке первого обхода
+    vector<array<int, 2>> edge_faces; /// соседние грани ребра, -1 — соседа нет
+    Transform placement;
+
+    void buildEdges() {
+        map<pair<int, int>, int> index;
+        for (int f = 0; f < faceCount(); ++f) {
+            int count = face_offsets[f + 1] - face_offsets[f];
+            if (count < 3)
+                throw std::runtime_error("Mesh::Constructor face has less than 3 vertices");
+            for (int i = 0; i < count; ++i) {
+                int a = face_vertices[face_offsets[f] + i];
+                int b = face_vertices[face_offsets[f] + (i + 1) % count];
+                auto [it, inserted] = index.emplace(make_pair(min(a, b), max(a, b)), edges.size());
+                if (inserted) {
+                    edges.push_back({a, b});
+                    edge_faces.push_back({f, -1});
+                } else if (edge_faces[it->second][1] < 0) {
+                    edge_faces[it->second][1] = f;
+                } else {
+                    throw std::runtime_error("Mesh::Constructor edge is shared by more than two faces");
+                }
+            }
+        }
+    }
+
+    static Vertex<int> project(const Vertex<int> &p, double r) {
+        return Vertex<int>(p.x / (1 + r * p.z), p.y / (1 + r * p.z), p.z / (1 + r * p.z));
+    }
+
+    /// Рёбра, у которых видна хотя бы одна из соседних граней
+    [[nodiscard]] vector<Edge> edgesOf(const vector<Vertex<int>> &points, const vector<char> &visible) const {
+        vector<Edge> res;
+        for (size_t e = 0; e < edges.size(); ++e) {
+            auto [f1, f2] = edge_faces[e];
+            if (visible[f1] || (f2 >= 0 && visible[f2]))
+                res.emplace_back(points[edges[e][0]], points[edges[e][1]]);
+        }
+        return res;
+    }
+
+public:
+    /// vertices — вершины, faces — номера вершин каждой грани в порядке обхода
+    Mesh(const vector<Vertex<double>> &vertices, const vector<vector<int>> &faces) {
+        for (auto &v: vertices)
+            model.push_back(v);
+        for (auto &face: faces) {
+            for (int i: face) {
+                if (i < 0 || size_t(i) >= vertices.size())
+                    throw std::runtime_error("Mesh::Constructor vertex index out of range");
+                face_vertices.push_back(i);
+            }
+            face_offsets.push_back(face_vertices.size());
+        }
+        buildEdges();
+    }
+
+    /// Грани заданы своими вершинами; совпадающие вершины разных граней объединяются
+    explicit Mesh(const vector<vector<Vertex<int>>> &faces) {
+        map<tuple<int, int, int>, int> index;
+        for (auto &face: faces) {
+            for (auto &v: face) {
+                auto [it, inserted] = index.emplace(make_tuple(v.x, v.y, v.z), model.size());
+                if (inserted)
+                    model.push_back(v);
+                face_vertices.push_back(it->second);
+            }
+            face_offsets.push_back(face_vertices.size());
+        }
+        buildEdges();
+    }
+
+    [[nodiscard]] int vertexCount() const {
+        return model.size();
+    }
+
+    [[nodiscard]] int faceCount() const {
+        return face_offsets.size() - 1;
+    }
+
+    [[nodiscard]] int edgeCount() const {
+        return edges.size();
+    }
+
+    [[nodiscard]] const Transform &getPlacement() const {
+        return placement;
+    }
+
+    /// Применяет t поверх текущего положения
+    void transform(const Transform &t) {
+        placement = t * placement;
+    }
+
+    [[nodiscard]] Mesh transformed(const Transform &t) const {
+        Mesh res = *this;
+        res.transform(t);
+        return res;
+    }
+
+    void rotate(double alpha, double betta, double gamma, const Vertex<int> &center = {0, 0, 0}) {
+        transform(Transform::rotation(alpha, betta, gamma, convertToDoubleVertex(center)));
+    }
+
+    void rotateAboveAxes(double x, double y, double z, double phi) {
+        transform(Transform::axisRotation(x, y, z, phi));
+    }
+
+    /// Номера вершин грани f в порядке обхода
+    [[nodiscard]] span<const int> face(int f) const {
+        return {face_vertices.data() + face_offsets[f], size_t(face_offsets[f + 1] - face_offsets[f])};
+    }
+
+    /// Поверхность замкнута: у каждого ребра две соседние грани
+    [[nodiscard]] bool isClosed() const {
+        for (auto &[f1, f2]: edge_faces) {
+            if (f2 < 0)
+                return false;
+        }
+        return true;
+    }
+
+    /// Вершины в текущем положении, без округления
+    [[nodiscard]] VertexArray transformedVertices() const {
+        VertexArray moved;
+        placement.apply(model, moved);
+        return moved;
+    }
+
+    /// Все вершины преобразуются одним проходом и округляются; центр тела — среднее центров граней
+    [[nodiscard]] Pose pose() const {
+        VertexArray moved = transformedVertices();
+
+        Pose res;
+        res.points.resize(model.size());
+        for (size_t i = 0; i < model.size(); ++i)
+            res.points[i] = moved.rounded(i);
+
+        res.face_centers.resize(faceCount());
+        Vertex<int> center(0, 0, 0);
+        for (int f = 0; f < faceCount(); ++f) {
+            Vertex<int> face_center(0, 0, 0);
+            for (int k = face_offsets[f]; k < face_offsets[f + 1]; ++k)
+                face_center += res.points[face_vertices[k]];
+            res.face_centers[f] = face_center / (face_offsets[f + 1] - face_offsets[f]);
+            center += res.face_centers[f];
+        }
+        res.center = center / faceCount();
+        return res;
+    }
+
+    [[nodiscard]] vector<Vertex<int>> getVertices() const {
+        return pose().points;
+    }
+
+    [[nodiscard]] Vertex<int> getCenter() const {
+        return pose().center;
+    }
+
+    /// Видимые рёбра при параллельной проекции на плоскость xy: грань видна, если направленная внутрь
+    /// нормаль (от центра грани к центру тела) не смотрит на наблюдателя
+    [[nodiscard]] vector<Edge> visibleEdges() const {
+        Pose p = pose();
+        vector<char> visible(faceCount());
+        for (int f = 0; f < faceCount(); ++f)
+            visible[f] = (p.center - p.face_centers[f]).z <= 0;
+        return edgesOf(p.points, visible);
+    }
+
+    /// Видимые рёбра после одноточечной проекции (x, y, z) / (1 + r z)
+    [[nodiscard]] vector<Edge> projectedEdges(double r) const {
+        Pose p = pose();
+        for (auto &v: p.points)
+            v = project(v, r);
+        Vertex<int> center = project(p.center, r);
+
+        vector<char> visible(faceCount());
+        for (int f = 0; f < faceCount(); ++f) {
+            const int *face = face_vertices.data() + face_offsets[f];
+            Vertex<int> n = cross(p.points[face[1]] - p.points[face[0]], p.points[face[2]] - p.points[face[1]]);
+            if (n * (center - project(p.face_centers[f], r)) < 0)
+                n = -n;
+            visible[f] = !(n.z < 0 || (n.z == 0 && (n.x < 0 || n.y < 0)));
+        }
+        return edgesOf(p.points, visible);
+    }
+
+    /// Отображение без скрытых граней
+    template<RasterTarget Img>
+    void show(Img &img, const Magick::Color &color) const {
+        drawLines(visibleEdges(), img, color);
+    }
+
+    /// Отображение всех рёбер
+    template<RasterTarget Img>
+    void drawBounds(Img &img, const Magick::Color &color) const {
+        vector<Vertex<int>> points = getVertices();
+        vector<Edge> lines;
+        for (auto &[a, b]: edges)
+            lines.emplace_back(points[a], points[b]);
+        drawLines(lines, img, color);
+    }
+
+    template<RasterTarget Img>
+    void onePointProjection(double r, Img &img, const Magick::Color &color) const {
+        drawLines(projectedEdges(r), img, color);
+    }
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "sweep_line.h"
+#include <unordered_map>
+#include <ostream>
+
+struct ExactPointHash {
+    size_t operator()(const ExactPoint &p) const {
+        auto mix = [](size_t h, int128 v) {
+            auto u = (unsigned __int128) v;
+            h ^= size_t(u) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+            h ^= size_t(u >> 64) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+            return h;
+        };
+        return mix(mix(mix(0, p.x), p.y), p.d);
+    }
+};
+
+/// Направления рёбер сравниваются точно: по полуплоскости, затем по векторному произведению.
+/// Порядок — против часовой стрелки, начиная с направления (1, 0).
+inline bool angleLess(long long ax, long long ay, long long bx, long long by) {
+    bool lower_a = ay < 0 || (ay == 0 && ax < 0);
+    bool lower_b = by < 0 || (by == 0 && bx < 0);
+    if (lower_a != lower_b)
+        return lower_b;
+    return ax * by - ay * bx > 0;
+}
+
+/// Плоский граф, полученный разбиением отрезков во всех точках их пересечения.
+/// Вершины лежат в хеш-таблице, рёбра — в плоском массиве (CSR), упорядоченном по углу вокруг каждой вершины.
+class PlanarGraph {
+public:
+    struct HalfEdge {
+        int to;
+        int dx, dy; /// направление исходного отрезка, на котором лежит ребро
+    };
+
+    vector<ExactPoint> vertices;
+    vector<int> offsets;        /// рёбра вершины v: edges[offsets[v]] .. edges[offsets[v + 1] - 1]
+    vector<HalfEdge> edges;
+
+    explicit PlanarGraph(const vector<Segment<int>> &segments) {
+        // точки разбиения каждого отрезка, включая концы
+        vector<pair<int, ExactPoint>> cuts;
+        cuts.reserve(2 * segments.size());
+        for (size_t i = 0; i < segments.size(); ++i) {
+            cuts.emplace_back(i, ExactPoint(segments[i].a));
+            cuts.emplace_back(i, ExactPoint(segments[i].b));
+        }
+        for (auto &crossing: SweepLine(segments).crossings()) {
+            for (int s: crossing.segments)
+                cuts.emplace_back(s, crossing.point);
+        }
+        // на отрезке лексикографический порядок точек совпадает с порядком вдоль него
+        std::sort(cuts.begin(), cuts.end());
+        cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+        unordered_map<ExactPoint, int, ExactPointHash> ids;
+        ids.reserve(cuts.size());
+        auto vertexId = [&](const ExactPoint &p) {
+            PAINTING_COUNT(MAP_LOOKUPS, 1);
+            auto [it, inserted] = ids.try_emplace(p, int(vertices.size()));
+            if (inserted)
+                vertices.push_back(p);
+            return it->second;
+        };
+
+        vector<pair<int, HalfEdge>> half_edges;
+        half_edges.reserve(2 * cuts.size());
+        for (size_t i = 0; i + 1 < cuts.size(); ++i) {
+            if (cuts[i].first != cuts[i + 1].first)
+                continue;
+            const Segment<int> &segm = segments[cuts[i].first];
+            Vertex<int> d = segm.vec();
+            if (d.x < 0 || (d.x == 0 && d.y < 0))
+                d = -d;
+            int u = vertexId(cuts[i].second), v = vertexId(cuts[i + 1].second);
+            half_edges.push_back({u, {v, d.x, d.y}});
+            half_edges.push_back({v, {u, -d.x, -d.y}});
+        }
+
+        std::sort(half_edges.begin(), half_edges.end(), [](const auto &l, const auto &r) {
+            if (l.first != r.first)
+                return l.first < r.first;
+            if (l.second.to != r.second.to)
+                return l.second.to < r.second.to;
+            return false;
+        });
+        // наложенные отрезки дают одинаковые рёбра
+        half_edges.erase(std::unique(half_edges.begin(), half_edges.end(), [](const auto &l, const auto &r) {
+            return l.first == r.first && l.second.to == r.second.to;
+        }), half_edges.end());
+
+        offsets.assign(vertices.size() + 1, 0);
+        for (auto &[from, edge]: half_edges)
+            offsets[from + 1]++;
+        for (size_t v = 0; v < vertices.size(); ++v)
+            offsets[v + 1] += offsets[v];
+        edges.reserve(half_edges.size());
+        for (auto &[from, edge]: half_edges)
+            edges.push_back(edge);
+        for (size_t v = 0; v < vertices.size(); ++v) {
+            std::sort(edges.begin() + offsets[v], edges.begin() + offsets[v + 1],
+                      [](const HalfEdge &l, const HalfEdge &r) { return angleLess(l.dx, l.dy, r.dx, r.dy); });
+        }
+    }
+
+    /// Первое против часовой стрелки ребро вершины v после направления (dx, dy)
+    [[nodiscard]] int nextEdge(int v, int dx, int dy) const {
+        for (int e = offsets[v]; e < offsets[v + 1]; ++e) {
+            if (angleLess(dx, dy, edges[e].dx, edges[e].dy))
+                return e;
+        }
+        return offsets[v];
+    }
+
+    /// Обход внешней грани против часовой стрелки, начиная с самой левой нижней вершины
+    [[nodiscard]] vector<int> outerFace() const {
+        PAINTING_SCOPE("PlanarGraph::outerFace");
+        if (vertices.empty())
+            return {};
+        int start = 0;
+        for (size_t v = 1; v < vertices.size(); ++v) {
+            if (vertices[v] < vertices[start])
+                start = v;
+        }
+        if (offsets[start] == offsets[start + 1])
+            return {start};
+
+        // все рёбра самой левой нижней вершины смотрят вправо или вверх, поэтому начинаем как будто пришли снизу
+        int first = nextEdge(start, 0, -1);
+        vector<int> face;
+        int v = start, e = first;
+        do {
+            face.push_back(v);
+            const HalfEdge &edge = edges[e];
+            v = edge.to;
+            e = nextEdge(v, -edge.dx, -edge.dy);
+        } while ((v != start || e != first) && face.size() <= edges.size());
+
+        return face;
+    }
+};
+
+/// Внешний контур множества отрезков (обычно — самопересекающегося полигона).
+/// Пересечения ищутся заметающей прямой, поэтому время O((n + k) log n).
+inline vector<Vertex<int>> outerContour(const vector<Segment<int>> &segments, ostream *log = nullptr) {
+    PAINTING_SCOPE("outerContour");
+    PlanarGraph graph(segments);
+    vector<Vertex<int>> contour;
+    for (int v: graph.outerFace()) {
+        Vertex<int> p = graph.vertices[v].round();
+        if (contour.empty() || contour.back() != p)
+            contour.push_back(p);
+    }
+    while (contour.size() > 1 && contour.back() == contour[0])
+        contour.pop_back();
+
+    if (log != nullptr) {
+        for (size_t i = 0; i < contour.size(); ++i)
+            *log << "add segment: [" << contour[i] << ", " << contour[(i + 1) % contour.size()] << "]" << "\n";
+    }
+    return contour;
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "canvas.h"
+#include "scanline.h"
+#include "segment.h"
+
+/// Отсечение замкнутых контуров выпуклым окном (Сазерленд — Ходжмен) перед построчной заливкой.
+/// Контур по очереди обрезается каждой стороной окна, которую он пересекает; части за окном
+/// заменяются отрезками вдоль стороны, числа оборотов внутри окна при этом не меняются, поэтому
+/// отсечение годится для обоих правил заливки и для самопересекающихся контуров. После отсечения
+/// заливка не проходит ни строк, ни рёбер за окном. Каждая вершина результата помнит прямую
+/// выходящего из неё ребра (ScanlineFiller::addEdge с прямой), так что пикселы внутри окна
+/// получаются те же, что без отсечения. Буферы переиспользуются между вызовами.
+class PolygonClipper {
+public:
+    struct ClipVertex {
+        Vertex<double> p;
+        Vertex<double> line_a, line_b;  /// прямая ребра, выходящего из p
+    };
+
+private:
+    /// Сторона окна: точка P внутри, если nx * P.x + ny * P.y + c >= 0
+    struct Side {
+        double nx, ny, c;
+        Vertex<double> a, b;
+
+        [[nodiscard]] double value(const Vertex<double> &p) const {
+            return nx * p.x + ny * p.y + c;
+        }
+    };
+
+    vector<Side> sides;
+    vector<ClipVertex> buffer, scratch;
+    vector<size_t> outside;  /// сколько вершин контура снаружи каждой стороны
+
+    static Vertex<double> toDouble(const Vertex<double> &v) {
+        return v;
+    }
+
+    static Vertex<double> toDouble(const Vertex<int> &v) {
+        return convertToDoubleVertex(v);
+    }
+
+    /// Точка пересечения ребра cur - next со стороной; на осевых сторонах координата ставится точно
+    static Vertex<double> crossing(const Side &side, const Vertex<double> &cur, const Vertex<double> &next,
+                                   double value_cur, double value_next) {
+        double t = value_cur / (value_cur - value_next);
+        Vertex<double> p(cur.x + (next.x - cur.x) * t, cur.y + (next.y - cur.y) * t);
+        if (side.ny == 0)
+            p.x = -side.c / side.nx;
+        else if (side.nx == 0)
+            p.y = -side.c / side.ny;
+        return p;
+    }
+
+    void clipSide(const Side &side) {
+        scratch.clear();
+        size_t n = buffer.size();
+        for (size_t i = 0; i < n; ++i) {
+            const ClipVertex &cur = buffer[i], &next = buffer[i + 1 == n ? 0 : i + 1];
+            double value_cur = side.value(cur.p), value_next = side.value(next.p);
+            if (value_cur >= 0) {
+                scratch.push_back(cur);
+                // выходим из окна: дальше граница идёт по стороне до точки входа
+                if (value_next < 0)
+                    scratch.push_back({crossing(side, cur.p, next.p, value_cur, value_next), side.a, side.b});
+            } else if (value_next >= 0) {
+                scratch.push_back({crossing(side, cur.p, next.p, value_cur, value_next), cur.line_a, cur.line_b});
+            }
+        }
+        buffer.swap(scratch);
+    }
+
+    template<class PointFn>
+    void countOutside(size_t n, PointFn &&point) {
+        outside.assign(sides.size(), 0);
+        for (size_t i = 0; i < n; ++i) {
+            Vertex<double> p = toDouble(point(i));
+            for (size_t s = 0; s < sides.size(); ++s)
+                outside[s] += sides[s].value(p) < 0;
+        }
+    }
+
+    /// Отсекает контур сторонами, за которыми есть его вершины (outside уже посчитан)
+    template<class PointFn>
+    void clipCrossed(size_t n, PointFn &&point) {
+        buffer.clear();
+        for (size_t i = 0; i < n; ++i) {
+            Vertex<double> p = toDouble(point(i));
+            buffer.push_back({p, p, toDouble(point(i + 1 == n ? 0 : i + 1))});
+        }
+        for (size_t s = 0; s < sides.size() && !buffer.empty(); ++s) {
+            if (outside[s] > 0)
+                clipSide(sides[s]);
+        }
+    }
+
+    void addSide(const Vertex<double> &a, const Vertex<double> &b, double nx, double ny) {
+        sides.push_back({nx, ny, -(nx * a.x + ny * a.y), a, b});
+    }
+
+public:
+    /// Окно не задано: контуры не отсекаются
+    PolygonClipper() = default;
+
+    explicit PolygonClipper(const PixelRect &rect) {
+        setRect(rect);
+    }
+
+    /// Выпуклое окно с вершинами window в любом порядке обхода
+    explicit PolygonClipper(const vector<Vertex<int>> &window) {
+        setWindow(window);
+    }
+
+    /// Окно для пикселов rect: прямоугольник [x0 - 1, x1] x [y0 - 1, y1]. Запас в пиксел нужен,
+    /// чтобы отрезки вдоль сторон окна не попадали на строки и столбцы rect.
+    void setRect(const PixelRect &rect) {
+        sides.clear();
+        double x0 = rect.x0 - 1, y0 = rect.y0 - 1, x1 = rect.x1, y1 = rect.y1;
+        addSide({x0, y0}, {x0, y1}, 1, 0);
+        addSide({x1, y0}, {x1, y1}, -1, 0);
+        addSide({x0, y0}, {x1, y0}, 0, 1);
+        addSide({x0, y1}, {x1, y1}, 0, -1);
+    }
+
+    void setWindow(const vector<Vertex<int>> &window) {
+        size_t n = window.size();
+        if (n < 3)
+            throw std::runtime_error("PolygonClipper::setWindow window has less than 3 vertices");
+        int sign = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const auto &a = window[i], &b = window[(i + 1) % n], &c = window[(i + 2) % n];
+            long long turn = (long long) (b.x - a.x) * (c.y - b.y) - (long long) (b.y - a.y) * (c.x - b.x);
+            int s = turn > 0 ? 1 : turn < 0 ? -1 : 0;
+            if (s == 0 || (sign != 0 && s != sign))
+                throw std::runtime_error("PolygonClipper::setWindow window is not convex");
+            sign = s;
+        }
+        sides.clear();
+        for (size_t i = 0; i < n; ++i) {
+            Vertex<double> a = convertToDoubleVertex(window[i]), b = convertToDoubleVertex(window[(i + 1) % n]);
+            // нормаль внутрь: слева от стороны при обходе против часовой стрелки
+            addSide(a, b, -(b.y - a.y) * sign, (b.x - a.x) * sign);
+        }
+    }
+
+    /// Отсекает замкнутый контур из n вершин point(0), ..., point(n - 1) и добавляет его рёбра в filler.
+    /// Контур, целиком лежащий в окне, добавляется без копирования, лежащий за одной из сторон — пропускается.
+    template<class PointFn>
+    void addContour(ScanlineFiller &filler, size_t n, PointFn &&point) {
+        if (n < 2)
+            return;
+        PAINTING_COUNT(EDGE_TESTS, n * sides.size());
+        countOutside(n, point);
+        bool crosses = false;
+        for (size_t count: outside) {
+            if (count == n)
+                return;
+            crosses = crosses || count > 0;
+        }
+        if (!crosses) {
+            for (size_t i = 0; i < n; ++i)
+                filler.addEdge(toDouble(point(i)), toDouble(point(i + 1 == n ? 0 : i + 1)));
+            return;
+        }
+
+        clipCrossed(n, point);
+        for (size_t i = 0; i < buffer.size(); ++i) {
+            const ClipVertex &cur = buffer[i];
+            filler.addEdge(cur.p, buffer[i + 1 == buffer.size() ? 0 : i + 1].p, cur.line_a, cur.line_b);
+        }
+    }
+
+    /// Часть контура внутри окна; действительна до следующего вызова
+    template<class PointFn>
+    const vector<ClipVertex> &clip(size_t n, PointFn &&point) {
+        countOutside(n, point);
+        clipCrossed(n, point);
+        return buffer;
+    }
+
+    void addContour(ScanlineFiller &filler, const vector<Vertex<int>> &points) {
+        addContour(filler, points.size(), [&](size_t i) { return points[i]; });
+    }
+
+    /// Рёбра многоугольника: идущие друг за другом и замыкающиеся отсекаются как контур,
+    /// остальные добавляются как есть
+    void addSegments(ScanlineFiller &filler, const vector<Segment<int>> &segments) {
+        size_t i = 0;
+        while (i < segments.size()) {
+            size_t j = i + 1;
+            while (j < segments.size() && segments[j].a == segments[j - 1].b)
+                ++j;
+            if (j - i > 2 && segments[j - 1].b == segments[i].a) {
+                addContour(filler, j - i, [&](size_t k) { return segments[i + k].a; });
+            } else {
+                for (size_t k = i; k < j; ++k)
+                    filler.addEdge(segments[k].a, segments[k].b);
+            }
+            i = j;
+        }
+    }
+};
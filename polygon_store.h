@@ -0,0 +1,220 @@
+#pragma once
+
+#include "polyhedron.h"
+#include <memory>
+#include <span>
+#include <type_traits>
+
+/// Линейный распределитель: память выдаётся подряд из больших блоков и не освобождается по одному
+/// объекту. reset() за O(1) делает все блоки снова свободными, не возвращая их системе.
+/// Подходит только для тривиально разрушаемых типов: деструкторы не вызываются.
+class Arena {
+private:
+    struct Block {
+        unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    vector<Block> blocks;
+    size_t block_size;
+    size_t current = 0;  /// блок, из которого идёт выделение
+    size_t offset = 0;   /// занято в текущем блоке
+    size_t used = 0;
+
+public:
+    explicit Arena(size_t _block_size = size_t(1) << 20) : block_size(_block_size) {
+        if (block_size == 0)
+            throw std::runtime_error("Arena::Constructor block size is zero");
+    }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    Arena(Arena &&) = default;
+    Arena &operator=(Arena &&) = default;
+
+    void *allocate(size_t bytes, size_t align) {
+        while (current < blocks.size()) {
+            auto base = reinterpret_cast<uintptr_t>(blocks[current].data.get());
+            size_t start = ((base + offset + align - 1) & ~(uintptr_t(align) - 1)) - base;
+            if (start + bytes <= blocks[current].size) {
+                offset = start + bytes;
+                used += bytes;
+                return blocks[current].data.get() + start;
+            }
+            // после reset блоки переиспользуются по порядку; в неподходящем остаётся хвост
+            current++;
+            offset = 0;
+        }
+        size_t size = max(block_size, bytes + align);
+        blocks.push_back({make_unique_for_overwrite<std::byte[]>(size), size});
+        current = blocks.size() - 1;
+        offset = 0;
+        return allocate(bytes, align);
+    }
+
+    template<typename T>
+    T *allocate(size_t count) {
+        static_assert(is_trivially_destructible_v<T>, "Arena holds only trivially destructible types");
+        return static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    /// Освобождает всё выделенное за O(1); блоки остаются для следующих выделений
+    void reset() {
+        current = 0;
+        offset = 0;
+        used = 0;
+    }
+
+    /// Возвращает блоки системе
+    void release() {
+        blocks.clear();
+        reset();
+    }
+
+    [[nodiscard]] size_t bytesUsed() const {
+        return used;
+    }
+
+    [[nodiscard]] size_t bytesReserved() const {
+        size_t total = 0;
+        for (auto &block: blocks)
+            total += block.size;
+        return total;
+    }
+};
+
+/// Многоугольник из PolygonStore: только ссылки на координаты. Нормали не хранятся, а считаются
+/// по ребру при обращении, и совпадают с нормалями Polyhedron (направлены к центру).
+struct PolygonRef {
+    const int *xs;
+    const int *ys;
+    int count;
+    Vertex<int> center;
+
+    [[nodiscard]] int size() const {
+        return count;
+    }
+
+    [[nodiscard]] Vertex<int> vertex(int i) const {
+        return {xs[i], ys[i]};
+    }
+
+    /// Ребро i — от вершины i к следующей
+    [[nodiscard]] Segment<int> edge(int i) const {
+        int j = i + 1 == count ? 0 : i + 1;
+        return {vertex(i), vertex(j), normal(i)};
+    }
+
+    [[nodiscard]] Vertex<int> normal(int i) const {
+        int j = i + 1 == count ? 0 : i + 1;
+        Vertex<int> n(ys[j] - ys[i], xs[i] - xs[j], 0);
+        Vertex<int> mid = (vertex(i) + vertex(j)) / 2;
+        return n * (center - mid) < 0 ? -n : n;
+    }
+
+    [[nodiscard]] vector<Vertex<int>> points() const {
+        vector<Vertex<int>> res;
+        res.reserve(count);
+        for (int i = 0; i < count; ++i)
+            res.push_back(vertex(i));
+        return res;
+    }
+
+    [[nodiscard]] Polyhedron toPolyhedron() const {
+        return Polyhedron(points());
+    }
+
+    template<RasterTarget Img>
+    void drawBounds(Img &img, const Magick::Color &col) const {
+        const auto pen = makePen(img, col);
+        const PixelRect clip = targetBounds(img);
+        for (int i = 0; i < count; ++i) {
+            int j = i + 1 == count ? 0 : i + 1;
+            drawLineClipped(xs[i], ys[i], xs[j], ys[j], img, pen, clip);
+        }
+    }
+
+    /// Та же заливка, что Polyhedron::fill, без построения отрезков
+    template<RasterTarget Img>
+    void fill(Img &img, const Magick::Color &col, FillRule rule) const {
+        PAINTING_SCOPE("PolygonRef::fill");
+        const auto pen = makePen(img, col);
+        const PixelRect clip = targetBounds(img);
+        // таблица рёбер и буферы отсечения переиспользуются между вызовами
+        static thread_local PolygonClipper clipper;
+        static thread_local ScanlineFiller filler;
+        clipper.setRect(clip);
+        filler.clear();
+        clipper.addContour(filler, count, [&](size_t i) { return Vertex<int>(xs[i], ys[i]); });
+        filler.fill(rule, clip.y0, clip.y1, [&](int y, int x_from, int x_to) {
+            plotSpan(img, y, max(x_from, clip.x0), min(x_to, clip.x1), pen);
+        });
+    }
+};
+
+/// Многоугольники сцены в нескольких непрерывных блоках: координаты каждого лежат в арене двумя
+/// массивами x и y (8 байт на вершину против 36 байт на ребро у Segment<int>), а clear() освобождает
+/// всё сразу. Добавленные многоугольники не меняются.
+class PolygonStore {
+private:
+    Arena arena;
+    vector<PolygonRef> polygons;
+    size_t vertex_count = 0;
+
+public:
+    explicit PolygonStore(size_t block_size = size_t(1) << 20) : arena(block_size) {}
+
+    PolygonRef add(std::span<const Vertex<int>> points) {
+        if (points.size() < 3)
+            throw std::runtime_error("PolygonStore::add polygon has less than 3 vertices");
+        int n = points.size();
+        int *xs = arena.allocate<int>(n);
+        int *ys = arena.allocate<int>(n);
+        // тот же центр, что у Polyhedron::getCenter
+        Vertex<int> center;
+        for (int i = 0; i < n; ++i) {
+            xs[i] = points[i].x;
+            ys[i] = points[i].y;
+            center += Vertex<int>(points[i].x, points[i].y);
+        }
+        polygons.push_back({xs, ys, n, center / points.size()});
+        vertex_count += n;
+        return polygons.back();
+    }
+
+    PolygonRef add(const vector<Vertex<int>> &points) {
+        return add(std::span<const Vertex<int>>(points));
+    }
+
+    [[nodiscard]] size_t size() const {
+        return polygons.size();
+    }
+
+    [[nodiscard]] size_t vertexCount() const {
+        return vertex_count;
+    }
+
+    [[nodiscard]] const PolygonRef &operator[](size_t i) const {
+        return polygons[i];
+    }
+
+    [[nodiscard]] auto begin() const {
+        return polygons.begin();
+    }
+
+    [[nodiscard]] auto end() const {
+        return polygons.end();
+    }
+
+    /// Удаляет все многоугольники за O(1); память арены остаётся для следующей сцены
+    void clear() {
+        polygons.clear();
+        arena.reset();
+        vertex_count = 0;
+    }
+
+    /// Память под координаты и заголовки многоугольников
+    [[nodiscard]] size_t bytesUsed() const {
+        return arena.bytesUsed() + polygons.size() * sizeof(PolygonRef);
+    }
+};
@@ -3,6 +3,11 @@
 #include "draw.h"
 #include "segment.h"
 #include "bounding_box.h"
+#include "scanline.h"
+#include "polygon_clip.h"
+#include "aa_fill.h"
+#include "sweep_line.h"
+#include "outer_contour.h"
 #include <cmath>
 #include <map>
 #include <algorithm>
@@ -32,6 +37,7 @@ enum PlaceType {
 
 pair<bool, PlaceType>
 intersectSegment(const Vertex<int> &a, const Vertex<int> &b, const Vertex<int> &c, const Vertex<int> &d) {
+    PAINTING_COUNT(EDGE_TESTS, 1);
     int ab_cd = -area(b - a, d - c);
     if (ab_cd == 0) {  // параллельны
         if (area(d - c, c - a) != 0)
@@ -53,7 +59,9 @@ intersectSegment(const Vertex<int> &a, const Vertex<int> &b, const Vertex<int> &
 //    assert(abs(x1 - x2) < 1e-6);
 //    assert(abs(y1 - y2) < 1e-6);
 
-    return {0 <= t1 && t1 <= 1 && 0 <= t2 && t2 <= 1, CROSS};
+    bool crosses = 0 <= t1 && t1 <= 1 && 0 <= t2 && t2 <= 1;
+    PAINTING_COUNT(INTERSECTIONS_FOUND, crosses);
+    return {crosses, CROSS};
 }
 
 pair<bool, PlaceType>
@@ -104,7 +112,9 @@ private:
 public:
     explicit Polyhedron(const vector<Vertex<int>> &_points) {
         auto points = _points;
-        if (area(points[1] - points[0], points[2] - points[0]) > 0)
+        // в 64 битах: на координатах больше ~46000 произведение разностей не помещается в int
+        const Vertex<int> &p0 = points[0], &p1 = points[1], &p2 = points[2];
+        if ((long long) (p1.x - p0.x) * (p2.y - p0.y) - (long long) (p1.y - p0.y) * (p2.x - p0.x) > 0)
             std::reverse(points.begin(), points.end()); // do CW
 
         segments = vector<Segment<int>>(points.size());
@@ -120,11 +130,14 @@ public:
         fixNormals(getCenter());
     };
 
-    void drawBounds(Magick::Image &img, const Magick::Color &col) {
+    template<RasterTarget Img>
+    void drawBounds(Img &img, const Magick::Color &col) const {
         if (segments.empty())
             return;
+        const auto pen = makePen(img, col);
+        const PixelRect clip = targetBounds(img);
         for (auto &segm: segments)
-            segm.draw(img, col);
+            drawLineClipped(segm.a.x, segm.a.y, segm.b.x, segm.b.y, img, pen, clip);
     }
 
     [[nodiscard]] bool isConvex() const {
@@ -146,23 +159,17 @@ public:
     }
 
     [[nodiscard]] bool IsSimple() const {
+        PAINTING_SCOPE("Polyhedron::IsSimple");
         int n = segments.size();
         if (n <= 2)
             return false;
 
-        for (int i = 2; i < n - 1; ++i) {
-            if (intersectSegment(segments[0], segments[i]).first)
-                return false;
-        }
-
-        for (int i = 1; i < n - 2; ++i) {
-            for (int j = i + 2; j < n; ++j) {
-                if (intersectSegment(segments[i], segments[j]).first)
-                    return false;
-            }
-        }
+        return !hasSelfCrossings(segments);
+    }
 
-        return true;
+    /// Все точки самопересечения контура
+    [[nodiscard]] vector<SegmentCrossing> selfCrossings() const {
+        return findSelfCrossings(segments);
     }
 
     [[nodiscard]] static bool isInsideEvenOddRule(const vector<Segment<int>> &segments, const Vertex<int> &v) {
@@ -214,30 +221,54 @@ public:
         return true;
     }
 
-    void fillWithEvenOddRule(Magick::Image &img, const Magick::Color &col) const {
+    template<RasterTarget Img>
+    void fillWithEvenOddRule(Img &img, const Magick::Color &col) const {
+        fill(img, col, EVEN_ODD);
+    }
+
+    template<RasterTarget Img>
+    void fillWithNonZeroWinding(Img &img, const Magick::Color &col) const {
+        fill(img, col, NON_ZERO);
+    }
+
+    template<RasterTarget Img>
+    void fill(Img &img, const Magick::Color &col, FillRule rule) const {
         if (segments.size() <= 2)
             return;
 
-        BoundingBox<int> bbox(segments);
-        for (int i = bbox.getXMin(); i < bbox.getXMax(); i++) {
-            for (int j = bbox.getYMin(); j < bbox.getYMax(); j++) {
-                if (isInsideEvenOddRule({i, j}))
-                    img.pixelColor(i, j, col);
-            }
-        }
+        PAINTING_SCOPE("Polyhedron::fill");
+        const auto pen = makePen(img, col);
+        const PixelRect clip = targetBounds(img);
+        // части за пределами холста отсекаются до заливки; буферы переиспользуются между вызовами
+        static thread_local PolygonClipper clipper;
+        static thread_local ScanlineFiller filler;
+        clipper.setRect(clip);
+        filler.clear();
+        clipper.addSegments(filler, segments);
+        filler.fill(rule, clip.y0, clip.y1, [&](int y, int x_from, int x_to) {
+            plotSpan(img, y, max(x_from, clip.x0), min(x_to, clip.x1), pen);
+        });
     }
 
-    void fillWithNonZeroWinding(Magick::Image &img, const Magick::Color &col) const {
+    /// Сглаженная заливка: края закрашиваются пропорционально площади пиксела внутри полигона
+    template<RasterTarget Img>
+    void fillAntialiased(Img &img, const Magick::Color &col, FillRule rule) const {
         if (segments.size() <= 2)
             return;
 
-        BoundingBox<int> bbox(segments);
-        for (int i = bbox.getXMin(); i < bbox.getXMax(); i++) {
-            for (int j = bbox.getYMin(); j < bbox.getYMax(); j++) {
-                if (isInsideNonZeroWinding({i, j}))
-                    img.pixelColor(i, j, col);
-            }
+        PAINTING_SCOPE("Polyhedron::fillAntialiased");
+        PixelRect area = {INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+        for (auto &segm: segments) {
+            area.x0 = min(area.x0, segm.a.x);
+            area.y0 = min(area.y0, segm.a.y);
+            area.x1 = max(area.x1, segm.a.x + 2);
+            area.y1 = max(area.y1, segm.a.y + 2);
         }
+        // буфер переиспользуется между вызовами
+        static thread_local CoverageAccumulator accumulator;
+        accumulator.reset(area.intersect(targetBounds(img)));
+        accumulator.addSegments(segments);
+        fillCoverage(accumulator, rule, img, col);
     }
 
     [[nodiscard]] Vertex<int> getCenter() const {
@@ -246,7 +277,7 @@ public:
             center += segm.a;
         }
 
-        return center / segments.size();
+        return center / int(segments.size());
     }
 
     void move(const Vertex<int> &shift) {
@@ -274,103 +305,23 @@ public:
 
     void fixNormals(const Vertex<int> &point) {
         for (auto &segm: segments) {
-            if (segm.n * (point - segm.getCenter()) < 0)
+            Vertex<int> d = point - segm.getCenter();
+            if ((long long) segm.n.x * d.x + (long long) segm.n.y * d.y + (long long) segm.n.z * d.z < 0)
                 segm.n = -segm.n;
         }
     }
 
-    [[nodiscard]] vector<Segment<int>> getSegments() const {
+    [[nodiscard]] const vector<Segment<int>> &getSegments() const {
         return segments;
     }
 
-    [[nodiscard]] Polyhedron weilerAtherton() const {
-        size_t idx = 0;
-        for (size_t i = 1; i < segments.size(); ++i)
-            if (segments[i].a.x < segments[idx].a.x)
-                idx = i;
-
-        vector<Vertex<int>> list;
-        map<Vertex<int>, vector<int>> m;
-
-        list.reserve(1.5 * segments.size());
-        for (size_t k = idx; k < segments.size() + idx; ++k) {
-            int i = k;
-            if (i >= segments.size())
-                i -= segments.size();
-
-            list.push_back(segments[i].a);
-            m[segments[i].a].push_back(list.size() - 1);
-
-            vector<pair<double, Vertex<int>>> new_p;
-            for (int j = 0; j < segments.size(); ++j) {
-                // пропускаем соседей
-                if (abs(i - j) <= 1 || abs(i - j) == segments.size() - 1)
-                    continue;
-
-                auto ans = intersectionPoint(segments[i], segments[j]);
-                double t1 = get<0>(ans), t2 = get<0>(ans);
-                if (get<2>(ans) != PlaceType::CROSS || t1 <= 0 || t1 >= 1 || t2 <= 0 || t2 >= 1)
-                    continue;
-
-                new_p.emplace_back(t1, segments[i].a + (segments[i].b - segments[i].a).multy(t1));
-            }
-            if (new_p.empty())
-                continue;
-            sort(new_p.begin(), new_p.end());
-            for (auto &[t, p]: new_p) {
-                list.push_back(p);
-                m[p].push_back(list.size() - 1);
-            }
-        }
-
-        vector<Segment<int>> segms;
-        segms.reserve(list.size());
-        segms.emplace_back(list[0], list[1]);
-        cout << "add segment: [" << segms.back().a << ", " << segms.back().b << "]" << "\n";
-        m.erase(m.find(list[0])); // это вершина, поэтому встречается точно только один раз
-        int count = 2;
-        int cur = 1;
-        while (!m.empty() && count <= list.size()) {
-            if (cur >= list.size())
-                cur -= list.size();
-            if (!m.contains(list[cur])) {
-                for (int i = 0; i < list.size(); ++i) {
-                    if (!m.contains(list[i]))
-                        continue;
-                    if (Polyhedron::isInsideEvenOddRule(segms, (list[i] + get(list, i + 1)) / 2)) {
-                        m.erase(m.find(list[i]));
-                        continue;
-                    }
-                    cur = i;
-                    break;
-                }
-            }
-
-            if (m[list[cur]].size() <= 1) {
-                m.erase(m.find(list[cur]));
-                int next_idx = (cur + 1) % list.size();
-
-                segms.emplace_back(list[cur], list[next_idx]);
-                cout << "add segment: [" << segms.back().a << ", " << segms.back().b << "]" << "\n";
-                count++;
-                cur++;
-                continue;
-            }
-
-            auto it = m.find(list[cur]);
-            auto vec_it = std::find_if(it->second.begin(), it->second.end(),
-                                       [&cur](int j) -> bool { return j != cur; });
-            cur = *vec_it; // переключаемся на другую ветку
-            it->second.erase(vec_it);
-
-            int next_idx = (cur + 1) % list.size();
-            segms.emplace_back(list[cur], list[next_idx]);
-            cout << "add segment: [" << segms.back().a << ", " << segms.back().b << "]" << "\n";
-            count++;
-            cur++;
-        }
-
-        return Polyhedron(segms);
+    /// Внешний контур полигона с самопересечениями. Если передан log, в него выводятся рёбра контура.
+    [[nodiscard]] Polyhedron weilerAtherton(ostream *log = nullptr) const {
+        PAINTING_SCOPE("Polyhedron::weilerAtherton");
+        auto contour = outerContour(segments, log);
+        if (contour.size() < 3)
+            return *this;
+        return Polyhedron(contour);
     }
 
     ~Polyhedron() = default;
@@ -379,6 +330,7 @@ public:
 Segment<int> cyrusBeckClipLine(const Segment<int> &line, const Polyhedron &pol) {
     auto l = line.vec();
     double t1 = 0, t2 = 1;
+    PAINTING_COUNT(EDGE_TESTS, pol.getSegments().size());
     for (auto &segm: pol.getSegments()) {
         auto ans = intersectionPoint(line.a, line.b, segm.a, segm.b);
         if (get<2>(ans) == PlaceType::PARALLEL)
@@ -399,7 +351,8 @@ Segment<int> cyrusBeckClipLine(const Segment<int> &line, const Polyhedron &pol)
     return Segment<int>{a, b};
 }
 
-void showProjection(const vector<Segment<int>> &segments, double z, Magick::Image &img, const Magick::Color &color) {
+template<RasterTarget Img>
+void showProjection(const vector<Segment<int>> &segments, double z, Img &img, const Magick::Color &color) {
     // {x1, y1, z1}, {x2, y2, z2}
     // z = z1 + t * (z2 - z1) => t = (z - z1) / (z2 - z1);
     vector<Vertex<int>> points;
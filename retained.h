@@ -0,0 +1,153 @@
+#pragma once
+
+#include "polyhedron.h"
+#include <functional>
+
+/// Сцена в удерживаемом режиме: холст хранится между кадрами вместе со списком примитивов
+/// и прямоугольником, который каждый из них занимал при последней отрисовке. Изменённый примитив
+/// помечает грязными свой старый и новый прямоугольники; render() очищает только их и перерисовывает
+/// в них через CanvasView все задевающие их примитивы в порядке добавления. Результат совпадает
+/// с отрисовкой всей сцены с нуля пиксел в пиксел.
+class RetainedScene {
+public:
+    using Draw = function<void(CanvasView &)>;
+    using Edge = pair<Vertex<int>, Vertex<int>>;
+
+private:
+    struct Item {
+        Draw draw;          /// пусто — примитив удалён
+        PixelRect bounds;   /// консервативная оценка пикселов, которые меняет draw
+    };
+
+    /// Сверх этого числа грязные прямоугольники сливаются в один
+    static constexpr size_t MAX_DIRTY = 16;
+
+    Canvas canvas;
+    Canvas::Pixel background;
+    vector<Item> items;
+    vector<PixelRect> dirty;
+
+    static PixelRect unite(const PixelRect &l, const PixelRect &r) {
+        if (l.empty())
+            return r;
+        if (r.empty())
+            return l;
+        return {min(l.x0, r.x0), min(l.y0, r.y0), max(l.x1, r.x1), max(l.y1, r.y1)};
+    }
+
+    static long long area(const PixelRect &r) {
+        return r.empty() ? 0 : (long long) (r.x1 - r.x0) * (r.y1 - r.y0);
+    }
+
+    /// Добавляет прямоугольник, сливая пересекающиеся и те, объединение которых почти не больше
+    /// их суммы: одна очистка большой области дешевле нескольких мелких с общими примитивами
+    void markDirty(PixelRect r) {
+        r = r.intersect(canvas.bounds());
+        if (r.empty())
+            return;
+        for (size_t i = 0; i < dirty.size();) {
+            PixelRect u = unite(dirty[i], r);
+            if (!dirty[i].intersect(r).empty() || area(u) <= area(dirty[i]) + area(r)) {
+                r = u;
+                dirty[i] = dirty.back();
+                dirty.pop_back();
+                i = 0;
+            } else {
+                ++i;
+            }
+        }
+        dirty.push_back(r);
+        if (dirty.size() > MAX_DIRTY) {
+            PixelRect all;
+            for (auto &d: dirty)
+                all = unite(all, d);
+            dirty = {all};
+        }
+    }
+
+    void check(int id) const {
+        if (id < 0 || size_t(id) >= items.size() || !items[id].draw)
+            throw std::runtime_error("RetainedScene unknown primitive id");
+    }
+
+public:
+    RetainedScene(int width, int height, const Magick::Color &_background = Magick::Color("white"))
+            : canvas(width, height, _background), background(Canvas::pack(_background)) {
+        dirty.push_back(canvas.bounds());
+    }
+
+    /// Прямоугольник отрезков: Брезенхем не выходит за прямоугольник концов
+    static PixelRect linesBounds(const vector<Edge> &lines) {
+        PixelRect res;
+        for (auto &[a, b]: lines)
+            res = unite(res, {min(a.x, b.x), min(a.y, b.y), max(a.x, b.x) + 1, max(a.y, b.y) + 1});
+        return res;
+    }
+
+    /// Номер нового примитива. bounds должен покрывать все пикселы, которые меняет draw.
+    int add(const PixelRect &bounds, Draw draw) {
+        if (!draw)
+            throw std::runtime_error("RetainedScene::add empty draw function");
+        items.push_back({std::move(draw), bounds});
+        markDirty(bounds);
+        return items.size() - 1;
+    }
+
+    /// Заменяет примитив id: перерисуются его прежний и новый прямоугольники
+    void update(int id, const PixelRect &bounds, Draw draw) {
+        check(id);
+        if (!draw)
+            throw std::runtime_error("RetainedScene::update empty draw function");
+        markDirty(items[id].bounds);
+        markDirty(bounds);
+        items[id] = {std::move(draw), bounds};
+    }
+
+    void remove(int id) {
+        check(id);
+        markDirty(items[id].bounds);
+        items[id] = {};
+    }
+
+    /// Отрезки одного цвета, как drawLines
+    int addLines(vector<Edge> lines, const Magick::Color &color) {
+        PixelRect bounds = linesBounds(lines);
+        return add(bounds, [lines = std::move(lines), color](CanvasView &view) { drawLines(lines, view, color); });
+    }
+
+    void updateLines(int id, vector<Edge> lines, const Magick::Color &color) {
+        PixelRect bounds = linesBounds(lines);
+        update(id, bounds, [lines = std::move(lines), color](CanvasView &view) { drawLines(lines, view, color); });
+    }
+
+    /// Помечает область грязной без изменения примитивов, например после смены фона
+    void invalidate(const PixelRect &rect) {
+        markDirty(rect);
+    }
+
+    /// Области, которые перерисует следующий render()
+    [[nodiscard]] const vector<PixelRect> &dirtyRects() const {
+        return dirty;
+    }
+
+    /// Перерисовывает грязные области и возвращает их: вне этих прямоугольников холст не изменился
+    vector<PixelRect> render() {
+        PAINTING_SCOPE("RetainedScene::render");
+        vector<PixelRect> changed;
+        changed.swap(dirty);
+        for (auto &rect: changed) {
+            CanvasView view(canvas, rect);
+            for (int y = rect.y0; y < rect.y1; ++y)
+                plotSpan(view, y, rect.x0, rect.x1, background);
+            for (auto &item: items) {
+                if (item.draw && !item.bounds.intersect(rect).empty())
+                    item.draw(view);
+            }
+        }
+        return changed;
+    }
+
+    [[nodiscard]] const Canvas &getCanvas() const {
+        return canvas;
+    }
+};
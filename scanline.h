@@ -0,0 +1,215 @@
+#pragma once
+
+#include "segment.h"
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+
+/// Правило определения принадлежности пиксела полигону
+enum FillRule {
+    EVEN_ODD,
+    NON_ZERO,
+};
+
+/// Ребро таблицы рёбер. Пиксел (x, y) считается лежащим правее ребра, если точка пересечения
+/// ребра со строкой y имеет абсциссу <= x. Строка y пересекает ребро, если y_min <= y < y_max
+/// (полуинтервал, чтобы общая вершина двух рёбер не учитывалась дважды).
+struct ScanEdge {
+    double x0, y0; /// нижний конец ребра
+    double x1, y1; /// верхний конец ребра
+    int row_begin; /// первая строка, пересекающая ребро
+    int row_end;   /// строка за последней, пересекающей ребро
+    int dir;       /// +1, если ребро направлено вверх, -1 — вниз
+
+    ScanEdge(const Vertex<double> &a, const Vertex<double> &b) {
+        dir = a.y < b.y ? 1 : -1;
+        const Vertex<double> &lo = a.y < b.y ? a : b;
+        const Vertex<double> &hi = a.y < b.y ? b : a;
+        x0 = lo.x;
+        y0 = lo.y;
+        x1 = hi.x;
+        y1 = hi.y;
+        row_begin = int(ceil(y0));
+        row_end = int(ceil(y1));
+    }
+
+    /// Часть a - b ребра, лежащего на прямой line_a - line_b: строки берутся по концам части,
+    /// а абсциссы пересечений — по исходной прямой, поэтому отсечение ребра не сдвигает его пикселы
+    ScanEdge(const Vertex<double> &a, const Vertex<double> &b, const Vertex<double> &line_a,
+             const Vertex<double> &line_b) : ScanEdge(line_a, line_b) {
+        dir = a.y < b.y ? 1 : -1;
+        row_begin = int(ceil(min(a.y, b.y)));
+        row_end = int(ceil(max(a.y, b.y)));
+    }
+
+    /// Самый левый пиксел строки y, лежащий правее ребра
+    [[nodiscard]] int columnAt(int y) const {
+        // сначала умножаем, потом делим: для целых вершин результат деления точный
+        return int(ceil(x0 + (y - y0) * (x1 - x0) / (y1 - y0)));
+    }
+};
+
+/// Заливка полигона построчным сканированием: таблица рёбер, отсортированная по y,
+/// и список активных рёбер, упорядоченный по x. Стоимость O(n log n + число строк и отрезков).
+/// Объект можно переиспользовать, чтобы не выделять память под таблицы при каждой заливке.
+class ScanlineFiller {
+public:
+    /// Элемент списка активных рёбер
+    struct Crossing {
+        int x;
+        int dir;
+        int edge;
+    };
+private:
+    vector<ScanEdge> edges;
+    vector<Crossing> active;
+    bool sorted = true;
+public:
+    void clear() {
+        edges.clear();
+        active.clear();
+        sorted = true;
+    }
+
+    void addEdge(const Vertex<double> &a, const Vertex<double> &b) {
+        if (a.y == b.y)
+            return; // горизонтальные рёбра не пересекают строки
+        ScanEdge edge(a, b);
+        if (edge.row_begin >= edge.row_end)
+            return; // ребро лежит между двумя соседними строками
+        if (!edges.empty() && edges.back().row_begin > edge.row_begin)
+            sorted = false;
+        edges.push_back(edge);
+    }
+
+    void addEdge(const Vertex<int> &a, const Vertex<int> &b) {
+        addEdge(convertToDoubleVertex(a), convertToDoubleVertex(b));
+    }
+
+    /// Часть a - b ребра line_a - line_b, см. ScanEdge
+    void addEdge(const Vertex<double> &a, const Vertex<double> &b, const Vertex<double> &line_a,
+                 const Vertex<double> &line_b) {
+        if (a.y == b.y || line_a.y == line_b.y)
+            return;
+        ScanEdge edge(a, b, line_a, line_b);
+        if (edge.row_begin >= edge.row_end)
+            return;
+        if (!edges.empty() && edges.back().row_begin > edge.row_begin)
+            sorted = false;
+        edges.push_back(edge);
+    }
+
+    void addSegments(const vector<Segment<int>> &segments) {
+        edges.reserve(edges.size() + segments.size());
+        for (auto &segm: segments)
+            addEdge(segm.a, segm.b);
+    }
+
+    void addContour(const vector<Vertex<int>> &points) {
+        edges.reserve(edges.size() + points.size());
+        for (size_t i = 0; i < points.size(); ++i)
+            addEdge(points[i], points[(i + 1) % points.size()]);
+    }
+
+    [[nodiscard]] bool empty() const {
+        return edges.empty();
+    }
+
+    [[nodiscard]] int rowBegin() const {
+        int row = INT_MAX;
+        for (auto &edge: edges)
+            row = min(row, edge.row_begin);
+        return row;
+    }
+
+    [[nodiscard]] int rowEnd() const {
+        int row = INT_MIN;
+        for (auto &edge: edges)
+            row = max(row, edge.row_end);
+        return row;
+    }
+
+    /// Сортирует таблицу рёбер. После этого заливку можно вызывать из нескольких потоков,
+    /// передавая каждому свой список активных рёбер.
+    void prepare() {
+        if (!sorted) {
+            std::stable_sort(edges.begin(), edges.end(), [](const ScanEdge &l, const ScanEdge &r) {
+                return l.row_begin < r.row_begin;
+            });
+            sorted = true;
+        }
+    }
+
+    /// Вызывает span(y, x_from, x_to) для каждого отрезка [x_from, x_to) строк y_from <= y < y_to,
+    /// лежащего внутри полигона по правилу rule
+    template<class SpanFn>
+    void fill(FillRule rule, int y_from, int y_to, SpanFn &&span) {
+        prepare();
+        fill(rule, y_from, y_to, std::forward<SpanFn>(span), active);
+    }
+
+    /// То же для подготовленной таблицы (см. prepare) со своим списком активных рёбер
+    template<class SpanFn>
+    void fill(FillRule rule, int y_from, int y_to, SpanFn &&span, vector<Crossing> &active) const {
+        if (!sorted)
+            throw std::runtime_error("ScanlineFiller::fill edge table is not prepared");
+
+        active.clear();
+        size_t next = 0;
+        int y = y_from;
+        while (y < y_to) {
+            if (active.empty()) {
+                while (next < edges.size() && edges[next].row_end <= y)
+                    next++;
+                if (next == edges.size())
+                    break;
+                y = max(y, edges[next].row_begin);
+                if (y >= y_to)
+                    break;
+            }
+
+            // добавляем рёбра, начинающиеся на этой строке, и выбрасываем закончившиеся
+            for (; next < edges.size() && edges[next].row_begin <= y; ++next) {
+                if (edges[next].row_end > y)
+                    active.push_back({0, edges[next].dir, int(next)});
+            }
+            std::erase_if(active, [&](const Crossing &c) { return edges[c.edge].row_end <= y; });
+
+            // порядок с прошлой строки почти не меняется, поэтому сортировка вставками
+            for (auto &c: active)
+                c.x = edges[c.edge].columnAt(y);
+            PAINTING_COUNT(EDGE_TESTS, active.size());
+            for (size_t i = 1; i < active.size(); ++i) {
+                Crossing c = active[i];
+                size_t j = i;
+                for (; j > 0 && active[j - 1].x > c.x; --j)
+                    active[j] = active[j - 1];
+                active[j] = c;
+            }
+
+            if (rule == EVEN_ODD) {
+                for (size_t i = 0; i + 1 < active.size(); i += 2) {
+                    if (active[i].x < active[i + 1].x)
+                        span(y, active[i].x, active[i + 1].x);
+                }
+            } else {
+                int winding = 0;
+                int from = 0;
+                for (auto &c: active) {
+                    if (winding == 0)
+                        from = c.x;
+                    winding += c.dir;
+                    if (winding == 0 && from < c.x)
+                        span(y, from, c.x);
+                }
+            }
+            y++;
+        }
+    }
+
+    template<class SpanFn>
+    void fill(FillRule rule, SpanFn &&span) {
+        fill(rule, INT_MIN, INT_MAX, std::forward<SpanFn>(span));
+    }
+};
@@ -0,0 +1,330 @@
+#pragma once
+
+#include "polyhedron.h"
+#include "kuboid.h"
+#include "zbuffer.h"
+#include "image_writer.h"
+#include "thread_pool.h"
+#include <istream>
+#include <sstream>
+#include <memory>
+#include <mutex>
+#include <exception>
+
+/// Пакетная отрисовка по текстовому описанию сцены. Команды читаются по одной строке и сразу
+/// выполняются, поэтому в памяти находится только текущий холст, а не весь список примитивов.
+/// Сохранение идёт в пуле потоков параллельно с отрисовкой следующих команд; холсты
+/// для сохранения и буфер глубины переиспользуются между выходами и сценами (см. reset).
+///
+///   # комментарий
+///   canvas W H [BACKGROUND]             новый холст (память прежнего того же размера переиспользуется)
+///   transform reset                     сброс текущего преобразования
+///   translate DX DY [DZ]                преобразования накапливаются поверх текущего
+///   scale S
+///   rotate A B G [CX CY [CZ]]           как Transform::rotation, вокруг точки (CX, CY, CZ)
+///   perspective R                       коэффициент одноточечной проекции, 0 — параллельная
+///   line COLOR X1 Y1 X2 Y2
+///   polyline COLOR X Y X Y ...
+///   polygon COLOR X Y X Y ...           граница многоугольника
+///   fill evenodd|nonzero COLOR X Y ...
+///   fill-aa evenodd|nonzero COLOR X Y ...
+///   contour COLOR X Y X Y ...           внешний контур самопересекающегося многоугольника
+///   bezier COLOR X Y X Y ...
+///   cuboid edges|visible|projection|solid COLOR X Y Z A [B C]
+///   save FILE                           путь относительно output_dir, формат — по расширению (см. writeImage)
+///
+/// Цвет — любая строка, понятная Magick::Color: имя или #rrggbb.
+class SceneRenderer {
+private:
+    ThreadPool &pool;
+    string output_dir;
+    size_t max_in_flight;
+
+    unique_ptr<Canvas> canvas;
+    bool has_canvas = false;          /// в текущей сцене уже была команда canvas
+    unique_ptr<DepthRenderer> depth;
+    double depth_r = 0;
+    Transform current;
+    double r = 0;
+    size_t line_number = 0;
+
+    mutex m;
+    vector<shared_ptr<Canvas>> spare;  /// холсты, освободившиеся после сохранения
+    size_t in_flight = 0;
+    exception_ptr error;
+    ThreadPool::TaskGroup saves;      /// запись файлов; чужие задачи пула не ждём
+
+    /// Ошибка разбора с номером строки
+    [[noreturn]] void fail(const string &message) const {
+        throw std::runtime_error("SceneRenderer::execute line " + to_string(line_number) + ": " + message);
+    }
+
+    template<typename T>
+    T read(istringstream &args, const char *what) const {
+        T value;
+        if (!(args >> value))
+            fail(string("expected ") + what);
+        return value;
+    }
+
+    /// Необязательный аргумент: false, если строка закончилась
+    template<typename T>
+    bool readOptional(istringstream &args, T &value, const char *what) const {
+        if (args >> value)
+            return true;
+        if (!args.eof())
+            fail(string("bad ") + what);
+        return false;
+    }
+
+    void expectEnd(istringstream &args) const {
+        string rest;
+        if (args >> rest)
+            fail("unexpected argument " + rest);
+    }
+
+    Magick::Color readColor(istringstream &args) const {
+        return Magick::Color(read<string>(args, "color"));
+    }
+
+    FillRule readRule(istringstream &args) const {
+        string rule = read<string>(args, "fill rule");
+        if (rule == "evenodd")
+            return EVEN_ODD;
+        if (rule == "nonzero")
+            return NON_ZERO;
+        fail("unknown fill rule " + rule);
+    }
+
+    /// Точки до конца строки, после текущего преобразования
+    vector<Vertex<int>> readPoints(istringstream &args, size_t min_count) const {
+        vector<Vertex<int>> points;
+        double x, y;
+        while (args >> x) {
+            if (!(args >> y))
+                fail("odd number of coordinates");
+            Vertex<double> p = current.apply(Vertex<double>(x, y, 0));
+            points.emplace_back(roundToInt(p.x), roundToInt(p.y));
+        }
+        if (!args.eof())
+            fail("bad coordinate");
+        if (points.size() < min_count)
+            fail("expected at least " + to_string(min_count) + " points");
+        return points;
+    }
+
+    Canvas &target() const {
+        if (!has_canvas)
+            fail("no canvas, use canvas W H first");
+        return *canvas;
+    }
+
+    Mesh readCuboid(istringstream &args) const {
+        double x = read<double>(args, "x"), y = read<double>(args, "y"), z = read<double>(args, "z");
+        double a = read<double>(args, "size");
+        double b = a, c = a;
+        if (readOptional(args, b, "height"))
+            c = read<double>(args, "depth");
+        expectEnd(args);
+        vector<Vertex<double>> vertices = {{x, y, z}, {x + a, y, z}, {x + a, y + b, z}, {x, y + b, z},
+                                           {x, y, z + c}, {x + a, y, z + c}, {x + a, y + b, z + c}, {x, y + b, z + c}};
+        Mesh mesh(vertices, {{0, 1, 2, 3}, {4, 5, 6, 7}, {0, 1, 5, 4}, {1, 2, 6, 5}, {2, 3, 7, 6}, {3, 0, 4, 7}});
+        mesh.transform(current);
+        return mesh;
+    }
+
+    /// Вызывается под m: ошибка записи сообщается один раз
+    void rethrowError() {
+        if (error) {
+            exception_ptr e = error;
+            error = nullptr;
+            rethrow_exception(e);
+        }
+    }
+
+    /// Копия холста уходит в пул; сам холст можно рисовать дальше
+    void save(const string &filename) {
+        Canvas &img = target();
+        shared_ptr<Canvas> copy;
+        {
+            unique_lock lock(m);
+            if (in_flight >= max_in_flight) {
+                lock.unlock();
+                pool.wait(saves);
+                lock.lock();
+            }
+            rethrowError();
+            if (!spare.empty()) {
+                copy = std::move(spare.back());
+                spare.pop_back();
+            }
+            in_flight++;
+        }
+        if (copy)
+            *copy = img;
+        else
+            copy = make_shared<Canvas>(img);
+
+        string path = output_dir.empty() ? filename : output_dir + "/" + filename;
+        pool.submit(saves, [this, path, copy] {
+            exception_ptr failure;
+            try {
+                writeImage(*copy, path);
+            } catch (...) {
+                failure = current_exception();
+            }
+            lock_guard lock(m);
+            if (failure && !error)
+                error = failure;
+            in_flight--;
+            spare.push_back(copy);
+        });
+    }
+
+public:
+    /// Файлы сохраняются в пуле pool; не больше max_in_flight (0 — два на поток) холстов ждут записи
+    explicit SceneRenderer(ThreadPool &_pool, string _output_dir = "", size_t _max_in_flight = 0)
+            : pool(_pool), output_dir(std::move(_output_dir)),
+              max_in_flight(_max_in_flight == 0 ? 2 * _pool.size() : _max_in_flight) {}
+
+    SceneRenderer(const SceneRenderer &) = delete;
+    SceneRenderer &operator=(const SceneRenderer &) = delete;
+
+    ~SceneRenderer() {
+        pool.wait(saves);
+    }
+
+    /// Текущий холст, если он уже создан в этой сцене
+    [[nodiscard]] const Canvas *getCanvas() const {
+        return has_canvas ? canvas.get() : nullptr;
+    }
+
+    /// Начало новой сцены: сбрасываются преобразование, перспектива и номер строки, холст нужно
+    /// задать заново. Память холста, буфера глубины и копий для сохранения остаётся.
+    void reset() {
+        has_canvas = false;
+        current = Transform();
+        r = 0;
+        line_number = 0;
+    }
+
+    /// Выполняет одну строку описания
+    void execute(const string &line) {
+        line_number++;
+        istringstream args(line);
+        string command;
+        if (!(args >> command) || command[0] == '#')
+            return;
+
+        if (command == "canvas") {
+            int w = read<int>(args, "width"), h = read<int>(args, "height");
+            string background = "white";
+            args >> background;
+            expectEnd(args);
+            if (w <= 0 || h <= 0)
+                fail("canvas size must be positive");
+            if (canvas && canvas->getWidth() == w && canvas->getHeight() == h)
+                canvas->clear(Canvas::pack(Magick::Color(background)));
+            else
+                canvas = make_unique<Canvas>(w, h, Magick::Color(background));
+            if (depth)
+                depth->clear();
+            has_canvas = true;
+        } else if (command == "transform") {
+            if (read<string>(args, "reset") != "reset")
+                fail("expected transform reset");
+            expectEnd(args);
+            current = Transform();
+        } else if (command == "translate") {
+            double dx = read<double>(args, "dx"), dy = read<double>(args, "dy"), dz = 0;
+            readOptional(args, dz, "dz");
+            expectEnd(args);
+            current = Transform::translation({dx, dy, dz}) * current;
+        } else if (command == "scale") {
+            double s = read<double>(args, "scale");
+            expectEnd(args);
+            current = Transform::scale(s) * current;
+        } else if (command == "rotate") {
+            double a = read<double>(args, "alpha"), b = read<double>(args, "betta"), g = read<double>(args, "gamma");
+            Vertex<double> center(0, 0, 0);
+            if (readOptional(args, center.x, "center x")) {
+                center.y = read<double>(args, "center y");
+                readOptional(args, center.z, "center z");
+            }
+            expectEnd(args);
+            current = Transform::rotation(a, b, g, center) * current;
+        } else if (command == "perspective") {
+            r = read<double>(args, "r");
+            expectEnd(args);
+        } else if (command == "line") {
+            auto color = readColor(args);
+            auto points = readPoints(args, 2);
+            if (points.size() != 2)
+                fail("line takes exactly 2 points");
+            drawLine(points[0], points[1], target(), color);
+        } else if (command == "polyline") {
+            auto color = readColor(args);
+            drawPolyline(readPoints(args, 2), target(), color);
+        } else if (command == "polygon") {
+            auto color = readColor(args);
+            drawPolyline(readPoints(args, 3), target(), color, true);
+        } else if (command == "fill" || command == "fill-aa") {
+            FillRule rule = readRule(args);
+            auto color = readColor(args);
+            Polyhedron pol(readPoints(args, 3));
+            if (command == "fill")
+                pol.fill(target(), color, rule);
+            else
+                pol.fillAntialiased(target(), color, rule);
+        } else if (command == "contour") {
+            auto color = readColor(args);
+            Polyhedron(readPoints(args, 3)).weilerAtherton().drawBounds(target(), color);
+        } else if (command == "bezier") {
+            auto color = readColor(args);
+            drawBezierCurve(readPoints(args, 2), target(), color);
+        } else if (command == "cuboid") {
+            string mode = read<string>(args, "cuboid mode");
+            auto color = readColor(args);
+            Mesh cuboid = readCuboid(args);
+            Canvas &img = target();
+            if (mode == "edges") {
+                cuboid.drawBounds(img, color);
+            } else if (mode == "visible") {
+                cuboid.show(img, color);
+            } else if (mode == "projection") {
+                cuboid.onePointProjection(r, img, color);
+            } else if (mode == "solid") {
+                if (!depth || depth_r != r || depth->getBuffer().bounds() != img.bounds()) {
+                    depth = make_unique<DepthRenderer>(img.getWidth(), img.getHeight(), r);
+                    depth_r = r;
+                }
+                depth->drawMesh(cuboid, img, color);
+            } else {
+                fail("unknown cuboid mode " + mode);
+            }
+        } else if (command == "save") {
+            string filename = read<string>(args, "file name");
+            expectEnd(args);
+            save(filename);
+        } else {
+            fail("unknown command " + command);
+        }
+    }
+
+    /// Читает сцену из in до конца потока, не загружая её целиком
+    void run(istream &in) {
+        PAINTING_SCOPE("SceneRenderer::run");
+        reset();
+        string line;
+        while (getline(in, line))
+            execute(line);
+        finish();
+    }
+
+    /// Дожидается записи всех сохранённых файлов и пробрасывает первую ошибку записи
+    void finish() {
+        pool.wait(saves);
+        lock_guard lock(m);
+        rethrowError();
+    }
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "vertex.h"
+#include "canvas.h"
 
 template<typename T> requires Arithmetic<T>
 class Segment {
@@ -21,7 +22,8 @@ public:
         return area(b - v, a - v) == 0 && (a - v) * (b - v) <= 0;
     }
 
-    void draw(Magick::Image &img, const Magick::Color &col) const {
+    template<RasterTarget Img>
+    void draw(Img &img, const Magick::Color &col) const {
         drawLine(a.x, a.y, b.x, b.y, img, col);
     }
 
@@ -0,0 +1,378 @@
+#pragma once
+
+#include "polyhedron.h"
+#include <unordered_map>
+#include <limits>
+
+/// Равномерная сетка над прямоугольниками объектов: объект записывается во все ячейки, которые задевает
+/// его прямоугольник. Сетка не ограничена, занятые ячейки хранятся в хеш-таблице.
+/// Объекты, задевающие больше MAX_CELLS ячеек, хранятся отдельным списком и проверяются при каждом запросе.
+/// Запросы только читают сетку, поэтому их можно выполнять из нескольких потоков одновременно.
+class SpatialGrid {
+public:
+    static constexpr int MAX_CELLS = 64;
+
+private:
+    struct Entry {
+        PixelRect box;
+        PixelRect cells;  /// ячейки [x0, x1) x [y0, y1)
+        bool alive = false;
+        bool large = false;
+    };
+
+    int cell_size;
+    unordered_map<int64_t, vector<int>> cells;
+    vector<Entry> entries;
+    vector<int> large;
+    size_t alive_count = 0;
+
+    [[nodiscard]] int cellOf(int v) const {
+        return v >= 0 ? v / cell_size : -((-int64_t(v) + cell_size - 1) / cell_size);
+    }
+
+    static int64_t key(int cx, int cy) {
+        return int64_t(cx) << 32 | uint32_t(cy);
+    }
+
+    [[nodiscard]] PixelRect cellRange(const PixelRect &box) const {
+        return {cellOf(box.x0), cellOf(box.y0), cellOf(box.x1 - 1) + 1, cellOf(box.y1 - 1) + 1};
+    }
+
+    static bool isLarge(const PixelRect &c) {
+        return int64_t(c.x1 - c.x0) * (c.y1 - c.y0) > MAX_CELLS;
+    }
+
+    void link(int id) {
+        Entry &e = entries[id];
+        e.large = isLarge(e.cells);
+        if (e.large) {
+            large.push_back(id);
+            return;
+        }
+        for (int cy = e.cells.y0; cy < e.cells.y1; ++cy) {
+            for (int cx = e.cells.x0; cx < e.cells.x1; ++cx)
+                cells[key(cx, cy)].push_back(id);
+        }
+    }
+
+    void unlink(int id) {
+        Entry &e = entries[id];
+        auto erase = [id](vector<int> &ids) {
+            auto it = std::find(ids.begin(), ids.end(), id);
+            *it = ids.back();
+            ids.pop_back();
+        };
+        if (e.large) {
+            erase(large);
+            return;
+        }
+        for (int cy = e.cells.y0; cy < e.cells.y1; ++cy) {
+            for (int cx = e.cells.x0; cx < e.cells.x1; ++cx) {
+                auto it = cells.find(key(cx, cy));
+                erase(it->second);
+                if (it->second.empty())
+                    cells.erase(it);
+            }
+        }
+    }
+
+    [[nodiscard]] const vector<int> *cell(int cx, int cy) const {
+        PAINTING_COUNT(MAP_LOOKUPS, 1);
+        auto it = cells.find(key(cx, cy));
+        return it == cells.end() ? nullptr : &it->second;
+    }
+
+public:
+    explicit SpatialGrid(int _cell_size = 64) : cell_size(_cell_size) {
+        if (cell_size <= 0)
+            throw std::runtime_error("SpatialGrid::Constructor cell size must be positive");
+    }
+
+    [[nodiscard]] size_t size() const {
+        return alive_count;
+    }
+
+    [[nodiscard]] int getCellSize() const {
+        return cell_size;
+    }
+
+    [[nodiscard]] bool contains(int id) const {
+        return id >= 0 && size_t(id) < entries.size() && entries[id].alive;
+    }
+
+    [[nodiscard]] const PixelRect &box(int id) const {
+        return entries[id].box;
+    }
+
+    /// Добавляет объект id с прямоугольником box (полуоткрытым, как PixelRect)
+    void insert(int id, const PixelRect &box) {
+        if (id < 0)
+            throw std::runtime_error("SpatialGrid::insert negative id");
+        if (box.empty())
+            throw std::runtime_error("SpatialGrid::insert empty box");
+        if (size_t(id) >= entries.size())
+            entries.resize(id + 1);
+        if (entries[id].alive)
+            throw std::runtime_error("SpatialGrid::insert id is already present");
+        entries[id] = {box, cellRange(box), true, false};
+        link(id);
+        alive_count++;
+    }
+
+    /// Новое положение объекта. Если он остался в тех же ячейках, сетка не меняется.
+    void update(int id, const PixelRect &box) {
+        if (!contains(id))
+            throw std::runtime_error("SpatialGrid::update unknown id");
+        if (box.empty())
+            throw std::runtime_error("SpatialGrid::update empty box");
+        Entry &e = entries[id];
+        PixelRect range = cellRange(box);
+        e.box = box;
+        if (range == e.cells)
+            return;
+        unlink(id);
+        e.cells = range;
+        link(id);
+    }
+
+    void remove(int id) {
+        if (!contains(id))
+            throw std::runtime_error("SpatialGrid::remove unknown id");
+        unlink(id);
+        entries[id].alive = false;
+        alive_count--;
+    }
+
+    /// Вызывает f(id) для каждого объекта, прямоугольник которого содержит точку (x, y)
+    template<class F>
+    void queryPoint(int x, int y, F &&f) const {
+        if (auto *ids = cell(cellOf(x), cellOf(y))) {
+            for (int id: *ids) {
+                if (entries[id].box.contains(x, y))
+                    f(id);
+            }
+        }
+        for (int id: large) {
+            if (entries[id].box.contains(x, y))
+                f(id);
+        }
+    }
+
+    /// Вызывает f(id) ровно один раз для каждого объекта, прямоугольник которого пересекает rect.
+    /// Повторы отсекаются без памяти: объект сообщается только из ячейки, где лежит угол пересечения.
+    template<class F>
+    void queryRect(const PixelRect &rect, F &&f) const {
+        if (rect.empty())
+            return;
+        PixelRect range = cellRange(rect);
+        if (int64_t(range.x1 - range.x0) * (range.y1 - range.y0) <= int64_t(cells.size())) {
+            for (int cy = range.y0; cy < range.y1; ++cy) {
+                for (int cx = range.x0; cx < range.x1; ++cx) {
+                    auto *ids = cell(cx, cy);
+                    if (ids == nullptr)
+                        continue;
+                    for (int id: *ids) {
+                        PixelRect common = entries[id].box.intersect(rect);
+                        if (!common.empty() && cellOf(common.x0) == cx && cellOf(common.y0) == cy)
+                            f(id);
+                    }
+                }
+            }
+        } else {
+            // запрос шире занятой части сетки: дешевле пройти по занятым ячейкам
+            for (auto &[k, ids]: cells) {
+                int cx = int(k >> 32), cy = int(int32_t(uint32_t(k)));
+                if (cx < range.x0 || cx >= range.x1 || cy < range.y0 || cy >= range.y1)
+                    continue;
+                for (int id: ids) {
+                    PixelRect common = entries[id].box.intersect(rect);
+                    if (!common.empty() && cellOf(common.x0) == cx && cellOf(common.y0) == cy)
+                        f(id);
+                }
+            }
+        }
+        for (int id: large) {
+            if (!entries[id].box.intersect(rect).empty())
+                f(id);
+        }
+    }
+
+    /// Вызывает f(id) для объектов, прямоугольник которых задевает отрезок a-b; ячейки обходятся
+    /// вдоль отрезка (Amanatides-Woo). Объект может быть сообщён несколько раз.
+    template<class F>
+    void querySegmentCells(const Vertex<int> &a, const Vertex<int> &b, F &&f) const {
+        PixelRect seg_box = {min(a.x, b.x), min(a.y, b.y), max(a.x, b.x) + 1, max(a.y, b.y) + 1};
+        auto visit = [&](int cx, int cy) {
+            if (auto *ids = cell(cx, cy)) {
+                for (int id: *ids) {
+                    if (!entries[id].box.intersect(seg_box).empty())
+                        f(id);
+                }
+            }
+        };
+        // точки отрезка: a + t (b - a), 0 <= t <= 1; ячейка c по x — полуинтервал [c * size, (c + 1) * size)
+        int cx = cellOf(a.x), cy = cellOf(a.y);
+        int remaining_x = abs(cellOf(b.x) - cx), remaining_y = abs(cellOf(b.y) - cy);
+        const double dx = b.x - a.x, dy = b.y - a.y;
+        const int step_x = dx > 0 ? 1 : -1, step_y = dy > 0 ? 1 : -1;
+        auto firstCrossing = [&](int c, int step, double start, double d) {
+            if (d == 0)
+                return numeric_limits<double>::infinity();
+            return (double(int64_t(step > 0 ? c + 1 : c) * cell_size) - start) / d;
+        };
+        double t_x = firstCrossing(cx, step_x, a.x, dx), t_y = firstCrossing(cy, step_y, a.y, dy);
+        const double dt_x = dx == 0 ? 0 : cell_size / abs(dx), dt_y = dy == 0 ? 0 : cell_size / abs(dy);
+        visit(cx, cy);
+        // число шагов известно заранее, поэтому ошибки округления не уводят обход мимо последней ячейки
+        while (remaining_x + remaining_y > 0) {
+            if (remaining_y == 0 || (remaining_x > 0 && t_x < t_y)) {
+                cx += step_x;
+                t_x += dt_x;
+                remaining_x--;
+            } else {
+                cy += step_y;
+                t_y += dt_y;
+                remaining_y--;
+            }
+            visit(cx, cy);
+        }
+        for (int id: large) {
+            if (!entries[id].box.intersect(seg_box).empty())
+                f(id);
+        }
+    }
+};
+
+/// Индекс многоугольников для запросов «какие многоугольники содержат точку / задевают тайл /
+/// пересекают отрезок». Многоугольники принадлежат вызывающему и должны жить дольше индекса;
+/// после move, scale или rotate многоугольника нужно вызвать update с его номером.
+class PolygonIndex {
+private:
+    vector<const Polyhedron *> polygons;
+    SpatialGrid grid;
+
+    static PixelRect boxOf(const Polyhedron &pol) {
+        if (pol.getSegments().empty())
+            throw std::runtime_error("PolygonIndex::add polygon is empty");
+        BoundingBox<int> box(pol.getSegments());
+        return {box.getXMin(), box.getYMin(), box.getXMax() + 1, box.getYMax() + 1};
+    }
+
+    /// Число оборотов с тем же соглашением, что PolygonHitTester: ребро считается при y_lo <= y < y_hi,
+    /// если точка лежит на нём или левее
+    static int winding(const Polyhedron &pol, const Vertex<int> &v) {
+        PAINTING_COUNT(EDGE_TESTS, pol.getSegments().size());
+        int w = 0;
+        for (auto &segm: pol.getSegments()) {
+            if (segm.a.y == segm.b.y)
+                continue;
+            bool up = segm.a.y < segm.b.y;
+            const Vertex<int> &lo = up ? segm.a : segm.b, &hi = up ? segm.b : segm.a;
+            if (lo.y <= v.y && v.y < hi.y &&
+                double(v.x - lo.x) * (hi.y - lo.y) - double(v.y - lo.y) * (hi.x - lo.x) >= 0)
+                w += up ? 1 : -1;
+        }
+        return w;
+    }
+
+    /// Знак поворота a -> b -> c в 64-битной арифметике: int переполняется уже при разностях ~46000
+    static int orientation(const Vertex<int> &a, const Vertex<int> &b, const Vertex<int> &c) {
+        long long s = (long long) (b.x - a.x) * (c.y - a.y) - (long long) (b.y - a.y) * (c.x - a.x);
+        return (s > 0) - (s < 0);
+    }
+
+    /// Пересекаются ли замкнутые отрезки ab и cd (касание тоже считается)
+    static bool segmentsTouch(const Vertex<int> &a, const Vertex<int> &b, const Vertex<int> &c, const Vertex<int> &d) {
+        PAINTING_COUNT(EDGE_TESTS, 1);
+        int abc = orientation(a, b, c), abd = orientation(a, b, d);
+        int cda = orientation(c, d, a), cdb = orientation(c, d, b);
+        if (abc == 0 && abd == 0 && cda == 0 && cdb == 0)  // на одной прямой
+            return isBoxIntersects(a.x, b.x, c.x, d.x) && isBoxIntersects(a.y, b.y, c.y, d.y);
+        return abc * abd <= 0 && cda * cdb <= 0;
+    }
+
+    void check(int id) const {
+        if (!grid.contains(id))
+            throw std::runtime_error("PolygonIndex unknown polygon id");
+    }
+
+public:
+    explicit PolygonIndex(int cell_size = 64) : grid(cell_size) {}
+
+    /// Номер нового многоугольника
+    int add(const Polyhedron &pol) {
+        int id = polygons.size();
+        grid.insert(id, boxOf(pol));
+        polygons.push_back(&pol);
+        return id;
+    }
+
+    /// Многоугольник id изменился: сетка перестраивается только в ячейках, которые он покинул или занял
+    void update(int id) {
+        check(id);
+        grid.update(id, boxOf(*polygons[id]));
+    }
+
+    void remove(int id) {
+        check(id);
+        grid.remove(id);
+        polygons[id] = nullptr;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return grid.size();
+    }
+
+    [[nodiscard]] const Polyhedron &operator[](int id) const {
+        check(id);
+        return *polygons[id];
+    }
+
+    [[nodiscard]] const SpatialGrid &getGrid() const {
+        return grid;
+    }
+
+    /// Многоугольники, содержащие точку v по правилу rule, — то же, что PolygonHitTester::contains
+    /// по всем многоугольникам; номера по возрастанию
+    [[nodiscard]] vector<int> containing(const Vertex<int> &v, FillRule rule = EVEN_ODD) const {
+        vector<int> res;
+        grid.queryPoint(v.x, v.y, [&](int id) {
+            int w = winding(*polygons[id], v);
+            if (rule == EVEN_ODD ? (w & 1) : w != 0)
+                res.push_back(id);
+        });
+        std::sort(res.begin(), res.end());
+        return res;
+    }
+
+    /// Многоугольники, ограничивающий прямоугольник которых задевает rect (например, тайл):
+    /// консервативный ответ для отсечения
+    [[nodiscard]] vector<int> touching(const PixelRect &rect) const {
+        vector<int> res;
+        grid.queryRect(rect, [&](int id) { res.push_back(id); });
+        std::sort(res.begin(), res.end());
+        return res;
+    }
+
+    /// Многоугольники, граница которых пересекает отрезок или внутри которых (по чётности) лежит его начало
+    [[nodiscard]] vector<int> crossing(const Segment<int> &line) const {
+        vector<int> candidates;
+        grid.querySegmentCells(line.a, line.b, [&](int id) { candidates.push_back(id); });
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+        vector<int> res;
+        for (int id: candidates) {
+            const Polyhedron &pol = *polygons[id];
+            bool hit = winding(pol, line.a) & 1;
+            for (auto &segm: pol.getSegments()) {
+                if (hit)
+                    break;
+                hit = segmentsTouch(segm.a, segm.b, line.a, line.b);
+            }
+            if (hit)
+                res.push_back(id);
+        }
+        return res;
+    }
+};
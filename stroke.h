@@ -0,0 +1,333 @@
+#pragma once
+
+#include "polyhedron.h"
+#include "boolean_ops.h"
+#include <span>
+
+/// Соединение звеньев ломаной
+enum LineJoin {
+    JOIN_MITER,
+    JOIN_ROUND,
+    JOIN_BEVEL,
+};
+
+/// Окончание незамкнутой ломаной
+enum LineCap {
+    CAP_BUTT,
+    CAP_ROUND,
+    CAP_SQUARE,
+};
+
+struct StrokeStyle {
+    double width = 1;
+    LineJoin join = JOIN_MITER;
+    LineCap cap = CAP_BUTT;
+    double miter_limit = 4;  /// наибольшее отношение длины острия к половине ширины, дальше — скос
+};
+
+/// Обводка линий заданной ширины. Каждое звено, соединение и окончание становится отдельным выпуклым
+/// многоугольником, обходимым против часовой стрелки; их объединение по правилу NON_ZERO и есть обводка.
+/// Многоугольники заливаются одной построчной заливкой, поэтому каждый пиксел пишется ровно один раз
+/// при любой ширине, а самопересечения ломаной не требуют отдельной обработки.
+/// Объект можно переиспользовать: после clear память остаётся для следующей обводки.
+class Stroker {
+private:
+    StrokeStyle style;
+    double half;
+    vector<Vertex<double>> points;  /// вершины всех многоугольников подряд
+    vector<int> offsets = {0};      /// многоугольник i — points[offsets[i]..offsets[i + 1])
+    vector<Vertex<double>> path;    /// текущая ломаная без повторяющихся точек
+
+    /// Отклонение многоугольника круга от окружности, в пикселах
+    static constexpr double ROUND_TOLERANCE = 0.25;
+
+    /// Шаг сетки, на которую округляется контур обводки для сглаживания: 1/64 пиксела
+    static constexpr int OUTLINE_SUBPIXELS = 64;
+
+    static Vertex<double> leftOf(const Vertex<double> &d) {
+        return {-d.y, d.x};
+    }
+
+    static double cross(const Vertex<double> &a, const Vertex<double> &b) {
+        return a.x * b.y - a.y * b.x;
+    }
+
+    static Vertex<double> direction(const Vertex<double> &from, const Vertex<double> &to) {
+        Vertex<double> d = to - from;
+        return d / d.mod();
+    }
+
+    /// Добавляет выпуклый многоугольник, разворачивая его против часовой стрелки
+    void addPiece(std::initializer_list<Vertex<double>> piece) {
+        size_t start = points.size();
+        points.insert(points.end(), piece.begin(), piece.end());
+        finishPiece(start);
+    }
+
+    void finishPiece(size_t start) {
+        double area = 0;
+        for (size_t i = start; i < points.size(); ++i) {
+            const auto &b = i + 1 < points.size() ? points[i + 1] : points[start];
+            area += cross(points[i], b);
+        }
+        if (area == 0) {
+            points.resize(start);
+            return;
+        }
+        if (area < 0)
+            std::reverse(points.begin() + start, points.end());
+        offsets.push_back(points.size());
+    }
+
+    void addDisk(const Vertex<double> &c) {
+        // шаг по углу, при котором хорда отходит от окружности не больше чем на ROUND_TOLERANCE
+        double step = half > ROUND_TOLERANCE ? 2 * acos(1 - ROUND_TOLERANCE / half) : M_PI / 2;
+        int n = max(8, int(ceil(2 * M_PI / step)));
+        size_t start = points.size();
+        for (int i = 0; i < n; ++i)
+            points.push_back(c + Vertex<double>(cos(2 * M_PI * i / n), sin(2 * M_PI * i / n)) * half);
+        finishPiece(start);
+    }
+
+    void addSegmentPiece(const Vertex<double> &a, const Vertex<double> &b) {
+        Vertex<double> n = leftOf(direction(a, b)) * half;
+        addPiece({a + n, b + n, b - n, a - n});
+    }
+
+    /// Соединение в вершине v звеньев с направлениями d0 (входящее) и d1 (исходящее)
+    void addJoin(const Vertex<double> &v, const Vertex<double> &d0, const Vertex<double> &d1) {
+        double turn = cross(d0, d1);
+        if (style.join == JOIN_ROUND) {
+            addDisk(v);
+            return;
+        }
+        if (turn == 0)
+            return;  // звенья на одной прямой: прямоугольники уже примыкают друг к другу
+        // внешняя сторона поворота
+        double s = turn > 0 ? -1 : 1;
+        Vertex<double> n0 = leftOf(d0) * (s * half), n1 = leftOf(d1) * (s * half);
+        if (style.join == JOIN_MITER) {
+            // cos половины угла между нормалями
+            double c = sqrt(max(0.0, (1 + d0.x * d1.x + d0.y * d1.y) / 2));
+            if (c > 0 && 1 / c <= style.miter_limit) {
+                Vertex<double> bisector = n0 + n1;
+                Vertex<double> tip = v + bisector / bisector.mod() * (half / c);
+                addPiece({v, v + n0, tip, v + n1});
+                return;
+            }
+        }
+        addPiece({v, v + n0, v + n1});
+    }
+
+    void addCap(const Vertex<double> &end, const Vertex<double> &outward) {
+        if (style.cap == CAP_ROUND) {
+            addDisk(end);
+        } else if (style.cap == CAP_SQUARE) {
+            Vertex<double> n = leftOf(outward) * half, e = outward * half;
+            addPiece({end + n, end + e + n, end + e - n, end - n});
+        }
+    }
+
+    /// Обводка ломаной из path
+    void strokePath(bool closed) {
+        if (closed && path.size() > 1 && path.back() == path.front())
+            path.pop_back();
+        if (path.empty())
+            return;
+        if (path.size() == 1) {
+            // точка: видны только окончания
+            if (style.cap == CAP_ROUND)
+                addDisk(path[0]);
+            else if (style.cap == CAP_SQUARE)
+                addPiece({path[0] + Vertex<double>(-half, -half), path[0] + Vertex<double>(half, -half),
+                          path[0] + Vertex<double>(half, half), path[0] + Vertex<double>(-half, half)});
+            return;
+        }
+        if (closed && path.size() == 2)
+            closed = false;
+
+        size_t n = path.size();
+        size_t segments = closed ? n : n - 1;
+        for (size_t i = 0; i < segments; ++i)
+            addSegmentPiece(path[i], path[(i + 1) % n]);
+        for (size_t i = closed ? 0 : 1; i < (closed ? n : n - 1); ++i) {
+            const auto &prev = path[(i + n - 1) % n], &next = path[(i + 1) % n];
+            addJoin(path[i], direction(prev, path[i]), direction(path[i], next));
+        }
+        if (!closed) {
+            addCap(path[0], direction(path[1], path[0]));
+            addCap(path[n - 1], direction(path[n - 2], path[n - 1]));
+        }
+    }
+
+public:
+    explicit Stroker(const StrokeStyle &_style = {}) {
+        setStyle(_style);
+    }
+
+    void setStyle(const StrokeStyle &_style) {
+        if (!(_style.width > 0))
+            throw std::runtime_error("Stroker::setStyle width must be positive");
+        if (_style.miter_limit < 1)
+            throw std::runtime_error("Stroker::setStyle miter limit is less than 1");
+        style = _style;
+        half = style.width / 2;
+    }
+
+    [[nodiscard]] const StrokeStyle &getStyle() const {
+        return style;
+    }
+
+    void clear() {
+        points.clear();
+        offsets.assign(1, 0);
+    }
+
+    /// Ломаная через polyline, замкнутая, если closed; совпадающие соседние точки пропускаются
+    template<typename T>
+    void addPolyline(const vector<Vertex<T>> &polyline, bool closed = false) {
+        path.clear();
+        for (auto &p: polyline) {
+            Vertex<double> v(p.x, p.y);
+            if (path.empty() || !(path.back() == v))
+                path.push_back(v);
+        }
+        strokePath(closed);
+    }
+
+    void addSegment(const Segment<int> &segm) {
+        addPolyline(vector<Vertex<int>>{segm.a, segm.b});
+    }
+
+    /// Граница многоугольника: рёбра, идущие друг за другом, обводятся одной ломаной с соединениями
+    void addPolyhedron(const Polyhedron &pol) {
+        auto &segments = pol.getSegments();
+        size_t i = 0;
+        while (i < segments.size()) {
+            vector<Vertex<int>> chain = {segments[i].a, segments[i].b};
+            size_t j = i + 1;
+            for (; j < segments.size() && segments[j].a == chain.back(); ++j)
+                chain.push_back(segments[j].b);
+            bool closed = chain.size() > 2 && chain.back() == chain.front();
+            addPolyline(chain, closed);
+            i = j;
+        }
+    }
+
+    /// Кривая Безье, разбитая на отрезки с той же точностью, что в drawBezierCurve
+    void addBezier(const vector<Vertex<int>> &control) {
+        if (control.empty())
+            return;
+        vector<Vertex<double>> polyline = {convertToDoubleVertex(control[0])};
+        flattenBezier(control, BEZIER_TOLERANCE, polyline);
+        addPolyline(polyline);
+    }
+
+    [[nodiscard]] size_t pieceCount() const {
+        return offsets.size() - 1;
+    }
+
+    /// Многоугольник i обводки, против часовой стрелки
+    [[nodiscard]] std::span<const Vertex<double>> piece(size_t i) const {
+        return {points.data() + offsets[i], size_t(offsets[i + 1] - offsets[i])};
+    }
+
+    /// Отрезки строк обводки: span(y, x_from, x_to) для [x_from, x_to), строки по возрастанию
+    template<class SpanFn>
+    void forEachSpan(SpanFn &&span) const {
+        // таблица рёбер переиспользуется между вызовами
+        static thread_local ScanlineFiller filler;
+        filler.clear();
+        for (size_t i = 0; i < pieceCount(); ++i) {
+            auto p = piece(i);
+            for (size_t k = 0; k < p.size(); ++k)
+                filler.addEdge(p[k], p[(k + 1) % p.size()]);
+        }
+        filler.fill(NON_ZERO, std::forward<SpanFn>(span));
+    }
+
+    template<RasterTarget Img>
+    void fill(Img &img, const Magick::Color &col) const {
+        PAINTING_SCOPE("Stroker::fill");
+        const auto pen = makePen(img, col);
+        const PixelRect clip = targetBounds(img);
+        forEachSpan([&](int y, int x_from, int x_to) {
+            if (y >= clip.y0 && y < clip.y1)
+                plotSpan(img, y, max(x_from, clip.x0), min(x_to, clip.x1), pen);
+        });
+    }
+
+    /// Сглаженная обводка. Куски перекрываются, а покрытие по NON_ZERO складывает доли пиксела,
+    /// поэтому сначала строится их объединение (booleanContours) на сетке в 1/64 пиксела:
+    /// края под соединениями и окончаниями закрашиваются так же, как вдоль звена.
+    /// Куски предварительно отсекаются областью холста, поэтому размер обводки не ограничен,
+    /// но холст — не больше SWEEP_COORD_LIMIT / 64 пикселов по стороне.
+    template<RasterTarget Img>
+    void fillAntialiased(Img &img, const Magick::Color &col) const {
+        if (points.empty())
+            return;
+        PAINTING_SCOPE("Stroker::fillAntialiased");
+        PixelRect area = {INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+        for (auto &p: points) {
+            area.x0 = min(area.x0, int(floor(p.x)));
+            area.y0 = min(area.y0, int(floor(p.y)));
+            area.x1 = max(area.x1, int(ceil(p.x)) + 2);
+            area.y1 = max(area.y1, int(ceil(p.y)) + 2);
+        }
+        area = area.intersect(targetBounds(img));
+        if (area.empty())
+            return;
+
+        static thread_local PolygonClipper clipper;
+        clipper.setRect(area);
+        vector<Polyhedron> outline;
+        vector<Segment<int>> segments;
+        for (size_t i = 0; i < pieceCount(); ++i) {
+            auto p = piece(i);
+            auto &clipped = clipper.clip(p.size(), [&](size_t k) { return p[k]; });
+            segments.clear();
+            Vertex<int> first, prev;
+            for (size_t k = 0; k < clipped.size(); ++k) {
+                Vertex<int> v(roundToInt((clipped[k].p.x - area.x0) * OUTLINE_SUBPIXELS),
+                              roundToInt((clipped[k].p.y - area.y0) * OUTLINE_SUBPIXELS));
+                if (k == 0)
+                    first = v;
+                else if (v != prev)
+                    segments.emplace_back(prev, v);
+                prev = v;
+            }
+            if (!clipped.empty() && prev != first)
+                segments.emplace_back(prev, first);
+            if (segments.size() >= 3)
+                outline.emplace_back(segments);
+        }
+
+        static thread_local CoverageAccumulator accumulator;
+        accumulator.reset(area);
+        auto toCanvas = [&](const Vertex<int> &v) {
+            return Vertex<double>(double(v.x) / OUTLINE_SUBPIXELS + area.x0, double(v.y) / OUTLINE_SUBPIXELS + area.y0);
+        };
+        for (auto &contour: booleanContours(outline, {}, BOOLEAN_UNION)) {
+            for (size_t k = 0; k < contour.size(); ++k)
+                accumulator.addEdge(toCanvas(contour[k]), toCanvas(contour[(k + 1) % contour.size()]));
+        }
+        fillCoverage(accumulator, NON_ZERO, img, col);
+    }
+};
+
+/// Толстая ломаная одним вызовом
+template<RasterTarget Img>
+void strokePolyline(const vector<Vertex<int>> &points, const StrokeStyle &style, Img &img, const Magick::Color &color,
+                    bool closed = false) {
+    static thread_local Stroker stroker;
+    stroker.setStyle(style);
+    stroker.clear();
+    stroker.addPolyline(points, closed);
+    stroker.fill(img, color);
+}
+
+template<RasterTarget Img>
+void strokeLine(const Vertex<int> &from, const Vertex<int> &to, const StrokeStyle &style, Img &img,
+                const Magick::Color &color) {
+    strokePolyline({from, to}, style, img, color);
+}
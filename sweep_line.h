@@ -0,0 +1,329 @@
+#pragma once
+
+#include "segment.h"
+#include <set>
+#include <map>
+#include <vector>
+#include <stdexcept>
+
+using int128 = __int128;
+
+/// Допустимый модуль координат: при нём все вычисления заметающей прямой точны в 128-битных целых
+const int SWEEP_COORD_LIMIT = 1 << 22;
+
+inline int128 gcd128(int128 a, int128 b) {
+    if (a < 0) a = -a;
+    if (b < 0) b = -b;
+    while (b != 0) {
+        int128 t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/// Точка с рациональными координатами (x / d, y / d), d > 0, дробь несократима
+struct ExactPoint {
+    int128 x = 0, y = 0, d = 1;
+
+    ExactPoint() = default;
+
+    ExactPoint(const Vertex<int> &v) : x(v.x), y(v.y), d(1) {}
+
+    ExactPoint(int128 _x, int128 _y, int128 _d) : x(_x), y(_y), d(_d) {
+        if (d < 0) {
+            x = -x;
+            y = -y;
+            d = -d;
+        }
+        int128 g = gcd128(gcd128(x, y), d);
+        if (g > 1) {
+            x /= g;
+            y /= g;
+            d /= g;
+        }
+    }
+
+    /// Лексикографический порядок: по x, затем по y
+    bool operator<(const ExactPoint &p) const {
+        int128 l = x * p.d, r = p.x * d;
+        if (l != r)
+            return l < r;
+        return y * p.d < p.y * d;
+    }
+
+    bool operator==(const ExactPoint &p) const {
+        return x == p.x && y == p.y && d == p.d;
+    }
+
+    [[nodiscard]] Vertex<double> toDouble() const {
+        return {double(x) / double(d), double(y) / double(d)};
+    }
+
+    [[nodiscard]] Vertex<int> round() const {
+        auto p = toDouble();
+        return {roundToInt(p.x), roundToInt(p.y)};
+    }
+};
+
+/// Точка, через которую проходят два или больше отрезков
+struct SegmentCrossing {
+    ExactPoint point;
+    vector<int> segments; /// индексы отрезков, содержащих точку
+};
+
+/// Точка пересечения двух непараллельных отрезков, если она есть
+inline bool crossingPoint(const Vertex<int> &a, const Vertex<int> &b, const Vertex<int> &c, const Vertex<int> &d,
+                          ExactPoint &point) {
+    PAINTING_COUNT(EDGE_TESTS, 1);
+    long long den = (long long) (b.x - a.x) * (d.y - c.y) - (long long) (b.y - a.y) * (d.x - c.x);
+    if (den == 0)
+        return false;
+    long long t = (long long) (c.x - a.x) * (d.y - c.y) - (long long) (c.y - a.y) * (d.x - c.x);
+    long long u = (long long) (c.x - a.x) * (b.y - a.y) - (long long) (c.y - a.y) * (b.x - a.x);
+    if (den < 0) {
+        den = -den;
+        t = -t;
+        u = -u;
+    }
+    if (t < 0 || t > den || u < 0 || u > den)
+        return false;
+    point = ExactPoint(int128(a.x) * den + int128(b.x - a.x) * t, int128(a.y) * den + int128(b.y - a.y) * t, den);
+    PAINTING_COUNT(INTERSECTIONS_FOUND, 1);
+    return true;
+}
+
+/// Заметающая прямая Бентли — Оттмана. Находит все точки, через которые проходят хотя бы два отрезка,
+/// за O((n + k) log n) в точной арифметике: события обрабатываются слева направо (при равных x — снизу вверх),
+/// порядок отрезков на прямой хранится в дереве.
+class SweepLine {
+private:
+    struct Item {
+        Vertex<int> p, q; /// p лексикографически меньше q
+        long long dx, dy;
+    };
+
+    /// Ордината отрезка на текущей вертикали, умноженная на знаменатель события: key / dx
+    struct Key {
+        int128 num;
+        long long dx;
+    };
+
+    struct StatusLess {
+        const SweepLine *sweep;
+        using is_transparent = void;
+
+        bool operator()(int s, int t) const {
+            return sweep->less(s, t);
+        }
+
+        bool operator()(int s, const ExactPoint &p) const {
+            return sweep->below(s, p);
+        }
+
+        bool operator()(const ExactPoint &p, int s) const {
+            return sweep->above(s, p);
+        }
+    };
+
+    using Status = set<int, StatusLess>;
+
+    vector<Item> items;
+    ExactPoint event;
+    Status status;
+    vector<Status::iterator> where;
+    map<ExactPoint, vector<int>> queue;
+
+    static bool lexLess(const Vertex<int> &a, const Vertex<int> &b) {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    }
+
+    [[nodiscard]] Key key(int s) const {
+        const Item &it = items[s];
+        if (it.dx == 0) {
+            // вертикальный отрезок занимает на прямой точку события, прижатую к его концам
+            int128 y = event.y;
+            y = max(y, int128(it.p.y) * event.d);
+            y = min(y, int128(it.q.y) * event.d);
+            return {y, 1};
+        }
+        return {int128(it.p.y) * event.d * it.dx + (event.x - int128(it.p.x) * event.d) * it.dy, it.dx};
+    }
+
+    static int compare(const Key &l, const Key &r) {
+        int128 a = l.num * r.dx, b = r.num * l.dx;
+        return a < b ? -1 : (a > b ? 1 : 0);
+    }
+
+    [[nodiscard]] int compareSlope(int s, int t) const {
+        const Item &l = items[s], &r = items[t];
+        if (l.dx == 0 || r.dx == 0)
+            return (l.dx == 0) - (r.dx == 0);
+        long long a = l.dy * r.dx, b = r.dy * l.dx;
+        return a < b ? -1 : (a > b ? 1 : 0);
+    }
+
+    [[nodiscard]] bool less(int s, int t) const {
+        Key ks = key(s), kt = key(t);
+        int c = compare(ks, kt);
+        if (c != 0)
+            return c < 0;
+        // общая точка на вертикали: если она уже пройдена, порядок как после неё (по возрастанию наклона)
+        int slope = compareSlope(s, t);
+        if (slope != 0) {
+            bool passed = ks.num <= event.y * ks.dx;
+            return passed ? slope < 0 : slope > 0;
+        }
+        return s < t;
+    }
+
+    [[nodiscard]] bool below(int s, const ExactPoint &p) const {
+        Key k = key(s);
+        return k.num < p.y * k.dx;
+    }
+
+    [[nodiscard]] bool above(int s, const ExactPoint &p) const {
+        Key k = key(s);
+        return k.num > p.y * k.dx;
+    }
+
+    [[nodiscard]] bool contains(int s, const ExactPoint &p) const {
+        Key k = key(s);
+        return k.num == p.y * k.dx;
+    }
+
+    void findNewEvent(int s, int t) {
+        ExactPoint p;
+        if (crossingPoint(items[s].p, items[s].q, items[t].p, items[t].q, p) && event < p) {
+            queue[p];
+            PAINTING_COUNT(MAP_LOOKUPS, 1);
+        }
+    }
+
+public:
+    explicit SweepLine(const vector<Segment<int>> &segments) : status(StatusLess{this}) {
+        items.resize(segments.size());
+        where.resize(segments.size(), status.end());
+        for (size_t i = 0; i < segments.size(); ++i) {
+            Vertex<int> a = segments[i].a, b = segments[i].b;
+            if (abs(a.x) > SWEEP_COORD_LIMIT || abs(a.y) > SWEEP_COORD_LIMIT ||
+                abs(b.x) > SWEEP_COORD_LIMIT || abs(b.y) > SWEEP_COORD_LIMIT)
+                throw std::runtime_error("SweepLine::Constructor coordinates are out of range");
+            if (lexLess(b, a))
+                swap(a, b);
+            items[i] = {Vertex<int>(a.x, a.y), Vertex<int>(b.x, b.y), b.x - a.x, b.y - a.y};
+            if (a.x == b.x && a.y == b.y)
+                continue; // вырожденный отрезок не участвует
+            queue[ExactPoint(items[i].p)].push_back(i);
+            queue[ExactPoint(items[i].q)];
+        }
+    }
+
+    /// Для каждой точки, через которую проходят хотя бы два отрезка, вызывает on_crossing(point, segments).
+    /// Если on_crossing возвращает false, обход прекращается.
+    template<class F>
+    void run(F &&on_crossing) {
+        PAINTING_SCOPE("SweepLine::run");
+        vector<int> upper, passing, ending;
+        while (!queue.empty()) {
+            auto node = queue.begin();
+            event = node->first;
+            upper.swap(node->second);
+            queue.erase(node);
+
+            // отрезки, содержащие событие, идут в дереве подряд
+            passing.clear();
+            ending.clear();
+            for (auto it = status.lower_bound(event); it != status.end() && contains(*it, event); ++it) {
+                if (ExactPoint(items[*it].q) == event)
+                    ending.push_back(*it);
+                else
+                    passing.push_back(*it);
+            }
+
+            if (upper.size() + passing.size() + ending.size() >= 2) {
+                vector<int> all;
+                all.reserve(upper.size() + passing.size() + ending.size());
+                all.insert(all.end(), upper.begin(), upper.end());
+                all.insert(all.end(), passing.begin(), passing.end());
+                all.insert(all.end(), ending.begin(), ending.end());
+                if (!on_crossing(static_cast<const ExactPoint &>(event), static_cast<const vector<int> &>(all)))
+                    return;
+            }
+
+            for (int s: ending)
+                status.erase(where[s]);
+            for (int s: passing)
+                status.erase(where[s]);
+            // после события порядок проходящих через него отрезков определяется наклоном
+            for (int s: upper)
+                where[s] = status.insert(s).first;
+            for (int s: passing)
+                where[s] = status.insert(s).first;
+
+            size_t inserted = upper.size() + passing.size();
+            auto first = status.lower_bound(event);
+            if (inserted == 0) {
+                if (first != status.end() && first != status.begin())
+                    findNewEvent(*prev(first), *first);
+                continue;
+            }
+            auto last = next(first, inserted - 1);
+            if (first != status.begin())
+                findNewEvent(*prev(first), *first);
+            if (next(last) != status.end())
+                findNewEvent(*last, *next(last));
+        }
+    }
+
+    /// Все точки пересечения отрезков
+    vector<SegmentCrossing> crossings() {
+        vector<SegmentCrossing> ans;
+        run([&](const ExactPoint &p, const vector<int> &segments) {
+            ans.push_back({p, segments});
+            return true;
+        });
+        return ans;
+    }
+};
+
+/// Соседние рёбра замкнутой ломаной из n рёбер
+inline bool isAdjacentEdge(int i, int j, int n) {
+    int diff = abs(i - j);
+    return diff == 1 || diff == n - 1;
+}
+
+/// Есть ли среди отрезков, проходящих через точку, пара несоседних рёбер ломаной
+inline bool hasNonAdjacentPair(const vector<int> &segments, int n) {
+    for (size_t i = 0; i < segments.size(); ++i) {
+        for (size_t j = i + 1; j < segments.size(); ++j) {
+            if (!isAdjacentEdge(segments[i], segments[j], n))
+                return true;
+        }
+    }
+    return false;
+}
+
+/// Пересекаются ли несоседние рёбра замкнутой ломаной. Обход останавливается на первом пересечении,
+/// поэтому для простого полигона время O(n log n).
+inline bool hasSelfCrossings(const vector<Segment<int>> &segments) {
+    int n = segments.size();
+    bool found = false;
+    SweepLine(segments).run([&](const ExactPoint &, const vector<int> &ids) {
+        found = hasNonAdjacentPair(ids, n);
+        return !found;
+    });
+    return found;
+}
+
+/// Все точки самопересечения замкнутой ломаной (вершины, где сходятся только соседние рёбра, не считаются)
+inline vector<SegmentCrossing> findSelfCrossings(const vector<Segment<int>> &segments) {
+    int n = segments.size();
+    vector<SegmentCrossing> ans;
+    SweepLine(segments).run([&](const ExactPoint &p, const vector<int> &ids) {
+        if (hasNonAdjacentPair(ids, n))
+            ans.push_back({p, ids});
+        return true;
+    });
+    return ans;
+}
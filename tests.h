@@ -4,7 +4,22 @@
 #include <utility>
 #include <vector>
 #include <cassert>
+#include <random>
+#include <set>
+#include <sstream>
 #include "polyhedron.h"
+#include "clipping.h"
+#include "hit_test.h"
+#include "tile_renderer.h"
+#include "animation.h"
+#include "kuboid.h"
+#include "zbuffer.h"
+#include "scene.h"
+#include "polygon_store.h"
+#include "spatial_index.h"
+#include "arc.h"
+#include "stroke.h"
+#include "boolean_ops.h"
 #include <Magick++.h>
 
 template<class T>
@@ -87,10 +102,1747 @@ void TestIsSimple() {
     assert(pol2.IsSimple() == false);
 }
 
+/// Сравнивает построчную заливку с попиксельными проверками isInside* во всех точках,
+/// для которых луч проверки не проходит через вершины и которые не лежат на границе
+void TestScanlineFill() {
+    vector<Vertex<int>> points = {{150, 200},
+                                  {460, 350},
+                                  {100, 350},
+                                  {400, 200},
+                                  {250, 460}};
+    Polyhedron pol(points);
+    auto segments = pol.getSegments();
+
+    for (FillRule rule: {EVEN_ODD, NON_ZERO}) {
+        ScanlineFiller filler;
+        filler.addSegments(segments);
+        map<pair<int, int>, int> covered;
+        filler.fill(rule, [&](int y, int x_from, int x_to) {
+            for (int x = x_from; x < x_to; ++x)
+                covered[{x, y}]++;
+        });
+
+        for (int x = 90; x < 470; ++x) {
+            for (int y = 190; y < 470; ++y) {
+                Vertex<int> v(x, y);
+                Vertex<int> end = rule == EVEN_ODD ? Vertex<int>(0, y - 10) : Vertex<int>(0, y);
+                bool ambiguous = false;
+                for (auto &segm: segments) {
+                    ambiguous |= segm.isInside(v);
+                    ambiguous |= area(end - v, segm.a - v) == 0;
+                }
+                if (ambiguous)
+                    continue;
+
+                bool expected = rule == EVEN_ODD ? pol.isInsideEvenOddRule(v) : pol.isInsideNonZeroWinding(v);
+                assert(covered[make_pair(x, y)] == (expected ? 1 : 0));
+            }
+        }
+    }
+}
+
+/// Canvas должен получать те же пикселы, что и Magick::Image
+void TestCanvasMatchesImage() {
+    const Magick::Color white(QuantumRange, QuantumRange, QuantumRange);
+    const Magick::Color blue(0, 0, QuantumRange);
+    const Magick::Color black(0, 0, 0);
+
+    Canvas canvas(120, 100, white);
+    Magick::Image img("120x100", white);
+    vector<Vertex<int>> points = {{10, 10},
+                                  {110, 40},
+                                  {20, 90},
+                                  {60, 5}};
+    Polyhedron pol(points);
+    pol.fillWithNonZeroWinding(canvas, blue);
+    pol.fillWithNonZeroWinding(img, blue);
+    pol.drawBounds(canvas, black);
+    pol.drawBounds(img, black);
+    drawLine(0, 50, 119, 70, canvas, black);
+    drawLine(0, 50, 119, 70, img, black);
+
+    for (int y = 0; y < canvas.getHeight(); ++y) {
+        for (int x = 0; x < canvas.getWidth(); ++x)
+            assert(canvas.getPixel(x, y) == Canvas::pack(img.pixelColor(x, y)));
+    }
+}
+
+/// Перебор всех пар несоседних рёбер, как в исходной реализации IsSimple
+bool isSimpleBruteForce(const vector<Segment<int>> &segments) {
+    int n = segments.size();
+    for (int i = 0; i < n; ++i) {
+        for (int j = i + 1; j < n; ++j) {
+            if (!isAdjacentEdge(i, j, n) && intersectSegment(segments[i], segments[j]).first)
+                return false;
+        }
+    }
+    return true;
+}
+
+void TestSweepLine() {
+    mt19937 gen(42);
+
+    // мелкая сетка даёт много вырожденных случаев: общие вершины, вертикали, наложения
+    for (int iter = 0; iter < 3000; ++iter) {
+        int n = 3 + gen() % 8;
+        vector<Vertex<int>> points;
+        while ((int) points.size() < n) {
+            Vertex<int> v(gen() % 8, gen() % 8);
+            if (!points.empty() && points.back() == v)
+                continue;
+            points.push_back(v);
+        }
+        if (points.back() == points[0])
+            continue;
+        vector<Segment<int>> segments;
+        for (int i = 0; i < n; ++i)
+            segments.emplace_back(points[i], points[(i + 1) % n]);
+
+        assert(!hasSelfCrossings(segments) == isSimpleBruteForce(segments));
+    }
+
+    for (int iter = 0; iter < 300; ++iter) {
+        vector<Segment<int>> segments;
+        for (int i = 0; i < 25; ++i) {
+            Vertex<int> a(gen() % 40, gen() % 40), b(gen() % 40, gen() % 40);
+            if (a != b)
+                segments.emplace_back(a, b);
+        }
+
+        bool collinear = false;
+        map<ExactPoint, set<int>> expected;
+        for (int i = 0; i < (int) segments.size(); ++i) {
+            for (int j = i + 1; j < (int) segments.size(); ++j) {
+                auto check = intersectSegment(segments[i], segments[j]);
+                collinear |= check.first && check.second == COLLINEAR;
+                ExactPoint p;
+                if (crossingPoint(segments[i].a, segments[i].b, segments[j].a, segments[j].b, p)) {
+                    expected[p].insert(i);
+                    expected[p].insert(j);
+                }
+            }
+        }
+        if (collinear)
+            continue;
+
+        auto found = SweepLine(segments).crossings();
+        assert(found.size() == expected.size());
+        for (auto &crossing: found) {
+            set<int> ids(crossing.segments.begin(), crossing.segments.end());
+            assert(ids.size() == crossing.segments.size());
+            assert(expected[crossing.point] == ids);
+        }
+    }
+}
+
+void TestOuterContour() {
+    // бантик: контур проходит через точку пересечения дважды
+    vector<Vertex<int>> bow = {{20,  20},
+                               {280, 280},
+                               {20,  280},
+                               {280, 20}};
+    auto contour = outerContour(Polyhedron(bow).getSegments());
+    assert(contour.size() == 6);
+    assert(std::count(contour.begin(), contour.end(), Vertex<int>(150, 150)) == 2);
+
+    // звезда: пять вершин и пять точек пересечения
+    vector<Vertex<int>> star = {{150, 200},
+                                {460, 350},
+                                {100, 350},
+                                {400, 200},
+                                {250, 460}};
+    contour = outerContour(Polyhedron(star).getSegments());
+    assert(contour.size() == 10);
+    for (auto &v: star)
+        assert(std::find(contour.begin(), contour.end(), v) != contour.end());
+    assert(Polyhedron(contour).IsSimple());
+
+    // у простого полигона внешний контур совпадает с ним самим
+    vector<Vertex<int>> simple = {{50,  50},
+                                  {100, 20},
+                                  {150, 200},
+                                  {300, 300},
+                                  {350, 450},
+                                  {200, 300}};
+    contour = outerContour(Polyhedron(simple).getSegments());
+    assert(contour.size() == simple.size());
+    for (auto &v: simple)
+        assert(std::find(contour.begin(), contour.end(), v) != contour.end());
+}
+
+void TestConvexClipper() {
+    vector<Vertex<int>> points = {{50,  50},
+                                  {100, 20},
+                                  {250, 200},
+                                  {300, 300},
+                                  {350, 450},
+                                  {200, 300}};
+    Polyhedron window(points);
+    window.move({1000, 500});
+    window.scale(3);
+    ConvexClipper clipper(window);
+
+    mt19937 gen(7);
+    vector<Segment<int>> lines;
+    for (int i = 0; i < 1000; ++i)
+        lines.emplace_back(Vertex<int>(gen() % 2560, gen() % 1440), Vertex<int>(gen() % 2560, gen() % 1440));
+    // отрезок, параллельный стороне и лежащий снаружи, отбрасывается целиком
+    auto &side = window.getSegments()[0];
+    lines.emplace_back(side.a - side.n * 10, side.b - side.n * 10);
+
+    vector<Segment<int>> clipped(lines.size());
+    size_t visible = clipper.clip(lines, clipped);
+    assert(visible > 0 && visible < lines.size());
+    assert(clipped.back().a == clipped.back().b);
+
+    for (size_t i = 0; i + 1 < lines.size(); ++i) {
+        auto expected = cyrusBeckClipLine(lines[i], window);
+        assert(abs(expected.a.x - clipped[i].a.x) <= 1 && abs(expected.a.y - clipped[i].a.y) <= 1);
+        assert(abs(expected.b.x - clipped[i].b.x) <= 1 && abs(expected.b.y - clipped[i].b.y) <= 1);
+    }
+}
+
+/// Заливка с отсечением окном холста совпадает с заливкой без отсечения пиксел в пиксел
+void TestPolygonClipper() {
+    const int width = 200, height = 150;
+    const Canvas::Pixel white = Canvas::packRGB(255, 255, 255), black = Canvas::packRGB(0, 0, 0);
+    mt19937 gen(25);
+    uniform_int_distribution<int> coord(-3000, 3000);
+    for (int round = 0; round < 60; ++round) {
+        vector<Vertex<int>> points;
+        for (int i = 0; i < 3 + round % 7; ++i)
+            points.emplace_back(coord(gen) / (round % 3 + 1), coord(gen) / (round % 3 + 1));
+        Polyhedron pol(points);
+        for (FillRule rule: {EVEN_ODD, NON_ZERO}) {
+            Canvas expected(width, height, Magick::Color("white"));
+            ScanlineFiller filler;
+            filler.addSegments(pol.getSegments());
+            filler.fill(rule, [&](int y, int x_from, int x_to) {
+                plotSpan(expected, y, x_from, x_to, black);
+            });
+            Canvas actual(width, height, Magick::Color("white"));
+            pol.fill(actual, Magick::Color(0, 0, 0), rule);
+            assert(memcmp(expected.data(), actual.data(), sizeof(Canvas::Pixel) * width * height) == 0);
+
+            // окно меньше холста: снаружи ничего не меняется
+            PixelRect rect = {30, 20, 170, 110};
+            Canvas partial(width, height, Magick::Color("white"));
+            CanvasView view(partial, rect);
+            pol.fill(view, Magick::Color(0, 0, 0), rule);
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x)
+                    assert(partial.getPixel(x, y) == (rect.contains(x, y) ? expected.getPixel(x, y) : white));
+            }
+        }
+    }
+
+    // многоугольник целиком за холстом не даёт ни одного ребра
+    PolygonClipper clipper(PixelRect{0, 0, width, height});
+    ScanlineFiller filler;
+    clipper.addContour(filler, {{-500, 10}, {-100, 40}, {-300, 400}});
+    assert(filler.empty());
+
+    // выпуклое окно: внутри окна заливка та же, снаружи пусто
+    vector<Vertex<int>> window = {{20, 10}, {180, 40}, {150, 140}, {40, 120}};
+    clipper.setWindow(window);
+    auto insideWindow = [&](int x, int y, bool &on_side) {
+        on_side = false;
+        bool inside = true;
+        for (size_t i = 0; i < window.size(); ++i) {
+            const auto &a = window[i], &b = window[(i + 1) % window.size()];
+            long long side = (long long) (b.x - a.x) * (y - a.y) - (long long) (b.y - a.y) * (x - a.x);
+            on_side |= side == 0;
+            inside &= side > 0;
+        }
+        return inside;
+    };
+    for (int round = 0; round < 20; ++round) {
+        vector<Vertex<int>> points;
+        for (int i = 0; i < 5 + round % 4; ++i)
+            points.emplace_back(coord(gen) / 10 + 100, coord(gen) / 10 + 75);
+        Polyhedron pol(points);
+        Canvas expected(width, height, Magick::Color("white"));
+        pol.fill(expected, Magick::Color(0, 0, 0), NON_ZERO);
+        filler.clear();
+        clipper.addContour(filler, points);
+        Canvas actual(width, height, Magick::Color("white"));
+        filler.fill(NON_ZERO, [&](int y, int x_from, int x_to) {
+            plotSpan(actual, y, x_from, x_to, black);
+        });
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                bool on_side;
+                bool inside = insideWindow(x, y, on_side);
+                if (!on_side)
+                    assert(actual.getPixel(x, y) == (inside ? expected.getPixel(x, y) : white));
+            }
+        }
+    }
+
+    bool thrown = false;
+    try {
+        clipper.setWindow({{0, 0}, {100, 0}, {50, 10}, {100, 100}});
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+/// Пакетная проверка точек должна совпадать с построчной заливкой
+void TestPolygonHitTester() {
+    vector<Vertex<int>> points = {{150, 200},
+                                  {460, 350},
+                                  {100, 350},
+                                  {400, 200},
+                                  {250, 460}};
+    auto segments = Polyhedron(points).getSegments();
+    PolygonHitTester tester(segments);
+
+    vector<int> xs, ys;
+    for (int y = 190; y < 470; ++y) {
+        for (int x = 90; x < 470; ++x) {
+            xs.push_back(x);
+            ys.push_back(y);
+        }
+    }
+
+    for (FillRule rule: {EVEN_ODD, NON_ZERO}) {
+        vector<uint8_t> inside(xs.size());
+        tester.contains(xs.size(), xs.data(), ys.data(), inside.data(), rule);
+
+        vector<uint8_t> expected(xs.size(), 0);
+        ScanlineFiller filler;
+        filler.addSegments(segments);
+        filler.fill(rule, [&](int y, int x_from, int x_to) {
+            for (int x = x_from; x < x_to; ++x)
+                expected[(y - 190) * 380 + (x - 90)] = 1;
+        });
+        assert(inside == expected);
+    }
+}
+
+/// Расстояние от точки до ломаной
+double distToPolyline(const Vertex<double> &v, const Vertex<double> &start, const vector<Vertex<double>> &polyline) {
+    double best = dist(v, start);
+    Vertex<double> a = start;
+    for (auto &b: polyline) {
+        Vertex<double> ab = b - a;
+        double t = ab.mod2() > 0 ? std::clamp(((v - a) * ab) / ab.mod2(), 0.0, 1.0) : 0.0;
+        best = min(best, dist(v, a + ab * t));
+        a = b;
+    }
+    return best;
+}
+
+void TestBezierFlattening() {
+    array<Vertex<double>, 4> cubic = {Vertex<double>(200, 400), Vertex<double>(500, 200),
+                                      Vertex<double>(100, 200), Vertex<double>(400, 400)};
+    vector<Vertex<double>> tmp(4);
+    for (double tolerance: {0.1, 0.25, 1.0}) {
+        vector<Vertex<double>> polyline;
+        flattenBezier<3>(cubic, tolerance, polyline);
+        assert(polyline.back() == cubic[3]);
+        for (int i = 0; i <= 1000; ++i) {
+            auto p = bezierPoint(cubic.data(), cubic.size(), i / 1000.0, tmp.data());
+            assert(distToPolyline(p, cubic[0], polyline) <= tolerance + 1e-9);
+        }
+    }
+
+    // крупная кривая разбивается мельче, маленькая — на пару отрезков
+    vector<Vertex<double>> small, big;
+    flattenBezier<3>({Vertex<double>(0, 0), Vertex<double>(2, 3), Vertex<double>(4, 3), Vertex<double>(6, 0)},
+                     BEZIER_TOLERANCE, small);
+    flattenBezier<3>({Vertex<double>(0, 0), Vertex<double>(2000, 3000), Vertex<double>(4000, 3000),
+                      Vertex<double>(6000, 0)}, BEZIER_TOLERANCE, big);
+    assert(small.size() <= 4);
+    assert(big.size() > 20 * small.size());
+
+    // общий путь: прямая, квадратичная кривая, де Кастельжо на стеке и в куче
+    auto check_general = [](const vector<Vertex<int>> &points) {
+        vector<Vertex<double>> control, polyline, buffer(points.size());
+        for (const auto &v: points)
+            control.push_back(convertToDoubleVertex(v));
+        flattenBezier(points, BEZIER_TOLERANCE, polyline);
+        assert(polyline.back() == control.back());
+        for (int i = 0; i <= 1000; ++i) {
+            auto p = bezierPoint(control.data(), control.size(), i / 1000.0, buffer.data());
+            assert(distToPolyline(p, control[0], polyline) <= BEZIER_TOLERANCE + 1e-9);
+        }
+    };
+    check_general({{10, 20}, {300, 150}});
+    check_general({{10, 20}, {300, 400}, {500, 0}});
+    check_general({{200, 400}, {500, 200}, {100, 200}, {400, 400}, {0, 0}});
+    vector<Vertex<int>> many;
+    for (int i = 0; i < int(BEZIER_MAX_POINTS) + 4; ++i)
+        many.emplace_back(i * 40, i % 3 == 0 ? 0 : i % 3 == 1 ? 500 : 200);
+    check_general(many);
+}
+
+void TestThreadPool() {
+    // parallelFor внутри задачи того же пула: ждёт только свои задачи, даже когда поток один
+    for (size_t threads: {1, 4}) {
+        ThreadPool pool(threads);
+        ThreadPool::TaskGroup outer;
+        atomic<int> sum = 0;
+        for (int k = 0; k < 3; ++k) {
+            pool.submit(outer, [&] {
+                pool.parallelFor(4, [&](size_t i) { sum += int(i) + 1; });
+            });
+        }
+        pool.wait(outer);
+        assert(outer.done() && sum == 30);
+    }
+
+    // ожидание группы не ждёт посторонней задачи, занявшей поток
+    ThreadPool pool(2);
+    atomic<bool> release = false, started = false;
+    pool.submit([&] {
+        started = true;
+        while (!release)
+            this_thread::yield();
+    });
+    while (!started)
+        this_thread::yield();
+    atomic<int> count = 0;
+    pool.parallelFor(16, [&](size_t) { count++; });
+    assert(count == 16);
+    release = true;
+    pool.wait();
+
+    bool thrown = false;
+    ThreadPool::TaskGroup group;
+    pool.submit(group, [&] {
+        try {
+            pool.wait();
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+    });
+    pool.wait(group);
+    assert(thrown);
+}
+
+void TestTileRenderer() {
+    const Magick::Color white(QuantumRange, QuantumRange, QuantumRange);
+    mt19937 gen(17);
+    uniform_int_distribution<int> coord(-40, 340), channel(0, 255);
+    auto randomColor = [&] {
+        return Magick::Color(channel(gen) * QuantumRange / 255, channel(gen) * QuantumRange / 255,
+                             channel(gen) * QuantumRange / 255);
+    };
+
+    Canvas serial(300, 200, white), tiled(300, 200, white);
+    TileRenderer renderer(32);
+    for (int k = 0; k < 40; ++k) {
+        vector<Vertex<int>> points;
+        for (int i = 0; i < 3 + k % 5; ++i)
+            points.emplace_back(coord(gen), coord(gen) * 2 / 3);
+        Polyhedron pol(points);
+        auto col = randomColor();
+        FillRule rule = k % 2 ? NON_ZERO : EVEN_ODD;
+        switch (k % 4) {
+            case 0:
+            case 1:
+                pol.fill(serial, col, rule);
+                renderer.addFill(pol, rule, col);
+                break;
+            case 2:
+                pol.drawBounds(serial, col);
+                renderer.addBounds(pol, col);
+                break;
+            case 3:
+                drawBezierCurve(points, serial, col);
+                renderer.addBezier(points, col);
+                break;
+        }
+    }
+
+    ThreadPool pool(4);
+    renderer.render(tiled, pool);
+    assert(memcmp(serial.data(), tiled.data(), sizeof(Canvas::Pixel) * 300 * 200) == 0);
+
+    // повторная отрисовка тем же пулом даёт тот же результат
+    tiled.clear(Canvas::pack(white));
+    renderer.render(tiled, pool);
+    assert(memcmp(serial.data(), tiled.data(), sizeof(Canvas::Pixel) * 300 * 200) == 0);
+}
+
+/// Разбор GIF, записанного GifWriter: кадры в виде пикселов, первая строка файла — первая в векторе.
+/// Частичный кадр накладывается на предыдущий, как при показе.
+vector<vector<Canvas::Pixel>> decodeGif(const string &filename) {
+    ifstream in(filename, ios::binary);
+    vector<uint8_t> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    assert(data.size() > 13 && memcmp(data.data(), "GIF89a", 6) == 0);
+    int width = data[6] | (data[7] << 8), height = data[8] | (data[9] << 8);
+    size_t pos = 13;
+    auto skipBlocks = [&] {
+        while (data[pos] != 0)
+            pos += data[pos] + 1;
+        pos++;
+    };
+
+    vector<vector<Canvas::Pixel>> frames;
+    while (data[pos] != 0x3B) {
+        if (data[pos] == 0x21) {
+            pos += 2;
+            skipBlocks();
+            continue;
+        }
+        assert(data[pos] == 0x2C);
+        int left = data[pos + 1] | (data[pos + 2] << 8), top = data[pos + 3] | (data[pos + 4] << 8);
+        int w = data[pos + 5] | (data[pos + 6] << 8), h = data[pos + 7] | (data[pos + 8] << 8);
+        assert(left + w <= width && top + h <= height);
+        assert(!frames.empty() || (w == width && h == height));
+        int flags = data[pos + 9];
+        pos += 10;
+        vector<Canvas::Pixel> palette;
+        for (int i = 0; i < (2 << (flags & 7)); ++i, pos += 3)
+            palette.push_back(Canvas::packRGB(data[pos], data[pos + 1], data[pos + 2]));
+
+        int min_code_size = data[pos++];
+        vector<uint8_t> bytes;
+        while (data[pos] != 0) {
+            bytes.insert(bytes.end(), data.begin() + pos + 1, data.begin() + pos + 1 + data[pos]);
+            pos += data[pos] + 1;
+        }
+        pos++;
+
+        const int clear_code = 1 << min_code_size, end_code = clear_code + 1;
+        vector<vector<uint8_t>> dict;
+        int code_size = 0, prev = -1;
+        size_t bit = 0;
+        vector<Canvas::Pixel> frame = frames.empty() ? vector<Canvas::Pixel>(size_t(width) * height) : frames.back();
+        size_t decoded = 0;
+        while (true) {
+            int code = 0;
+            for (int i = 0; i < (code_size ? code_size : min_code_size + 1); ++i, ++bit)
+                code |= ((bytes[bit / 8] >> (bit % 8)) & 1) << i;
+            if (code == clear_code) {
+                dict.clear();
+                for (int i = 0; i < clear_code + 2; ++i)
+                    dict.push_back({uint8_t(i)});
+                code_size = min_code_size + 1;
+                prev = -1;
+                continue;
+            }
+            if (code == end_code)
+                break;
+            vector<uint8_t> entry;
+            if (code < int(dict.size())) {
+                entry = dict[code];
+                if (prev >= 0) {
+                    dict.push_back(dict[prev]);
+                    dict.back().push_back(entry[0]);
+                }
+            } else {
+                assert(code == int(dict.size()) && prev >= 0);
+                entry = dict[prev];
+                entry.push_back(entry[0]);
+                dict.push_back(entry);
+            }
+            if (int(dict.size()) == (1 << code_size) && code_size < 12)
+                code_size++;
+            for (uint8_t index: entry) {
+                assert(decoded < size_t(w) * h);
+                frame[size_t(top + decoded / w) * width + left + decoded % w] = palette[index];
+                decoded++;
+            }
+            prev = code;
+        }
+        assert(decoded == size_t(w) * h);
+        frames.push_back(std::move(frame));
+    }
+    return frames;
+}
+
+void TestGifWriter() {
+    const string filename = "test_gif_writer.gif";
+    mt19937 gen(9);
+    uniform_int_distribution<int> channel(0, 255);
+
+    // 200 цветов: палитра точная, а словарь LZW переполняется и сбрасывается много раз
+    Canvas noise(160, 120), smooth(160, 120);
+    vector<Canvas::Pixel> colors;
+    for (int i = 0; i < 200; ++i)
+        colors.push_back(Canvas::packRGB(channel(gen), channel(gen), channel(gen)));
+    for (int y = 0; y < noise.getHeight(); ++y) {
+        for (int x = 0; x < noise.getWidth(); ++x) {
+            noise.setPixel(x, y, colors[channel(gen) % colors.size()]);
+            smooth.setPixel(x, y, Canvas::packRGB(x, y * 2, (x + y) % 256));
+        }
+    }
+    {
+        GifWriter writer(filename, 160, 120);
+        writer.addFrame(noise);
+        writer.addFrame(smooth);
+    }
+    auto frames = decodeGif(filename);
+    assert(frames.size() == 2);
+    for (int y = 0; y < 120; ++y) {
+        for (int x = 0; x < 160; ++x) {
+            // строки записаны снизу вверх
+            assert(frames[0][(119 - y) * 160 + x] == noise.getPixel(x, y));
+            // больше 256 цветов — квантование, ошибка не больше половины шага
+            auto expected = Canvas::unpack(smooth.getPixel(x, y));
+            auto actual = Canvas::unpack(frames[1][(119 - y) * 160 + x]);
+            for (int c = 0; c < 3; ++c)
+                assert(abs(expected[c] - actual[c]) <= 26);
+        }
+    }
+
+    // параллельная отрисовка пишет тот же файл, что и последовательная
+    auto drawFrame = [](int i, Canvas &canvas) {
+        Polyhedron pol(vector<Vertex<int>>{{10, 10}, {150, 20 + 4 * i}, {80, 110}});
+        pol.fillWithEvenOddRule(canvas, Magick::Color(0, 0, QuantumRange));
+    };
+    vector<uint8_t> serial;
+    {
+        GifWriter writer(filename, 160, 120);
+        for (int i = 0; i < 20; ++i) {
+            Canvas canvas(160, 120);
+            drawFrame(i, canvas);
+            writer.addFrame(canvas);
+        }
+    }
+    {
+        ifstream in(filename, ios::binary);
+        serial.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    {
+        ThreadPool pool(4);
+        GifWriter writer(filename, 160, 120);
+        renderAnimation(20, drawFrame, writer, pool, Magick::Color("white"), 3);
+    }
+    ifstream in(filename, ios::binary);
+    vector<uint8_t> parallel((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    assert(serial == parallel);
+    assert(decodeGif(filename).size() == 20);
+    remove(filename.c_str());
+}
+
+/// Грани куба со стороной a и углом в (x, y, z), как в plotAnimation
+array<array<Vertex<int>, 4>, 6> cubeFaces(int x, int y, int z, int a) {
+    vector<Vertex<int>> low = {{x, y, z}, {x + a, y, z}, {x + a, y + a, z}, {x, y + a, z}};
+    vector<Vertex<int>> high = low;
+    for (auto &v: high)
+        v.z = z + a;
+    array<array<Vertex<int>, 4>, 6> faces;
+    faces[4] = {low[0], low[1], low[2], low[3]};
+    faces[5] = {high[0], high[1], high[2], high[3]};
+    for (int i = 0; i < 4; i++)
+        faces[i] = {low[i], low[(i + 1) % 4], high[(i + 1) % 4], high[i]};
+    return faces;
+}
+
+void TestTransform() {
+    Vertex<double> center(10, -20, 30);
+    vector<Vertex<double>> points = {{1, 2, 3}, {-50, 40, 7}, {300, 200, -100}, {0, 0, 0}};
+
+    Transform rot = Transform::rotation(0.3, -1.1, 2.5, center);
+    Transform axis = Transform::axisRotation(1, 2, -2, 0.7);
+    // поворот по трём углам — это повороты вокруг осей x, y, z
+    Transform composed = Transform::axisRotation(1, 0, 0, 0.3) * Transform::axisRotation(0, 1, 0, -1.1) *
+                         Transform::axisRotation(0, 0, 1, 2.5);
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j)
+            assert(abs(composed(i, j) - Transform::rotation(0.3, -1.1, 2.5)(i, j)) < 1e-12);
+    }
+    for (auto &p: points) {
+        // Vertex<int>::rotate отбрасывает дробную часть
+        Vertex<int> truncated(p.x, p.y, p.z);
+        truncated.rotate(0.3, -1.1, 2.5, Vertex<int>(10, -20, 30));
+        assert(equal(rot.apply(p), convertToDoubleVertex(truncated), 1.0));
+
+        Vertex<double> expected = p;
+        expected.rotateAboveAxes(1 / 3.0, 2 / 3.0, -2 / 3.0, 0.7);
+        assert(equal(axis.apply(p), expected, 1e-9));
+
+        // сначала масштаб, потом сдвиг
+        auto moved = (Transform::translation({5, 6, 7}) * Transform::scale(2)).apply(p);
+        assert(equal(moved, p * 2.0 + Vertex<double>(5, 6, 7), 1e-9));
+
+        double r = 1.3e-3;
+        assert(equal(Transform::projection(r).apply(p), p / (1 + r * p.z), 1e-9));
+    }
+
+    // пакетное преобразование совпадает с поточечным, в том числе с перспективой
+    Transform full = Transform::projection(1e-3) * rot * axis;
+    VertexArray batch;
+    for (auto &p: points)
+        batch.push_back(p);
+    VertexArray out;
+    full.apply(batch, out);
+    for (size_t i = 0; i < points.size(); ++i)
+        assert(equal(out[i], full.apply(points[i]), 1e-9));
+
+    // полный оборот, собранный из кадров, возвращает куб на место без накопленной ошибки
+    Kuboid model(cubeFaces(200, 200, 100, 300));
+    auto c = convertToDoubleVertex(model.getCenter());
+    int N = 50;
+    Kuboid last = model.transformed(Transform::rotation(0, 2 * M_PI * N / N, 0, c));
+    assertVectorsEqual(model.getVertices(), last.getVertices());
+}
+
+void TestMesh() {
+    Kuboid cube(cubeFaces(200, 200, 100, 300));
+    assert(cube.vertexCount() == 8);
+    assert(cube.faceCount() == 6);
+    assert(cube.edgeCount() == 12);
+
+    // в общем положении видны три грани: 9 рёбер, каждое по одному разу
+    cube.rotate(M_PI / 8, M_PI / 4, 0, cube.getCenter());
+    auto edges = cube.visibleEdges();
+    assert(edges.size() == 9);
+    set<pair<tuple<int, int, int>, tuple<int, int, int>>> unique;
+    for (auto &[a, b]: edges) {
+        auto ta = make_tuple(a.x, a.y, a.z), tb = make_tuple(b.x, b.y, b.z);
+        unique.insert({min(ta, tb), max(ta, tb)});
+    }
+    assert(unique.size() == edges.size());
+
+    // перспектива: куб перед наблюдателем, видна одна ближняя грань и, под углом, соседние
+    Kuboid front(cubeFaces(-100, -100, 100, 200));
+    assert(front.projectedEdges(1e-3).size() == 4);
+    front.rotate(M_PI / 6, M_PI / 5, 0, front.getCenter());
+    auto projected = front.projectedEdges(1e-3);
+    assert(projected.size() == 9);
+
+    // show рисует ровно видимые рёбра
+    Canvas shown(700, 700), expected(700, 700);
+    cube.show(shown, Magick::Color(0, 0, QuantumRange));
+    for (auto &[a, b]: edges)
+        drawLine(a, b, expected, Magick::Color(0, 0, QuantumRange));
+    assert(memcmp(shown.data(), expected.data(), sizeof(Canvas::Pixel) * 700 * 700) == 0);
+
+    // индексный конструктор даёт ту же сетку, что и грани с вершинами
+    vector<Vertex<double>> vertices = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    Mesh tetrahedron(vertices, {{0, 2, 1}, {0, 1, 3}, {1, 2, 3}, {0, 3, 2}});
+    assert(tetrahedron.vertexCount() == 4 && tetrahedron.edgeCount() == 6);
+}
+
+/// Точки отрезка по формуле середины, без обрезки
+set<pair<int, int>> linePixels(int x1, int y1, int x2, int y2) {
+    set<pair<int, int>> res;
+    bool x_major = abs(x2 - x1) >= abs(y2 - y1);
+    if (x_major ? x1 > x2 : y1 > y2) {
+        swap(x1, x2);
+        swap(y1, y2);
+    }
+    int du = x_major ? x2 - x1 : y2 - y1, dv = x_major ? y2 - y1 : x2 - x1;
+    for (int t = 0; t <= du; ++t) {
+        int m = du == 0 ? 0 : int(floor((2.0 * abs(dv) * t + du) / (2.0 * du)));
+        int v = (x_major ? y1 : x1) + (dv < 0 ? -m : m);
+        res.insert(x_major ? make_pair(x1 + t, v) : make_pair(v, y1 + t));
+    }
+    return res;
+}
+
+void TestDrawLine() {
+    const Canvas::Pixel white = Canvas::packRGB(255, 255, 255), black = Canvas::packRGB(0, 0, 0);
+    mt19937 gen(12);
+    uniform_int_distribution<int> coord(-300, 600);
+    vector<array<int, 4>> lines = {{10, 10, 10, 10}, {-50, 20, 400, 20}, {40, -100, 40, 500}, {-20, -20, 250, 250},
+                                   {280, -5, -30, 305}, {0, 199, 299, 0}, {5, 5, 6, 300}};
+    for (int i = 0; i < 300; ++i)
+        lines.push_back({coord(gen), coord(gen), coord(gen), coord(gen)});
+
+    Canvas forward(300, 200, Magick::Color("white")), backward(300, 200, Magick::Color("white"));
+    for (auto &[x1, y1, x2, y2]: lines) {
+        forward.clear(white);
+        backward.clear(white);
+        drawLine(x1, y1, x2, y2, forward, Magick::Color(0, 0, 0));
+        drawLine(x2, y2, x1, y1, backward, Magick::Color(0, 0, 0));
+        auto expected = linePixels(x1, y1, x2, y2);
+        for (int y = 0; y < 200; ++y) {
+            for (int x = 0; x < 300; ++x) {
+                // обрезка не меняет видимые точки, а направление отрезка не важно
+                assert((forward.getPixel(x, y) == black) == expected.contains({x, y}));
+                assert(forward.getPixel(x, y) == backward.getPixel(x, y));
+            }
+        }
+    }
+
+    // ломаная — те же отрезки подряд
+    vector<Vertex<int>> points = {{-40, 10}, {100, 150}, {250, 150}, {350, -20}};
+    Canvas polyline(300, 200), separate(300, 200);
+    drawPolyline(points, polyline, Magick::Color(0, 0, 0), true);
+    for (size_t i = 0; i < points.size(); ++i)
+        drawLine(points[i], points[(i + 1) % points.size()], separate, Magick::Color(0, 0, 0));
+    assert(memcmp(polyline.data(), separate.data(), sizeof(Canvas::Pixel) * 300 * 200) == 0);
+}
+
+void TestMidpointArc() {
+    const Canvas::Pixel white = Canvas::packRGB(255, 255, 255);
+    const Magick::Color black(0, 0, 0);
+    const Vertex<int> center(150, 100);
+    // закрашенные точки относительно центра
+    auto pixelsOf = [&](auto draw) {
+        Canvas canvas(300, 200, Magick::Color("white"));
+        draw(canvas);
+        set<pair<int, int>> res;
+        for (int y = 0; y < 200; ++y) {
+            for (int x = 0; x < 300; ++x) {
+                if (canvas.getPixel(x, y) != white)
+                    res.insert({x - center.x, y - center.y});
+            }
+        }
+        return res;
+    };
+    auto unite = [](set<pair<int, int>> a, const set<pair<int, int>> &b) {
+        a.insert(b.begin(), b.end());
+        return a;
+    };
+
+    for (int r: {0, 1, 2, 7, 40, 95}) {
+        auto circle = pixelsOf([&](Canvas &c) { drawCircle(center, r, c, black); });
+        auto disk = pixelsOf([&](Canvas &c) { fillCircle(center, r, c, black); });
+        for (auto [x, y]: circle) {
+            // восемь симметрий и отклонение от окружности не больше половины пиксела
+            for (auto [u, v]: {pair{x, -y}, {-x, y}, {y, x}, {-y, -x}})
+                assert(circle.contains({u, v}));
+            assert(abs(sqrt(double(x) * x + y * y) - r) <= 0.5);
+            assert(disk.contains({x, y}));
+        }
+        for (auto [x, y]: disk)
+            assert(sqrt(double(x) * x + y * y) <= r + 0.5);
+        // круг без дыр: в каждой строке сплошной отрезок
+        for (auto [x, y]: disk)
+            assert(x == 0 || disk.contains({x > 0 ? x - 1 : x + 1, y}));
+    }
+
+    mt19937 gen(22);
+    uniform_real_distribution<double> angle(-2 * M_PI, 2 * M_PI);
+    const int r = 90;
+    auto circle = pixelsOf([&](Canvas &c) { drawCircle(center, r, c, black); });
+    auto disk = pixelsOf([&](Canvas &c) { fillCircle(center, r, c, black); });
+    for (int k = 0; k < 20; ++k) {
+        double a = angle(gen), b = angle(gen);
+        auto arc = pixelsOf([&](Canvas &c) { drawArc(center, r, a, b, c, black); });
+        auto rest = pixelsOf([&](Canvas &c) { drawArc(center, r, b, a, c, black); });
+        // дуга и её дополнение покрывают окружность, по часовой стрелке — то же дополнение
+        assert(unite(arc, rest) == circle);
+        assert(pixelsOf([&](Canvas &c) { drawArc(center, r, a, b, c, black, false); }) == rest);
+        double span = b - a >= 2 * M_PI ? 2 * M_PI : fmod(b - a, 2 * M_PI);
+        if (span < 0)
+            span += 2 * M_PI;
+        for (auto [x, y]: arc) {
+            double t = fmod(atan2(y, x) - a, 2 * M_PI);
+            if (t < 0)
+                t += 2 * M_PI;
+            assert(t <= span + 1e-5 || t >= 2 * M_PI - 1e-5);
+        }
+
+        auto sector = pixelsOf([&](Canvas &c) { fillSector(center, r, a, b, c, black); });
+        auto other = pixelsOf([&](Canvas &c) { fillSector(center, r, b, a, c, black); });
+        assert(unite(sector, other) == disk);
+        for (auto p: arc)
+            assert(sector.contains(p));
+    }
+    assert(pixelsOf([&](Canvas &c) { drawArc(center, r, 1, 1, c, black); }).empty());
+
+    // частично за краем холста: по тайлам то же, что целиком
+    Canvas whole(300, 200, Magick::Color("white")), tiled(300, 200, Magick::Color("white"));
+    const Vertex<int> edge(20, 180);
+    drawArc(edge, 120, 0.3, 5.1, whole, black);
+    fillSector(edge, 70, 2.5, 0.4, whole, Magick::Color(0, 0, QuantumRange));
+    for (int ty = 0; ty < 200; ty += 64) {
+        for (int tx = 0; tx < 300; tx += 64) {
+            CanvasView view(tiled, {tx, ty, tx + 64, ty + 64});
+            drawArc(edge, 120, 0.3, 5.1, view, black);
+            fillSector(edge, 70, 2.5, 0.4, view, Magick::Color(0, 0, QuantumRange));
+        }
+    }
+    assert(memcmp(whole.data(), tiled.data(), sizeof(Canvas::Pixel) * 300 * 200) == 0);
+
+    bool thrown = false;
+    try {
+        drawCircle(center, -1, whole, black);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+/// Расстояние от точки до отрезка
+double distanceToSegment(const Vertex<double> &p, const Vertex<double> &a, const Vertex<double> &b) {
+    Vertex<double> d = b - a;
+    double t = std::clamp(((p.x - a.x) * d.x + (p.y - a.y) * d.y) / (d.x * d.x + d.y * d.y), 0.0, 1.0);
+    return (p - (a + d * t)).mod();
+}
+
+void TestStroker() {
+    const Canvas::Pixel white = Canvas::packRGB(255, 255, 255);
+    const Magick::Color black(0, 0, 0);
+    auto pixelsOf = [&](const Stroker &stroker) {
+        Canvas canvas(200, 150, Magick::Color("white"));
+        stroker.fill(canvas, black);
+        set<pair<int, int>> res;
+        for (int y = 0; y < 150; ++y) {
+            for (int x = 0; x < 200; ++x) {
+                if (canvas.getPixel(x, y) != white)
+                    res.insert({x, y});
+            }
+        }
+        return res;
+    };
+
+    // прямоугольник толщиной 5: строки 17.5 <= y < 22.5, окончание без выступа
+    Stroker stroker({5, JOIN_MITER, CAP_BUTT});
+    stroker.addSegment({{10, 20}, {50, 20}});
+    set<pair<int, int>> expected;
+    for (int y = 18; y <= 22; ++y) {
+        for (int x = 10; x < 50; ++x)
+            expected.insert({x, y});
+    }
+    assert(pixelsOf(stroker) == expected);
+
+    // круглые соединения и окончания: точки ближе половины ширины к ломаной закрашены, дальше — нет
+    mt19937 gen(23);
+    uniform_int_distribution<int> coord(10, 190);
+    vector<Vertex<int>> polyline;
+    for (int i = 0; i < 8; ++i)
+        polyline.emplace_back(coord(gen), coord(gen) * 3 / 4);
+    stroker = Stroker({9, JOIN_ROUND, CAP_ROUND});
+    stroker.addPolyline(polyline);
+    auto round = pixelsOf(stroker);
+    for (int y = 0; y < 150; ++y) {
+        for (int x = 0; x < 200; ++x) {
+            double d = 1e9;
+            for (size_t i = 0; i + 1 < polyline.size(); ++i)
+                d = min(d, distanceToSegment(Vertex<double>(x, y), convertToDoubleVertex(polyline[i]),
+                                             convertToDoubleVertex(polyline[i + 1])));
+            if (d < 4.5 - 0.3)
+                assert(round.contains({x, y}));
+            if (d > 4.5 + 0.3)
+                assert(!round.contains({x, y}));
+        }
+    }
+
+    // отрезки строк не пересекаются: каждый пиксел пишется один раз
+    int last_y = INT_MIN, last_x = INT_MIN;
+    size_t written = 0;
+    stroker.forEachSpan([&](int y, int x_from, int x_to) {
+        assert(y > last_y || (y == last_y && x_from >= last_x));
+        last_y = y;
+        last_x = x_to;
+        written += x_to - x_from;
+    });
+    assert(written == round.size());
+
+    // острие на внешней стороне угла есть только у соединения JOIN_MITER
+    vector<Vertex<int>> corner = {{20, 20}, {60, 20}, {60, 60}};
+    Stroker miter({10, JOIN_MITER, CAP_BUTT}), bevel({10, JOIN_BEVEL, CAP_BUTT});
+    miter.addPolyline(corner);
+    bevel.addPolyline(corner);
+    auto with_tip = pixelsOf(miter), without_tip = pixelsOf(bevel);
+    assert(with_tip.contains({64, 16}) && !without_tip.contains({64, 16}));
+    for (auto p: without_tip)
+        assert(with_tip.contains(p));
+    // слишком острый угол превышает miter_limit и срезается
+    vector<Vertex<int>> sharp = {{20, 100}, {180, 110}, {20, 120}};
+    Stroker limited({10, JOIN_MITER, CAP_BUTT, 2}), beveled({10, JOIN_BEVEL, CAP_BUTT});
+    limited.addPolyline(sharp);
+    beveled.addPolyline(sharp);
+    assert(pixelsOf(limited) == pixelsOf(beveled));
+
+    // граница многоугольника — замкнутая ломаная: углы с остриём, внутри пусто
+    vector<Vertex<int>> square = {{40, 40}, {120, 40}, {120, 120}, {40, 120}};
+    Stroker outline({6, JOIN_MITER, CAP_BUTT}), closed({6, JOIN_MITER, CAP_BUTT});
+    outline.addPolyhedron(Polyhedron(square));
+    closed.addPolyline(square, true);
+    auto frame = pixelsOf(outline);
+    assert(frame == pixelsOf(closed));
+    assert(frame.contains({37, 37}) && frame.contains({122, 122}) && !frame.contains({80, 80}));
+
+    // кривая Безье — та же ломаная, что в drawBezierCurve
+    vector<Vertex<int>> control = {{10, 10}, {100, 140}, {190, 10}};
+    Stroker curve({4, JOIN_ROUND, CAP_SQUARE}), flattened({4, JOIN_ROUND, CAP_SQUARE});
+    curve.addBezier(control);
+    vector<Vertex<double>> points = {convertToDoubleVertex(control[0])};
+    flattenBezier(control, BEZIER_TOLERANCE, points);
+    flattened.addPolyline(points);
+    assert(pixelsOf(curve) == pixelsOf(flattened));
+
+    // по тайлам — то же, что целиком
+    Canvas whole(200, 150, Magick::Color("white")), tiled(200, 150, Magick::Color("white"));
+    stroker.fill(whole, black);
+    for (int ty = 0; ty < 150; ty += 64) {
+        for (int tx = 0; tx < 200; tx += 64) {
+            CanvasView view(tiled, {tx, ty, tx + 64, ty + 64});
+            stroker.fill(view, black);
+        }
+    }
+    assert(memcmp(whole.data(), tiled.data(), sizeof(Canvas::Pixel) * 200 * 150) == 0);
+
+    // сглаживание: куски перекрываются, но край под соединением закрашен так же, как вдоль звена
+    auto red = [](const Canvas &canvas, int x, int y) { return int(Canvas::unpack(canvas.getPixel(x, y))[0]); };
+    for (LineJoin join: {JOIN_MITER, JOIN_ROUND, JOIN_BEVEL}) {
+        for (LineCap cap: {CAP_BUTT, CAP_ROUND, CAP_SQUARE}) {
+            Stroker joined({4, join, cap}), single({4, join, cap});
+            joined.addPolyline(vector<Vertex<int>>{{10, 20}, {30, 20}, {50, 20}});
+            single.addSegment({{10, 20}, {50, 20}});
+            Canvas with_join(60, 40, Magick::Color("white")), without(60, 40, Magick::Color("white"));
+            joined.fillAntialiased(with_join, black);
+            single.fillAntialiased(without, black);
+            int edge = red(without, 20, 18);
+            assert(edge > 60 && edge < 200);
+            assert(abs(red(with_join, 30, 18) - edge) <= 4 && abs(red(with_join, 30, 22) - red(without, 30, 22)) <= 4);
+            for (int y = 0; y < 40; ++y) {
+                for (int x = 0; x < 60; ++x)
+                    assert(abs(red(with_join, x, y) - red(without, x, y)) <= 4);
+            }
+        }
+    }
+    // на изломе сглаженная обводка близка к обычной
+    Stroker bent({6, JOIN_ROUND, CAP_ROUND});
+    bent.addPolyline(vector<Vertex<int>>{{10, 10}, {60, 50}, {110, 15}});
+    Canvas hard(120, 70, Magick::Color("white")), smooth(120, 70, Magick::Color("white"));
+    bent.fill(hard, black);
+    bent.fillAntialiased(smooth, black);
+    for (int y = 0; y < 70; ++y) {
+        for (int x = 0; x < 120; ++x) {
+            // пикселы далеко от края совпадают
+            int a = red(hard, x, y), b = red(smooth, x, y);
+            assert(abs(a - b) < 255 || (a != red(hard, max(x - 1, 0), y) || a != red(hard, min(x + 1, 119), y) ||
+                                        a != red(hard, x, max(y - 1, 0)) || a != red(hard, x, min(y + 1, 69))));
+        }
+    }
+
+    bool thrown = false;
+    try {
+        Stroker wrong({0});
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+/// Число оборотов контура вокруг точки p
+int windingNumber(const vector<Vertex<int>> &contour, double px, double py) {
+    int w = 0;
+    for (size_t i = 0; i < contour.size(); ++i) {
+        const Vertex<int> &a = contour[i], &b = contour[(i + 1) % contour.size()];
+        double side = (b.x - a.x) * (py - a.y) - (px - a.x) * (b.y - a.y);
+        if (a.y <= py && py < b.y && side > 0)
+            w++;
+        else if (b.y <= py && py < a.y && side < 0)
+            w--;
+    }
+    return w;
+}
+
+/// Удвоенная ориентированная площадь контуров
+long long doubledArea(const vector<vector<Vertex<int>>> &contours) {
+    long long res = 0;
+    for (auto &c: contours) {
+        for (size_t i = 0; i < c.size(); ++i)
+            res += (long long) c[i].x * c[(i + 1) % c.size()].y - (long long) c[(i + 1) % c.size()].x * c[i].y;
+    }
+    return res;
+}
+
+void TestBooleanOps() {
+    auto rect = [](int x0, int y0, int x1, int y1) {
+        return Polyhedron(vector<Vertex<int>>{{x0, y0}, {x1, y0}, {x1, y1}, {x0, y1}});
+    };
+    vector<Polyhedron> a = {rect(0, 0, 100, 100)}, b = {rect(50, 50, 150, 150)};
+    auto united = booleanContours(a, b, BOOLEAN_UNION);
+    assert(united.size() == 1 && united[0].size() == 8 && doubledArea(united) == 2 * 17500);
+    auto common = booleanContours(a, b, BOOLEAN_INTERSECTION);
+    assert(common.size() == 1 && common[0].size() == 4 && doubledArea(common) == 2 * 2500);
+    auto diff = booleanContours(a, b, BOOLEAN_DIFFERENCE);
+    assert(diff.size() == 1 && diff[0].size() == 6 && doubledArea(diff) == 2 * 7500);
+    // два уголка касаются в двух точках и выходят отдельными контурами
+    auto sym = booleanContours(a, b, BOOLEAN_XOR);
+    assert(sym.size() == 2 && sym[0].size() == 6 && sym[1].size() == 6 && doubledArea(sym) == 2 * 15000);
+
+    // длинные тонкие полосы: под каждым длинным куском сотни горячих пикселов, их ищут заметающие прямые
+    vector<Polyhedron> stripes;
+    for (int i = 0; i < 200; ++i)
+        stripes.push_back(rect(0, 3 * i, 5000, 3 * i + 1));
+    vector<Polyhedron> bar = {rect(2500, -5, 2502, 605)};
+    auto comb = booleanContours(stripes, bar, BOOLEAN_UNION);
+    assert(comb.size() == 1 && comb[0].size() == 200 * 8 + 4 && doubledArea(comb) == 2 * (200 * 5000 + 820));
+    auto teeth = booleanContours(stripes, bar, BOOLEAN_INTERSECTION);
+    assert(teeth.size() == 200 && doubledArea(teeth) == 2 * 200 * 2);
+
+    // дырка обходится по часовой стрелке и остаётся пустой при заливке
+    auto holed = booleanContours(a, {rect(25, 25, 75, 75)}, BOOLEAN_DIFFERENCE);
+    assert(holed.size() == 2 && doubledArea(holed) == 2 * 7500);
+    Canvas canvas(120, 120, Magick::Color("white"));
+    fillContours(holed, canvas, Magick::Color(0, 0, 0));
+    assert(canvas.getPixel(50, 50) == Canvas::packRGB(255, 255, 255));
+    assert(canvas.getPixel(10, 10) == Canvas::packRGB(0, 0, 0));
+    Canvas same(120, 120, Magick::Color("white"));
+    fillContours(booleanOperation(a, {rect(25, 25, 75, 75)}, BOOLEAN_DIFFERENCE), same, Magick::Color(0, 0, 0));
+    assert(memcmp(canvas.data(), same.data(), sizeof(Canvas::Pixel) * 120 * 120) == 0);
+
+    // общая сторона исчезает, касание углом даёт два контура
+    auto joined = booleanContours({rect(0, 0, 50, 50), rect(50, 0, 100, 50)}, {}, BOOLEAN_UNION);
+    assert(joined.size() == 1 && joined[0].size() == 4 && doubledArea(joined) == 2 * 5000);
+    assert(booleanContours({rect(0, 0, 50, 50), rect(50, 50, 100, 100)}, {}, BOOLEAN_UNION).size() == 2);
+    // обход входа не важен
+    Polyhedron reversed(vector<Segment<int>>{{{0, 0}, {0, 100}}, {{0, 100}, {100, 100}},
+                                             {{100, 100}, {100, 0}}, {{100, 0}, {0, 0}}});
+    assert(booleanContours({reversed}, b, BOOLEAN_UNION) == united);
+
+    // пентаграмма: по чётности середина пуста, и пять лучей касаются друг друга вершинами
+    vector<Vertex<int>> star;
+    for (int i = 0; i < 5; ++i)
+        star.emplace_back(roundToInt(500 + 400 * cos(M_PI / 2 + 4 * M_PI * i / 5)),
+                          roundToInt(500 + 400 * sin(M_PI / 2 + 4 * M_PI * i / 5)));
+    assert(booleanContours({Polyhedron(star)}, {}, BOOLEAN_UNION, EVEN_ODD).size() == 5);
+    auto whole_star = booleanContours({Polyhedron(star)}, {}, BOOLEAN_UNION, NON_ZERO);
+    assert(whole_star.size() == 1 && whole_star[0].size() == 10);
+
+    // случайные наборы: вдали от рёбер результат совпадает с поточечной проверкой
+    mt19937 gen(24);
+    uniform_int_distribution<int> coord(0, 400);
+    uniform_real_distribution<double> sample(0, 400);
+    // во второй половине — мелкие координаты: много точек пересечения в одном пикселе
+    for (int round = 0; round < 24; ++round) {
+        vector<Polyhedron> subject, clip;
+        vector<vector<Vertex<int>>> subject_points, clip_points;
+        for (int k = 0; k < 9; ++k) {
+            vector<Vertex<int>> points;
+            for (int i = 0; i < 3 + k % 4; ++i)
+                points.emplace_back(coord(gen) / (round < 12 ? 1 : 8), coord(gen) / (round < 12 ? 1 : 8));
+            (k % 2 ? clip : subject).emplace_back(points);
+            (k % 2 ? clip_points : subject_points).push_back(points);
+        }
+        auto op = BooleanOperation(round % 4);
+        FillRule subject_rule = round % 3 ? NON_ZERO : EVEN_ODD, clip_rule = round % 5 ? EVEN_ODD : NON_ZERO;
+        auto result = booleanContours(subject, clip, op, subject_rule, clip_rule);
+        for (auto &contour: result) {
+            assert(contour.size() >= 3);
+            vector<Segment<int>> edges;
+            for (size_t i = 0; i < contour.size(); ++i) {
+                assert(contour[i] != contour[(i + 1) % contour.size()]);
+                edges.emplace_back(contour[i], contour[(i + 1) % contour.size()]);
+            }
+            // после округления через горячие пикселы контур остаётся простым
+            assert(!hasSelfCrossings(edges));
+        }
+
+        auto insideSet = [](const vector<vector<Vertex<int>>> &set, FillRule rule, double x, double y) {
+            int w = 0;
+            for (auto &points: set) {
+                int sign = rule == NON_ZERO && doubledArea({points}) < 0 ? -1 : 1;
+                w += sign * windingNumber(points, x, y);
+            }
+            return rule == EVEN_ODD ? (w & 1) != 0 : w != 0;
+        };
+        auto nearEdge = [](const vector<vector<Vertex<int>>> &set, double x, double y) {
+            for (auto &points: set) {
+                for (size_t i = 0; i < points.size(); ++i) {
+                    if (distanceToSegment(Vertex<double>(x, y), convertToDoubleVertex(points[i]),
+                                          convertToDoubleVertex(points[(i + 1) % points.size()])) < 1.5)
+                        return true;
+                }
+            }
+            return false;
+        };
+        for (int q = 0; q < 400; ++q) {
+            double x = sample(gen), y = sample(gen);
+            if (nearEdge(subject_points, x, y) || nearEdge(clip_points, x, y))
+                continue;
+            bool in_a = insideSet(subject_points, subject_rule, x, y), in_b = insideSet(clip_points, clip_rule, x, y);
+            bool expected = op == BOOLEAN_UNION ? in_a || in_b : op == BOOLEAN_INTERSECTION ? in_a && in_b :
+                            op == BOOLEAN_DIFFERENCE ? in_a && !in_b : in_a != in_b;
+            int w = 0;
+            for (auto &contour: result)
+                w += windingNumber(contour, x, y);
+            // контуры не накладываются: число оборотов 0 или 1
+            assert(w == int(expected));
+        }
+    }
+}
+
+/// Покрытие пикселов фигуры по правилу rule: (x, y) -> доля площади
+map<pair<int, int>, double> coverageOf(const vector<Vertex<double>> &contour, const PixelRect &area, FillRule rule) {
+    CoverageAccumulator accumulator;
+    accumulator.reset(area);
+    accumulator.addContour(contour);
+    map<pair<int, int>, double> res;
+    accumulator.resolve(rule, [&](int y, int x_from, const float *coverage) {
+        for (int x = area.x0; x < area.x1; ++x)
+            res[make_pair(x, y)] = coverage[x - x_from];
+    });
+    return res;
+}
+
+void TestAntialiasedFill() {
+    // прямоугольник с дробными границами: покрытие — площадь пересечения с квадратом пиксела
+    double left = 10.25, right = 20.75, bottom = 5.5, top = 15.0;
+    vector<Vertex<double>> rect = {{left, bottom}, {right, bottom}, {right, top}, {left, top}};
+    auto overlap = [](double a0, double a1, double b0, double b1) {
+        return max(0.0, min(a1, b1) - max(a0, b0));
+    };
+    // область обрезает прямоугольник слева: покрытие от этого не меняется
+    for (auto &[p, c]: coverageOf(rect, {12, 0, 30, 20}, EVEN_ODD)) {
+        double expected = overlap(p.first - 0.5, p.first + 0.5, left, right) *
+                          overlap(p.second - 0.5, p.second + 0.5, bottom, top);
+        assert(abs(c - expected) < 1e-4);
+    }
+
+    // наклонные рёбра: сумма покрытий равна площади треугольника
+    vector<Vertex<double>> triangle = {{3.3, 4.1}, {40.7, 12.9}, {17.2, 33.6}};
+    double area = abs(cross(triangle[1] - triangle[0], triangle[2] - triangle[0]).z) / 2;
+    double total = 0;
+    for (auto &[p, c]: coverageOf(triangle, {0, 0, 50, 50}, NON_ZERO))
+        total += c;
+    assert(abs(total - area) < 1e-3 * area);
+
+    // звезда: центр закрашен по ненулевому правилу и пуст по чётно-нечётному, вдали от рёбер — без полутонов
+    vector<Vertex<double>> star = {{150, 200}, {460, 350}, {100, 350}, {400, 200}, {250, 460}};
+    auto even_odd = coverageOf(star, {0, 0, 500, 500}, EVEN_ODD);
+    auto non_zero = coverageOf(star, {0, 0, 500, 500}, NON_ZERO);
+    assert(abs(even_odd[{270, 300}]) < 1e-4);
+    assert(abs(non_zero[{270, 300}] - 1) < 1e-4);
+    assert(abs(even_odd[{200, 340}] - 1) < 1e-4);
+
+    // в целом совпадает с обычной заливкой: пикселы вне её полностью не покрыты, внутри — покрыты
+    Polyhedron pol(vector<Vertex<int>>{{150, 200}, {460, 350}, {100, 350}, {400, 200}, {250, 460}});
+    for (FillRule rule: {EVEN_ODD, NON_ZERO}) {
+        Canvas hard(500, 500), smooth(500, 500);
+        pol.fill(hard, Magick::Color(0, 0, 0), rule);
+        pol.fillAntialiased(smooth, Magick::Color(0, 0, 0), rule);
+        const Canvas::Pixel black = Canvas::packRGB(0, 0, 0), white = Canvas::packRGB(255, 255, 255);
+        int differ = 0;
+        for (int y = 0; y < 500; ++y) {
+            for (int x = 0; x < 500; ++x) {
+                auto a = hard.getPixel(x, y), b = smooth.getPixel(x, y);
+                if ((a == black) != (b == black)) {
+                    differ++;
+                    assert(b != (a == black ? white : black));
+                }
+            }
+        }
+        assert(differ < 2000);
+    }
+}
+
+void TestDepthRenderer() {
+    const double r = 1e-3;
+    const Magick::Color red(QuantumRange, 0, 0), blue(0, 0, QuantumRange);
+    // два наклонных квадрата пересекаются: в каждом пикселе виден ближний, порядок отрисовки не важен
+    Mesh first(vector<Vertex<double>>{{50, 50, 100}, {250, 50, 300}, {250, 250, 300}, {50, 250, 100}}, {{0, 1, 2, 3}});
+    Mesh second(vector<Vertex<double>>{{100, 80, 320}, {280, 80, 120}, {280, 260, 120}, {100, 260, 320}},
+                {{0, 1, 2, 3}});
+    Canvas forward(300, 300), backward(300, 300);
+    DepthRenderer renderer(300, 300, r);
+    renderer.drawMesh(first, forward, red);
+    renderer.drawMesh(second, forward, blue);
+    renderer.clear();
+    renderer.drawMesh(second, backward, blue);
+    renderer.drawMesh(first, backward, red);
+    assert(memcmp(forward.data(), backward.data(), sizeof(Canvas::Pixel) * 300 * 300) == 0);
+
+    // глубина на экране — та же проекция, что у onePointProjection: точка, возвращённая обратно
+    // в пространство, лежит на ближнем из квадратов
+    auto [x, y] = make_pair(120, 150);
+    float z = renderer.getBuffer().at(x, y);
+    assert(z < DepthBuffer::FAR);
+    assert(abs(z / (1 - r * z) - min(100 + (x / (1 - r * z) - 50), 320 - (x / (1 - r * z) - 100) * 200 / 180.0)) < 1);
+
+    // куб за большим квадратом отбрасывается по тайлам целиком
+    Mesh wall(vector<Vertex<double>>{{0, 0, 10}, {300, 0, 10}, {300, 300, 10}, {0, 300, 10}}, {{0, 1, 2, 3}});
+    Kuboid cube(cubeFaces(100, 100, 200, 50));
+    Canvas canvas(300, 300);
+    renderer.clear();
+    renderer.drawMesh(wall, canvas, red);
+    Canvas covered = canvas;
+    renderer.drawMesh(cube, canvas, blue);
+    assert(renderer.rejectedFaces() == 3);
+    assert(memcmp(covered.data(), canvas.data(), sizeof(Canvas::Pixel) * 300 * 300) == 0);
+
+    // без стены видны три грани куба, и закрашена ровно его проекция
+    Canvas alone(300, 300);
+    renderer.clear();
+    cube.rotate(0.4, 0.5, 0, cube.getCenter());
+    renderer.drawMesh(cube, alone, blue);
+    int drawn = 0;
+    for (int i = 0; i < 300 * 300; ++i)
+        drawn += alone.data()[i] != Canvas::packRGB(255, 255, 255);
+    assert(drawn > 50 * 50 && drawn < 90 * 90);
+}
+
+/// Разбор QOI по спецификации: пикселы RGBA, первая строка файла — первая в векторе
+vector<Canvas::Pixel> decodeQOI(const vector<uint8_t> &data, int &width, int &height) {
+    assert(data.size() >= 22 && memcmp(data.data(), "qoif", 4) == 0);
+    auto be32 = [&](size_t pos) {
+        return int(uint32_t(data[pos]) << 24 | uint32_t(data[pos + 1]) << 16 | uint32_t(data[pos + 2]) << 8 | data[pos + 3]);
+    };
+    width = be32(4);
+    height = be32(8);
+    vector<Canvas::Pixel> pixels;
+    array<array<uint8_t, 4>, 64> index{};
+    array<uint8_t, 4> px = {0, 0, 0, 255};
+    size_t pos = 14;
+    while (pixels.size() < size_t(width) * height) {
+        uint8_t op = data[pos++];
+        int run = 1;
+        if (op == 0xFE) {
+            px = {data[pos], data[pos + 1], data[pos + 2], px[3]};
+            pos += 3;
+        } else if (op == 0xFF) {
+            px = {data[pos], data[pos + 1], data[pos + 2], data[pos + 3]};
+            pos += 4;
+        } else if ((op >> 6) == 0) {
+            px = index[op];
+        } else if ((op >> 6) == 1) {
+            px[0] += ((op >> 4) & 3) - 2;
+            px[1] += ((op >> 2) & 3) - 2;
+            px[2] += (op & 3) - 2;
+        } else if ((op >> 6) == 2) {
+            int dg = (op & 0x3F) - 32, next = data[pos++];
+            px[0] += dg + (next >> 4) - 8;
+            px[1] += dg;
+            px[2] += dg + (next & 15) - 8;
+        } else {
+            run = (op & 0x3F) + 1;
+        }
+        index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64] = px;
+        Canvas::Pixel p;
+        memcpy(&p, px.data(), sizeof(p));
+        pixels.insert(pixels.end(), run, p);
+    }
+    assert(pixels.size() == size_t(width) * height);
+    assert(data.size() == pos + 8 && data.back() == 1);
+    return pixels;
+}
+
+void TestSpatialIndex() {
+    mt19937 gen(13);
+    uniform_int_distribution<int> coord(200, 2999), extent(3, 120), angle(0, 359);
+    vector<Polyhedron> polygons;
+    polygons.reserve(400);
+    for (int k = 0; k < 400; ++k) {
+        int x = coord(gen), y = coord(gen), r = k % 100 == 0 ? 1500 : extent(gen);
+        vector<Vertex<int>> points;
+        for (int i = 0; i < 6; ++i) {
+            double phi = 2 * M_PI * (i + angle(gen) / 360.0) / 6;
+            points.emplace_back(x + roundToInt(r * cos(phi)), y + roundToInt(r * sin(phi)));
+        }
+        polygons.emplace_back(points);
+    }
+    PolygonIndex index(50);
+    for (auto &pol: polygons)
+        index.add(pol);
+    vector<char> alive(polygons.size(), 1);
+
+    auto boxOf = [](const Polyhedron &pol) {
+        BoundingBox<int> box(pol.getSegments());
+        return PixelRect{box.getXMin(), box.getYMin(), box.getXMax() + 1, box.getYMax() + 1};
+    };
+    auto compare = [&] {
+        for (int q = 0; q < 300; ++q) {
+            Vertex<int> v(coord(gen), coord(gen)), w(v.x + extent(gen) * 3 - 180, v.y + extent(gen) * 3 - 180);
+            PixelRect rect = {v.x, v.y, v.x + extent(gen), v.y + extent(gen)};
+            vector<int> inside_even, inside_nonzero, touching, crossing;
+            for (size_t id = 0; id < polygons.size(); ++id) {
+                if (!alive[id])
+                    continue;
+                const Polyhedron &pol = polygons[id];
+                PolygonHitTester tester(pol.getSegments());
+                if (tester.contains(v, EVEN_ODD))
+                    inside_even.push_back(id);
+                if (tester.contains(v, NON_ZERO))
+                    inside_nonzero.push_back(id);
+                if (!boxOf(pol).intersect(rect).empty())
+                    touching.push_back(id);
+                bool hit = tester.contains(v, EVEN_ODD);
+                for (auto &segm: pol.getSegments())
+                    hit = hit || intersectSegment(segm.a, segm.b, v, w).first;
+                if (hit)
+                    crossing.push_back(id);
+            }
+            assert(index.containing(v, EVEN_ODD) == inside_even);
+            assert(index.containing(v, NON_ZERO) == inside_nonzero);
+            assert(index.touching(rect) == touching);
+            assert(index.crossing({v, w}) == crossing);
+        }
+    };
+    compare();
+
+    // перемещённые многоугольники переносятся в новые ячейки
+    for (int id = 0; id < 400; id += 3) {
+        polygons[id].move({coord(gen) / 4 - 50, coord(gen) / 4 - 50});
+        if (id % 2)
+            polygons[id].scale(1.7);
+        index.update(id);
+    }
+    for (int id = 1; id < 400; id += 7) {
+        index.remove(id);
+        alive[id] = 0;
+    }
+    assert(index.size() == polygons.size() - std::count(alive.begin(), alive.end(), 0));
+    compare();
+
+    // на больших координатах произведения разностей не помещаются в int
+    PolygonIndex big(4096);
+    Polyhedron square(vector<Vertex<int>>{{0, 0}, {200000, 0}, {200000, 200000}, {0, 200000}});
+    big.add(square);
+    assert(big.crossing({{-100000, 100000}, {300000, 100001}}) == vector<int>{0});
+    assert(big.crossing({{-100000, -90000}, {300000, -10}}).empty());
+    assert(big.crossing({{-100000, -90000}, {300000, 200000}}) == vector<int>{0});
+
+    bool thrown = false;
+    try {
+        index.update(1);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void TestRetainedScene() {
+    const string filename = "test_retained.gif";
+    const Magick::Color white(QuantumRange, QuantumRange, QuantumRange);
+    const Magick::Color blue(0, 0, QuantumRange), red(QuantumRange, 0, 0);
+    Kuboid kuboid(cubeFaces(90, 60, 0, 80));
+    auto center = convertToDoubleVertex(kuboid.getCenter());
+    auto frame = [&](int i) {
+        return kuboid.transformed(Transform::rotation(0.4, 0.3 * i, 0, center) * Transform::translation({3.0 * i, 0, 0}));
+    };
+    Polyhedron backdrop(vector<Vertex<int>>{{20, 20}, {200, 30}, {120, 150}});
+    vector<RetainedScene::Edge> diagonal = {{{0, 0}, {299, 199}}};
+
+    // отрисовка кадра с нуля в том же порядке примитивов
+    auto reference = [&](int i) {
+        Canvas canvas(300, 200, white);
+        backdrop.fill(canvas, red, EVEN_ODD);
+        frame(i).show(canvas, blue);
+        if (i < 6)
+            drawLines(diagonal, canvas, red);
+        return canvas;
+    };
+
+    RetainedScene scene(300, 200, white);
+    BoundingBox<int> box(backdrop.getSegments());
+    scene.add({box.getXMin(), box.getYMin(), box.getXMax() + 1, box.getYMax() + 1},
+              [&](CanvasView &view) { backdrop.fill(view, red, EVEN_ODD); });
+    int cube = scene.addLines({}, blue);
+    int line = scene.addLines(diagonal, red);
+    assert(scene.dirtyRects().size() == 1 && scene.dirtyRects()[0] == PixelRect({0, 0, 300, 200}));
+
+    const int N = 12;
+    vector<Canvas> expected;
+    {
+        GifWriter writer(filename, 300, 200);
+        renderRetainedAnimation(N, [&](int i, RetainedScene &s) {
+            s.updateLines(cube, frame(i).visibleEdges(), blue);
+            if (i == 6)
+                s.remove(line);
+        }, scene, writer);
+        // кадры, кроме удаления линии, меняют только область вокруг куба
+        scene.updateLines(cube, frame(N).visibleEdges(), blue);
+        for (auto &r: scene.dirtyRects())
+            assert(r.x1 - r.x0 < 200 && r.y1 - r.y0 < 200);
+        for (auto &r: scene.render())
+            writer.addFrame(scene.getCanvas(), r);
+        assert(scene.dirtyRects().empty());
+        assert(memcmp(scene.getCanvas().data(), reference(N).data(), sizeof(Canvas::Pixel) * 300 * 200) == 0);
+        // без изменений перерисовывать нечего, а кадр из одного пиксела сохраняет паузу
+        assert(scene.render().empty());
+        writer.addFrame(scene.getCanvas(), PixelRect{});
+    }
+    for (int i = 0; i < N; ++i)
+        expected.push_back(reference(i));
+
+    auto frames = decodeGif(filename);
+    // кадр N может прийти несколькими прямоугольниками; проверяются первые N кадров и последний
+    assert(frames.size() >= expected.size() + 2);
+    expected.push_back(reference(N));
+    frames.erase(frames.begin() + N, frames.end() - 1);
+    for (size_t i = 0; i < frames.size(); ++i) {
+        for (int y = 0; y < 200; ++y) {
+            for (int x = 0; x < 300; ++x)
+                assert(frames[i][(199 - y) * 300 + x] == expected[i].getPixel(x, y));
+        }
+    }
+
+    bool thrown = false;
+    try {
+        scene.remove(line);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+    remove(filename.c_str());
+}
+
+void TestPolygonStore() {
+    Arena arena(64);
+    auto *bytes = arena.allocate<char>(3);
+    auto *values = arena.allocate<double>(5);
+    assert(reinterpret_cast<uintptr_t>(values) % alignof(double) == 0);
+    assert((void *) values != (void *) bytes);
+    auto *big = arena.allocate<int>(1000); // больше блока — отдельный блок
+    big[999] = 1;
+    size_t reserved = arena.bytesReserved();
+    arena.reset();
+    assert(arena.bytesUsed() == 0);
+    arena.allocate<char>(3);
+    assert(arena.bytesReserved() == reserved);
+
+    mt19937 gen(12);
+    uniform_int_distribution<int> coord(0, 199);
+    PolygonStore store(4096);
+    vector<Polyhedron> reference;
+    size_t segment_bytes = 0;
+    for (int k = 0; k < 50; ++k) {
+        vector<Vertex<int>> points(3 + k % 7);
+        for (auto &p: points)
+            p = {coord(gen), coord(gen)};
+        store.add(points);
+        reference.emplace_back(points);
+        segment_bytes += sizeof(Segment<int>) * points.size();
+    }
+    assert(store.size() == 50);
+    assert(store.bytesUsed() * 2 < segment_bytes);
+
+    for (size_t k = 0; k < store.size(); ++k) {
+        const PolygonRef &pol = store[k];
+        // нормали те же, что у Polyhedron, хотя он может обходить вершины в обратном порядке
+        for (int i = 0; i < pol.size(); ++i) {
+            Segment<int> e = pol.edge(i);
+            bool found = false;
+            for (auto &segm: reference[k].getSegments()) {
+                if ((segm.a == e.a && segm.b == e.b) || (segm.a == e.b && segm.b == e.a))
+                    found = found || segm.n == e.n;
+            }
+            assert(found);
+        }
+        for (FillRule rule: {EVEN_ODD, NON_ZERO}) {
+            Canvas expected(200, 200), actual(200, 200);
+            reference[k].fill(expected, Magick::Color(0, 0, 0), rule);
+            pol.fill(actual, Magick::Color(0, 0, 0), rule);
+            assert(memcmp(expected.data(), actual.data(), sizeof(Canvas::Pixel) * 200 * 200) == 0);
+        }
+        Canvas expected(200, 200), actual(200, 200);
+        reference[k].drawBounds(expected, Magick::Color(0, 0, 0));
+        pol.drawBounds(actual, Magick::Color(0, 0, 0));
+        assert(memcmp(expected.data(), actual.data(), sizeof(Canvas::Pixel) * 200 * 200) == 0);
+    }
+
+    store.clear();
+    assert(store.size() == 0 && store.bytesUsed() == 0);
+    store.add(vector<Vertex<int>>{{0, 0}, {10, 0}, {0, 10}});
+    assert(store[0].toPolyhedron().getSegments().size() == 3);
+
+    bool thrown = false;
+    try {
+        store.add(vector<Vertex<int>>{{0, 0}, {1, 1}});
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void TestImageWriter() {
+    // заливки (серии), мелкие и крупные перепады цвета и шум — все коды QOI
+    mt19937 gen(11);
+    uniform_int_distribution<int> channel(0, 255);
+    Canvas canvas(150, 90);
+    Polyhedron(vector<Vertex<int>>{{10, 10}, {140, 30}, {60, 80}}).fillWithEvenOddRule(canvas, Magick::Color(0, 0, 0));
+    for (int y = 0; y < 30; ++y) {
+        for (int x = 0; x < 150; ++x)
+            canvas.setPixel(x, y, Canvas::packRGB(x, x + y / 3, 2 * x));
+    }
+    for (int x = 0; x < 150; ++x)
+        canvas.setPixel(x, 85, Canvas::packRGB(channel(gen), channel(gen), channel(gen)));
+
+    for (bool bottom_up: {true, false}) {
+        int width, height;
+        auto pixels = decodeQOI(encodeQOI(canvas, bottom_up), width, height);
+        assert(width == 150 && height == 90);
+        for (int y = 0; y < 90; ++y) {
+            for (int x = 0; x < 150; ++x)
+                assert(pixels[(bottom_up ? 89 - y : y) * 150 + x] == canvas.getPixel(x, y));
+        }
+    }
+
+    ostringstream ppm, pam;
+    writePPM(canvas, ppm);
+    writePAM(canvas, pam);
+    string header = "P6\n150 90\n255\n";
+    assert(ppm.str().size() == header.size() + 150 * 90 * 3 && ppm.str().starts_with(header));
+    auto last = Canvas::unpack(canvas.getPixel(7, 89));
+    assert(memcmp(ppm.str().data() + header.size() + 7 * 3, last.data(), 3) == 0);
+    header = "P7\nWIDTH 150\nHEIGHT 90\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+    assert(pam.str().size() == header.size() + 150 * 90 * 4 && pam.str().starts_with(header));
+    assert(memcmp(pam.str().data() + header.size(), canvas.row(89), 150 * 4) == 0);
+
+    // фоновая запись: холст можно менять сразу после write
+    const string filename = "test_image_writer.qoi";
+    Canvas expected = canvas;
+    {
+        AsyncImageWriter writer(1);
+        writer.write(canvas, filename);
+        canvas.clear(Canvas::packRGB(255, 0, 0));
+        writer.write(canvas, "test_image_writer.ppm");
+        writer.flush();
+        bool failed = false;
+        writer.write(canvas, "no_such_directory/image.qoi");
+        try {
+            writer.flush();
+        } catch (const std::runtime_error &) {
+            failed = true;
+        }
+        assert(failed);
+    }
+    ifstream in(filename, ios::binary);
+    vector<uint8_t> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    int width, height;
+    auto pixels = decodeQOI(data, width, height);
+    for (int y = 0; y < 90; ++y)
+        assert(memcmp(pixels.data() + (89 - y) * 150, expected.row(y), 150 * 4) == 0);
+    remove(filename.c_str());
+    remove("test_image_writer.ppm");
+}
+
+void TestSceneRenderer() {
+    const string filename = "test_scene.gif";
+    const Magick::Color black("black");
+    istringstream scene(
+            "# комментарий и пустая строка пропускаются\n"
+            "\n"
+            "canvas 120 100 white\n"
+            "translate 10 5\n"
+            "fill nonzero black 0 0 60 10 30 50\n"
+            "transform reset\n"
+            "line black 0 90 119 90\n"
+            "bezier black 5 5 60 95 115 5\n"
+            "cuboid visible black 70 40 0 30\n"
+            "save " + filename + "\n");
+    Canvas expected(120, 100);
+    Polyhedron(vector<Vertex<int>>{{10, 5}, {70, 15}, {40, 55}}).fillWithNonZeroWinding(expected, black);
+    drawLine(0, 90, 119, 90, expected, black);
+    drawBezierCurve({{5, 5}, {60, 95}, {115, 5}}, expected, black);
+    Kuboid(cubeFaces(70, 40, 0, 30)).show(expected, black);
+    {
+        ThreadPool pool(2);
+        SceneRenderer renderer(pool);
+        renderer.run(scene);
+        assert(renderer.getCanvas() != nullptr);
+        assert(memcmp(renderer.getCanvas()->data(), expected.data(), sizeof(Canvas::Pixel) * 120 * 100) == 0);
+    }
+    auto frames = decodeGif(filename);
+    assert(frames.size() == 1);
+    for (int y = 0; y < 100; ++y) {
+        for (int x = 0; x < 120; ++x)
+            assert(frames[0][(99 - y) * 120 + x] == expected.getPixel(x, y));
+    }
+    remove(filename.c_str());
+
+    // ошибки разбора сообщают номер строки
+    auto errorOf = [](const string &text) {
+        ThreadPool pool(1);
+        SceneRenderer renderer(pool);
+        istringstream in(text);
+        try {
+            renderer.run(in);
+        } catch (const std::runtime_error &e) {
+            return string(e.what());
+        }
+        return string();
+    };
+    assert(errorOf("canvas 10 10\nline black 0 0\n") == "SceneRenderer::execute line 2: expected at least 2 points");
+    assert(errorOf("line black 0 0 1 1\n") == "SceneRenderer::execute line 1: no canvas, use canvas W H first");
+    assert(errorOf("canvas 10 10\n\nfill odd black 0 0 5 0 0 5\n") ==
+           "SceneRenderer::execute line 3: unknown fill rule odd");
+    assert(errorOf("canvas 10 10\ntranslate 1 x\n") == "SceneRenderer::execute line 2: expected dy");
+    assert(errorOf("canvas 10 10\npolygon black 0 0 5 0 0\n") ==
+           "SceneRenderer::execute line 2: odd number of coordinates");
+    assert(errorOf("canvas 10 10\nspline black\n") == "SceneRenderer::execute line 2: unknown command spline");
+
+    // следующая сцена того же отрисовщика начинается с чистого состояния
+    ThreadPool pool(1);
+    SceneRenderer renderer(pool);
+    istringstream first("canvas 10 10\ntranslate 5 5\nperspective 0.5\n\n"), second("canvas 10 10\nline black 0 0 3 0\n");
+    renderer.run(first);
+    renderer.run(second);
+    assert(renderer.getCanvas()->getPixel(0, 0) == Canvas::pack(black));
+    assert(renderer.getCanvas()->getPixel(5, 5) == Canvas::pack(Magick::Color("white")));
+    istringstream third("# без холста\nline black 0 0 1 1\n");
+    string error;
+    try {
+        renderer.run(third);
+    } catch (const std::runtime_error &e) {
+        error = e.what();
+    }
+    assert(error == "SceneRenderer::execute line 2: no canvas, use canvas W H first");
+    assert(renderer.getCanvas() == nullptr);
+}
+
+void TestInstrumentation() {
+    int evaluated = 0;
+    [[maybe_unused]] auto count = [&] {
+        evaluated++;
+        return 1;
+    };
+#ifdef PAINTING_INSTRUMENTATION
+    uint64_t pixels = Instrumentation::total(PIXELS_WRITTEN), tests = Instrumentation::total(EDGE_TESTS);
+    uint64_t crossings = Instrumentation::total(INTERSECTIONS_FOUND);
+    uint64_t allocations = Instrumentation::total(ALLOCATIONS);
+    PAINTING_COUNT(MAP_LOOKUPS, count());
+    assert(evaluated == 1);
+    {
+        PAINTING_SCOPE("TestInstrumentation");
+        Canvas canvas(100, 100);
+        Polyhedron(vector<Vertex<int>>{{10, 10}, {90, 10}, {90, 90}, {10, 90}}).fillWithEvenOddRule(canvas, Magick::Color("black"));
+        assert(!Polyhedron(vector<Vertex<int>>{{0, 0}, {50, 50}, {50, 0}, {0, 50}}).IsSimple());
+    }
+    // квадрат 80 x 80 по полуоткрытым строкам и столбцам
+    assert(Instrumentation::total(PIXELS_WRITTEN) - pixels == 80 * 80);
+    assert(Instrumentation::total(EDGE_TESTS) > tests);
+    assert(Instrumentation::total(INTERSECTIONS_FOUND) > crossings);
+    assert(Instrumentation::total(ALLOCATIONS) > allocations);
+
+    ostringstream trace;
+    Instrumentation::writeChromeTrace(trace);
+    assert(trace.str().starts_with("{\"traceEvents\": ["));
+    assert(trace.str().find("\"name\": \"TestInstrumentation\", \"cat\": \"painting\", \"ph\": \"X\"") != string::npos);
+    assert(trace.str().find("\"name\": \"Polyhedron::IsSimple\"") != string::npos);
+    assert(trace.str().find("\"name\": \"pixels written\", \"ph\": \"C\"") != string::npos);
+#else
+    // без инструментирования аргументы макросов даже не вычисляются
+    PAINTING_COUNT(PIXELS_WRITTEN, count());
+    PAINTING_SCOPE("TestInstrumentation");
+    assert(evaluated == 0);
+#endif
+}
+
 void RunTests() {
     TestGetCombCoeffs();
     TestIsInsideSegment();
     TestIntersectSegment();
     TestIsConvex();
     TestIsSimple();
+    TestScanlineFill();
+    TestCanvasMatchesImage();
+    TestSweepLine();
+    TestOuterContour();
+    TestConvexClipper();
+    TestPolygonClipper();
+    TestPolygonHitTester();
+    TestBezierFlattening();
+    TestThreadPool();
+    TestTileRenderer();
+    TestGifWriter();
+    TestTransform();
+    TestMesh();
+    TestDrawLine();
+    TestMidpointArc();
+    TestStroker();
+    TestBooleanOps();
+    TestAntialiasedFill();
+    TestDepthRenderer();
+    TestPolygonStore();
+    TestSpatialIndex();
+    TestRetainedScene();
+    TestImageWriter();
+    TestSceneRenderer();
+    TestInstrumentation();
 }
\ No newline at end of file
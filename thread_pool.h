@@ -0,0 +1,212 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+using namespace std;
+
+/// Пул потоков с перехватом задач: у каждого потока своя очередь, свои задачи он берёт с конца,
+/// а когда она пуста — забирает самые старые задачи из очередей других потоков.
+/// Задачи можно объединять в группы (TaskGroup) и ждать только свою группу: ожидающий поток сам
+/// выполняет задачи из очередей, поэтому ждать группу можно и изнутри задачи того же пула.
+class ThreadPool {
+public:
+    /// Счётчик незавершённых задач одной группы
+    class TaskGroup {
+    private:
+        friend class ThreadPool;
+        atomic<size_t> pending = 0;
+
+    public:
+        TaskGroup() = default;
+
+        TaskGroup(const TaskGroup &) = delete;
+
+        TaskGroup &operator=(const TaskGroup &) = delete;
+
+        [[nodiscard]] bool done() const {
+            return pending == 0;
+        }
+    };
+
+private:
+    struct Task {
+        function<void()> run;
+        TaskGroup *group = nullptr;
+    };
+
+    struct Queue {
+        mutex m;
+        deque<Task> tasks;
+    };
+
+    vector<unique_ptr<Queue>> queues;
+    vector<thread> threads;
+    mutex sleep_m;
+    condition_variable wake, done;
+    size_t queued = 0;            /// задачи в очередях, под sleep_m
+    atomic<size_t> pending = 0;   /// задачи в очередях и выполняющиеся
+    atomic<size_t> next_queue = 0;
+    bool stop = false;
+
+    static inline thread_local const ThreadPool *current_pool = nullptr;
+    static inline thread_local size_t current_index = 0;
+
+    bool pop(size_t index, Task &task) {
+        // своя очередь — с конца
+        {
+            Queue &q = *queues[index];
+            lock_guard l(q.m);
+            if (!q.tasks.empty()) {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+                return true;
+            }
+        }
+        // чужие — с начала
+        for (size_t k = 1; k < queues.size(); ++k) {
+            Queue &q = *queues[(index + k) % queues.size()];
+            lock_guard l(q.m);
+            if (!q.tasks.empty()) {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool runOne(size_t index) {
+        Task task;
+        if (!pop(index, task))
+            return false;
+        {
+            lock_guard l(sleep_m);
+            queued--;
+        }
+        // поток, помогающий в wait, на время задачи считается потоком пула
+        const ThreadPool *outer_pool = current_pool;
+        size_t outer_index = current_index;
+        current_pool = this;
+        current_index = index;
+        task.run();
+        current_pool = outer_pool;
+        current_index = outer_index;
+        bool group_done = task.group && --task.group->pending == 0;
+        if (--pending == 0 || group_done) {
+            lock_guard l(sleep_m);
+            done.notify_all();
+        }
+        return true;
+    }
+
+    void push(Task task) {
+        size_t index = current_pool == this ? current_index : next_queue++ % queues.size();
+        pending++;
+        if (task.group)
+            task.group->pending++;
+        // счётчик растёт раньше, чем задачу можно забрать из очереди: иначе runOne уменьшит его первым
+        {
+            lock_guard l(sleep_m);
+            queued++;
+        }
+        {
+            Queue &q = *queues[index];
+            lock_guard l(q.m);
+            q.tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    /// Выполняет задачи из очередей, пока не выполнится finished()
+    template<class Pred>
+    void helpUntil(Pred &&finished) {
+        size_t index = current_pool == this ? current_index : 0;
+        while (!finished()) {
+            if (runOne(index))
+                continue;
+            unique_lock l(sleep_m);
+            done.wait(l, [&] { return finished() || queued > 0; });
+        }
+    }
+
+    void workerLoop(size_t index) {
+        current_pool = this;
+        current_index = index;
+        while (true) {
+            if (runOne(index))
+                continue;
+            unique_lock l(sleep_m);
+            wake.wait(l, [&] { return stop || queued > 0; });
+            if (stop && queued == 0)
+                return;
+        }
+    }
+
+public:
+    explicit ThreadPool(size_t count = thread::hardware_concurrency()) {
+        count = max<size_t>(count, 1);
+        for (size_t i = 0; i < count; ++i)
+            queues.push_back(make_unique<Queue>());
+        for (size_t i = 0; i < count; ++i)
+            threads.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool() {
+        wait();
+        {
+            lock_guard l(sleep_m);
+            stop = true;
+        }
+        wake.notify_all();
+        for (auto &t: threads)
+            t.join();
+    }
+
+    [[nodiscard]] size_t size() const {
+        return threads.size();
+    }
+
+    /// Задача из рабочего потока попадает в его очередь, остальные раскладываются по кругу
+    void submit(function<void()> task) {
+        push({std::move(task), nullptr});
+    }
+
+    /// Задача группы group: её завершения ждёт wait(group)
+    void submit(TaskGroup &group, function<void()> task) {
+        push({std::move(task), &group});
+    }
+
+    /// Ждёт завершения задач группы; вызывающий поток тоже выполняет задачи. Можно вызывать из задачи пула.
+    void wait(TaskGroup &group) {
+        helpUntil([&] { return group.pending == 0; });
+    }
+
+    /// Ждёт завершения всех задач пула. Задача пула ждала бы и саму себя, поэтому из неё нельзя
+    /// вызывать wait() — только wait(group).
+    void wait() {
+        if (current_pool == this)
+            throw std::runtime_error("ThreadPool::wait called from a pool task, wait for a TaskGroup instead");
+        helpUntil([&] { return pending == 0; });
+    }
+
+    /// Выполняет f(i) для всех 0 <= i < n и ждёт завершения только этих вызовов
+    template<class F>
+    void parallelFor(size_t n, F &&f) {
+        TaskGroup group;
+        for (size_t i = 0; i < n; ++i)
+            submit(group, [&f, i] { f(i); });
+        wait(group);
+    }
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "polyhedron.h"
+#include "thread_pool.h"
+
+/// Тайловая отрисовка: примитивы сначала накапливаются, затем раскладываются по тайлам, которых касается
+/// их прямоугольник, и тайлы растеризуются параллельно. Внутри тайла примитивы рисуются в порядке
+/// добавления теми же функциями, что и без тайлов, поэтому результат совпадает пиксел в пиксел.
+class TileRenderer {
+private:
+    enum PrimitiveType {
+        LINE,
+        FILL,
+        POLYLINE,
+    };
+
+    struct Primitive {
+        PrimitiveType type;
+        Magick::Color color;
+        PixelRect bounds;
+        Vertex<int> a, b;   /// концы отрезка или начало ломаной
+        int shape = -1;     /// индекс в fills или polylines
+        FillRule rule = EVEN_ODD;
+    };
+
+    int tile_size;
+    vector<Primitive> primitives;
+    vector<ScanlineFiller> fills;
+    vector<vector<Vertex<double>>> polylines;
+
+    static PixelRect pointBounds(const Vertex<int> &a, const Vertex<int> &b) {
+        return {min(a.x, b.x), min(a.y, b.y), max(a.x, b.x) + 1, max(a.y, b.y) + 1};
+    }
+
+    static PixelRect unite(const PixelRect &l, const PixelRect &r) {
+        return {min(l.x0, r.x0), min(l.y0, r.y0), max(l.x1, r.x1), max(l.y1, r.y1)};
+    }
+
+    void draw(const Primitive &p, CanvasView &view, vector<ScanlineFiller::Crossing> &active) const {
+        switch (p.type) {
+            case LINE:
+                drawLine(p.a, p.b, view, p.color);
+                break;
+            case FILL: {
+                const auto pen = makePen(view, p.color);
+                fills[p.shape].fill(p.rule, view.rect.y0, view.rect.y1, [&](int y, int x_from, int x_to) {
+                    plotSpan(view, y, x_from, x_to, pen);
+                }, active);
+                break;
+            }
+            case POLYLINE:
+                drawFlattened(p.a, polylines[p.shape], view, p.color);
+                break;
+        }
+    }
+
+public:
+    explicit TileRenderer(int _tile_size = 64) : tile_size(_tile_size) {
+        if (tile_size <= 0)
+            throw std::runtime_error("TileRenderer::Constructor tile size must be positive");
+    }
+
+    void clear() {
+        primitives.clear();
+        fills.clear();
+        polylines.clear();
+    }
+
+    void addLine(const Vertex<int> &a, const Vertex<int> &b, const Magick::Color &color) {
+        primitives.push_back({LINE, color, pointBounds(a, b), a, b});
+    }
+
+    void addLine(const Segment<int> &segm, const Magick::Color &color) {
+        addLine(segm.a, segm.b, color);
+    }
+
+    /// То же, что Polyhedron::fill
+    void addFill(const Polyhedron &pol, FillRule rule, const Magick::Color &color) {
+        auto &segments = pol.getSegments();
+        if (segments.size() <= 2)
+            return;
+        PixelRect bounds = pointBounds(segments[0].a, segments[0].a);
+        for (auto &segm: segments)
+            bounds = unite(bounds, pointBounds(segm.a, segm.b));
+
+        fills.emplace_back();
+        fills.back().addSegments(segments);
+        fills.back().prepare();
+        primitives.push_back({FILL, color, bounds, {}, {}, int(fills.size()) - 1, rule});
+    }
+
+    /// То же, что Polyhedron::drawBounds
+    void addBounds(const Polyhedron &pol, const Magick::Color &color) {
+        for (auto &segm: pol.getSegments())
+            addLine(segm, color);
+    }
+
+    /// То же, что drawBezierCurve
+    void addBezier(const vector<Vertex<int>> &points, const Magick::Color &color) {
+        if (points.empty())
+            return;
+        vector<Vertex<double>> polyline;
+        flattenBezier(points, BEZIER_TOLERANCE, polyline);
+        PixelRect bounds = pointBounds(points[0], points[0]);
+        for (auto &p: polyline) {
+            Vertex<int> v(roundToInt(p.x), roundToInt(p.y));
+            bounds = unite(bounds, pointBounds(v, v));
+        }
+        polylines.push_back(std::move(polyline));
+        primitives.push_back({POLYLINE, color, bounds, points[0], {}, int(polylines.size()) - 1});
+    }
+
+    void render(Canvas &canvas, ThreadPool &pool) const {
+        PAINTING_SCOPE("TileRenderer::render");
+        int tiles_x = (canvas.getWidth() + tile_size - 1) / tile_size;
+        int tiles_y = (canvas.getHeight() + tile_size - 1) / tile_size;
+
+        vector<vector<int>> bins(size_t(tiles_x) * tiles_y);
+        for (size_t i = 0; i < primitives.size(); ++i) {
+            PixelRect r = primitives[i].bounds.intersect(canvas.bounds());
+            if (r.empty())
+                continue;
+            for (int ty = r.y0 / tile_size; ty <= (r.y1 - 1) / tile_size; ++ty) {
+                for (int tx = r.x0 / tile_size; tx <= (r.x1 - 1) / tile_size; ++tx)
+                    bins[size_t(ty) * tiles_x + tx].push_back(i);
+            }
+        }
+
+        pool.parallelFor(bins.size(), [&](size_t t) {
+            if (bins[t].empty())
+                return;
+            PAINTING_SCOPE("TileRenderer::tile");
+            int tx = t % tiles_x, ty = t / tiles_x;
+            CanvasView view(canvas, {tx * tile_size, ty * tile_size, (tx + 1) * tile_size, (ty + 1) * tile_size});
+            vector<ScanlineFiller::Crossing> active;
+            for (int i: bins[t])
+                draw(primitives[i], view, active);
+        });
+    }
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "vertex.h"
+#include <array>
+#include <vector>
+#include <stdexcept>
+
+/// Вершины, хранящиеся отдельными массивами координат: так преобразование проходит по ним
+/// одним циклом, который компилятор векторизует
+struct VertexArray {
+    vector<double> x, y, z;
+
+    [[nodiscard]] size_t size() const {
+        return x.size();
+    }
+
+    void resize(size_t n) {
+        x.resize(n);
+        y.resize(n);
+        z.resize(n);
+    }
+
+    void clear() {
+        resize(0);
+    }
+
+    template<typename T>
+    void push_back(const Vertex<T> &v) {
+        x.push_back(v.x);
+        y.push_back(v.y);
+        z.push_back(v.z);
+    }
+
+    [[nodiscard]] Vertex<double> operator[](size_t i) const {
+        return {x[i], y[i], z[i]};
+    }
+
+    [[nodiscard]] Vertex<int> rounded(size_t i) const {
+        return {roundToInt(x[i]), roundToInt(y[i]), roundToInt(z[i])};
+    }
+};
+
+/// Преобразование однородных координат матрицей 4 x 4 (хранится по строкам, действует на столбец (x, y, z, 1)).
+/// Синусы и косинусы считаются один раз при построении, а не для каждой вершины.
+/// Композиция a * b означает «сначала b, потом a».
+class Transform {
+private:
+    array<double, 16> m;
+
+    [[nodiscard]] bool isAffine() const {
+        return m[12] == 0 && m[13] == 0 && m[14] == 0 && m[15] == 1;
+    }
+
+public:
+    Transform() : m{1, 0, 0, 0,
+                    0, 1, 0, 0,
+                    0, 0, 1, 0,
+                    0, 0, 0, 1} {}
+
+    explicit Transform(const array<double, 16> &_m) : m(_m) {}
+
+    [[nodiscard]] double operator()(int row, int col) const {
+        return m[row * 4 + col];
+    }
+
+    static Transform translation(const Vertex<double> &shift) {
+        return Transform({1, 0, 0, shift.x,
+                          0, 1, 0, shift.y,
+                          0, 0, 1, shift.z,
+                          0, 0, 0, 1});
+    }
+
+    static Transform scale(double sx, double sy, double sz) {
+        return Transform({sx, 0, 0, 0,
+                          0, sy, 0, 0,
+                          0, 0, sz, 0,
+                          0, 0, 0, 1});
+    }
+
+    static Transform scale(double s) {
+        return scale(s, s, s);
+    }
+
+    /// Тот же поворот, что и Vertex::rotate
+    static Transform rotation(double alpha, double betta, double gamma) {
+        double cos_a = cos(alpha), sin_a = sin(alpha);
+        double cos_b = cos(betta), sin_b = sin(betta);
+        double cos_g = cos(gamma), sin_g = sin(gamma);
+        return Transform({cos_b * cos_g, -sin_g * cos_b, sin_b, 0,
+                          sin_a * sin_b * cos_g + sin_g * cos_a, -sin_a * sin_b * sin_g + cos_a * cos_g,
+                          -sin_a * cos_b, 0,
+                          sin_a * sin_g - sin_b * cos_a * cos_g, sin_a * cos_g + sin_b * sin_g * cos_a,
+                          cos_a * cos_b, 0,
+                          0, 0, 0, 1});
+    }
+
+    static Transform rotation(double alpha, double betta, double gamma, const Vertex<double> &center) {
+        return around(rotation(alpha, betta, gamma), center);
+    }
+
+    /// Поворот на phi вокруг оси (x, y, z), как Vertex::rotateAboveAxes; ось нормируется
+    static Transform axisRotation(double x, double y, double z, double phi) {
+        double l = sqrt(x * x + y * y + z * z);
+        if (l == 0)
+            throw std::runtime_error("Transform::axisRotation zero axis");
+        double nx = x / l, ny = y / l, nz = z / l;
+        double c = cos(phi), s = sin(phi), t = 1 - c;
+        return Transform({c + nx * nx * t, nx * ny * t - nz * s, nx * nz * t + ny * s, 0,
+                          nx * ny * t + nz * s, c + ny * ny * t, ny * nz * t - nx * s, 0,
+                          nx * nz * t - ny * s, ny * nz * t + nx * s, c + nz * nz * t, 0,
+                          0, 0, 0, 1});
+    }
+
+    /// Одноточечная перспективная проекция с центром на оси z, как Kuboid::onePointProjection:
+    /// (x, y, z) -> (x, y, z) / (1 + r z)
+    static Transform projection(double r) {
+        return Transform({1, 0, 0, 0,
+                          0, 1, 0, 0,
+                          0, 0, 1, 0,
+                          0, 0, r, 1});
+    }
+
+    /// Преобразование t относительно точки center вместо начала координат
+    static Transform around(const Transform &t, const Vertex<double> &center) {
+        return translation(center) * t * translation(center * -1.0);
+    }
+
+    Transform operator*(const Transform &t) const {
+        Transform res;
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                double s = 0;
+                for (int k = 0; k < 4; ++k)
+                    s += m[i * 4 + k] * t.m[k * 4 + j];
+                res.m[i * 4 + j] = s;
+            }
+        }
+        return res;
+    }
+
+    [[nodiscard]] Vertex<double> apply(const Vertex<double> &v) const {
+        double x = m[0] * v.x + m[1] * v.y + m[2] * v.z + m[3];
+        double y = m[4] * v.x + m[5] * v.y + m[6] * v.z + m[7];
+        double z = m[8] * v.x + m[9] * v.y + m[10] * v.z + m[11];
+        if (isAffine())
+            return {x, y, z};
+        double w = m[12] * v.x + m[13] * v.y + m[14] * v.z + m[15];
+        return {x / w, y / w, z / w};
+    }
+
+    [[nodiscard]] Vertex<double> apply(const Vertex<int> &v) const {
+        return apply(convertToDoubleVertex(v));
+    }
+
+    /// Преобразование направления (нормали): без сдвига и перспективы
+    [[nodiscard]] Vertex<double> applyLinear(const Vertex<double> &v) const {
+        return {m[0] * v.x + m[1] * v.y + m[2] * v.z,
+                m[4] * v.x + m[5] * v.y + m[6] * v.z,
+                m[8] * v.x + m[9] * v.y + m[10] * v.z};
+    }
+
+    /// Преобразует все вершины in в out за один проход; in и out — разные массивы
+    void apply(const VertexArray &in, VertexArray &out) const {
+        if (&in == &out)
+            throw std::runtime_error("Transform::apply in and out must differ");
+        out.resize(in.size());
+        applyBatch(in.size(), in.x.data(), in.y.data(), in.z.data(), out.x.data(), out.y.data(), out.z.data());
+    }
+
+private:
+    /// Массивы не пересекаются, поэтому цикл векторизуется без проверок на наложение
+    void applyBatch(size_t n, const double *__restrict xs, const double *__restrict ys, const double *__restrict zs,
+                    double *__restrict ox, double *__restrict oy, double *__restrict oz) const {
+        const double m0 = m[0], m1 = m[1], m2 = m[2], m3 = m[3];
+        const double m4 = m[4], m5 = m[5], m6 = m[6], m7 = m[7];
+        const double m8 = m[8], m9 = m[9], m10 = m[10], m11 = m[11];
+        if (isAffine()) {
+            for (size_t i = 0; i < n; ++i) {
+                double x = xs[i], y = ys[i], z = zs[i];
+                ox[i] = m0 * x + m1 * y + m2 * z + m3;
+                oy[i] = m4 * x + m5 * y + m6 * z + m7;
+                oz[i] = m8 * x + m9 * y + m10 * z + m11;
+            }
+            return;
+        }
+        const double m12 = m[12], m13 = m[13], m14 = m[14], m15 = m[15];
+        for (size_t i = 0; i < n; ++i) {
+            double x = xs[i], y = ys[i], z = zs[i];
+            double w = 1 / (m12 * x + m13 * y + m14 * z + m15);
+            ox[i] = (m0 * x + m1 * y + m2 * z + m3) * w;
+            oy[i] = (m4 * x + m5 * y + m6 * z + m7) * w;
+            oz[i] = (m8 * x + m9 * y + m10 * z + m11) * w;
+        }
+    }
+};
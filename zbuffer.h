@@ -0,0 +1,216 @@
+#pragma once
+
+#include "mesh.h"
+#include "scanline.h"
+#include <limits>
+
+/// Буфер глубины: для каждого пиксела — глубина ближайшей уже нарисованной точки.
+/// Дополнительно для каждого тайла хранится наибольшая глубина его пикселов: если грань
+/// целиком дальше её, то в этом тайле грань не видна и пикселы можно не проверять.
+class DepthBuffer {
+private:
+    int width, height, tile_size;
+    int tiles_x, tiles_y;
+    vector<float> depth;
+    vector<float> tile_max;
+
+public:
+    static constexpr float FAR = numeric_limits<float>::infinity();
+
+    DepthBuffer(int _width, int _height, int _tile_size = 16)
+            : width(_width), height(_height), tile_size(_tile_size) {
+        if (width <= 0 || height <= 0 || tile_size <= 0)
+            throw std::runtime_error("DepthBuffer::Constructor wrong size");
+        tiles_x = (width + tile_size - 1) / tile_size;
+        tiles_y = (height + tile_size - 1) / tile_size;
+        clear();
+    }
+
+    void clear() {
+        depth.assign(size_t(width) * height, FAR);
+        tile_max.assign(size_t(tiles_x) * tiles_y, FAR);
+    }
+
+    [[nodiscard]] PixelRect bounds() const {
+        return {0, 0, width, height};
+    }
+
+    [[nodiscard]] int getTileSize() const {
+        return tile_size;
+    }
+
+    [[nodiscard]] int tileIndex(int x, int y) const {
+        return (y / tile_size) * tiles_x + x / tile_size;
+    }
+
+    [[nodiscard]] float at(int x, int y) const {
+        return depth[size_t(y) * width + x];
+    }
+
+    /// Точка с глубиной z ближе записанной: тогда глубина обновляется
+    bool testAndSet(int x, int y, float z) {
+        float &d = depth[size_t(y) * width + x];
+        if (z >= d)
+            return false;
+        d = z;
+        return true;
+    }
+
+    /// Грань с наименьшей глубиной z_min может быть видна в тайле
+    [[nodiscard]] bool mayPass(int tile, float z_min) const {
+        return z_min < tile_max[tile];
+    }
+
+    /// Пересчитывает наибольшую глубину тайла после записи в него
+    void updateTile(int tile) {
+        int tx = tile % tiles_x, ty = tile / tiles_x;
+        int x_end = min(width, (tx + 1) * tile_size), y_end = min(height, (ty + 1) * tile_size);
+        float m = 0;
+        for (int y = ty * tile_size; y < y_end; ++y) {
+            const float *row = depth.data() + size_t(y) * width;
+            for (int x = tx * tile_size; x < x_end; ++x)
+                m = max(m, row[x]);
+        }
+        tile_max[tile] = m;
+    }
+};
+
+/// Закрашенные грани сеток с удалением невидимых точек по буферу глубины. Вершины проецируются
+/// так же, как в Mesh::onePointProjection: (x, y, z) / (1 + r z), наблюдатель смотрит вдоль оси z,
+/// меньшая глубина — ближе. Внутренность грани заполняется построчной заливкой, а глубина вдоль
+/// отрезка строки растёт линейно: проекция переводит плоскость грани в плоскость.
+/// Цвет грани зависит от угла между её нормалью и направлением взгляда.
+class DepthRenderer {
+private:
+    DepthBuffer buffer;
+    double r;
+    double ambient;
+    ScanlineFiller filler;
+    vector<char> touched;
+    size_t rejected_faces = 0;
+
+public:
+    DepthRenderer(int width, int height, double _r, double _ambient = 0.25, int tile_size = 16)
+            : buffer(width, height, tile_size), r(_r), ambient(_ambient) {}
+
+    void clear() {
+        buffer.clear();
+        rejected_faces = 0;
+    }
+
+    [[nodiscard]] const DepthBuffer &getBuffer() const {
+        return buffer;
+    }
+
+    /// Грани, целиком отброшенные по тайлам ещё до заливки
+    [[nodiscard]] size_t rejectedFaces() const {
+        return rejected_faces;
+    }
+
+    template<RasterTarget Img>
+    void drawMesh(const Mesh &mesh, Img &img, const Magick::Color &color) {
+        PAINTING_SCOPE("DepthRenderer::drawMesh");
+        VertexArray world = mesh.transformedVertices();
+        VertexArray screen;
+        Transform::projection(r).apply(world, screen);
+
+        Vertex<double> center(0, 0, 0);
+        for (size_t i = 0; i < world.size(); ++i)
+            center += world[i];
+        center = center / double(world.size());
+        const bool closed = mesh.isClosed();
+        const Vertex<double> eye(0, 0, r == 0 ? -numeric_limits<double>::infinity() : -1 / r);
+        const PixelRect area = buffer.bounds().intersect(targetBounds(img));
+        const int tile_size = buffer.getTileSize();
+
+        for (int f = 0; f < mesh.faceCount(); ++f) {
+            auto face = mesh.face(f);
+            // нормаль по Ньюэллу: устойчива и для неплоских граней
+            Vertex<double> n(0, 0, 0), s(0, 0, 0), face_center(0, 0, 0);
+            for (size_t i = 0; i < face.size(); ++i) {
+                Vertex<double> a = world[face[i]], b = world[face[(i + 1) % face.size()]];
+                n += Vertex<double>((a.y - b.y) * (a.z + b.z), (a.z - b.z) * (a.x + b.x), (a.x - b.x) * (a.y + b.y));
+                Vertex<double> pa = screen[face[i]], pb = screen[face[(i + 1) % face.size()]];
+                s += Vertex<double>((pa.y - pb.y) * (pa.z + pb.z), (pa.z - pb.z) * (pa.x + pb.x),
+                                    (pa.x - pb.x) * (pa.y + pb.y));
+                face_center += a;
+            }
+            face_center = face_center / double(face.size());
+            if (n * (face_center - center) < 0)
+                n = n * -1.0;
+            Vertex<double> view = r == 0 ? Vertex<double>(0, 0, 1) : face_center - eye;
+            if (closed && n * view >= 0)
+                continue; // грань обращена от наблюдателя
+            if (s.z == 0)
+                continue; // грань видна с ребра
+
+            // глубина на экране: z = z0 - (s.x (x - x0) + s.y (y - y0)) / s.z
+            Vertex<double> p0 = screen[face[0]];
+            const double dzdx = -s.x / s.z, dzdy = -s.y / s.z;
+            PixelRect box = {INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+            float z_min = DepthBuffer::FAR;
+            for (int i: face) {
+                Vertex<double> p = screen[i];
+                box.x0 = min(box.x0, int(floor(p.x)));
+                box.y0 = min(box.y0, int(floor(p.y)));
+                box.x1 = max(box.x1, int(ceil(p.x)) + 1);
+                box.y1 = max(box.y1, int(ceil(p.y)) + 1);
+                z_min = min(z_min, float(p.z));
+            }
+            box = box.intersect(area);
+            if (box.empty())
+                continue;
+
+            // раннее отсечение: грань дальше всего, что уже есть во всех задетых тайлах
+            bool may_pass = false;
+            for (int ty = box.y0 / tile_size; ty <= (box.y1 - 1) / tile_size && !may_pass; ++ty) {
+                for (int tx = box.x0 / tile_size; tx <= (box.x1 - 1) / tile_size && !may_pass; ++tx)
+                    may_pass = buffer.mayPass(buffer.tileIndex(tx * tile_size, ty * tile_size), z_min);
+            }
+            if (!may_pass) {
+                rejected_faces++;
+                continue;
+            }
+
+            double cos_angle = view.mod() == 0 ? 1 : -(n * view) / (n.mod() * view.mod());
+            double light = ambient + (1 - ambient) * max(0.0, cos_angle);
+            const auto pen = makePen(img, Magick::Color(color.quantumRed() * light, color.quantumGreen() * light,
+                                                        color.quantumBlue() * light));
+
+            filler.clear();
+            for (size_t i = 0; i < face.size(); ++i) {
+                Vertex<double> a = screen[face[i]], b = screen[face[(i + 1) % face.size()]];
+                filler.addEdge(Vertex<double>(a.x, a.y), Vertex<double>(b.x, b.y));
+            }
+            // тайлы прямоугольника грани, в которые что-то записано
+            const int tx0 = box.x0 / tile_size, ty0 = box.y0 / tile_size;
+            const int tiles_x = (box.x1 - 1) / tile_size - tx0 + 1, tiles_y = (box.y1 - 1) / tile_size - ty0 + 1;
+            touched.assign(size_t(tiles_x) * tiles_y, 0);
+            filler.fill(EVEN_ODD, box.y0, box.y1, [&](int y, int x_from, int x_to) {
+                x_from = max(x_from, box.x0);
+                x_to = min(x_to, box.x1);
+                double z_row = p0.z + dzdx * (x_from - p0.x) + dzdy * (y - p0.y);
+                // отрезок строки по тайлам: в тайлах, где грань заведомо закрыта, пикселы пропускаются
+                for (int x = x_from; x < x_to;) {
+                    int tile = buffer.tileIndex(x, y);
+                    int chunk_end = min(x_to, (x / tile_size + 1) * tile_size);
+                    if (buffer.mayPass(tile, z_min)) {
+                        for (int xi = x; xi < chunk_end; ++xi) {
+                            if (buffer.testAndSet(xi, y, float(z_row + dzdx * (xi - x_from)))) {
+                                plot(img, xi, y, pen);
+                                touched[(y / tile_size - ty0) * tiles_x + x / tile_size - tx0] = 1;
+                            }
+                        }
+                    }
+                    x = chunk_end;
+                }
+            });
+            for (int ty = 0; ty < tiles_y; ++ty) {
+                for (int tx = 0; tx < tiles_x; ++tx) {
+                    if (touched[ty * tiles_x + tx])
+                        buffer.updateTile(buffer.tileIndex((tx0 + tx) * tile_size, (ty0 + ty) * tile_size));
+                }
+            }
+        }
+    }
+};